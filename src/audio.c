@@ -3,110 +3,254 @@
 */
 #include <stdint.h>
 #include <stdio.h>
+#include <string.h>
 
 #include "SDL2/SDL.h"
 
 #include "qp.h"
 #include "audio.h"
 #include "lib/vgm.h"
+#include "lib/trace.h"
+
+#define GOVERNOR_HIGH 0.8 // step down when the load is above this
+#define GOVERNOR_LOW 0.4 // step up when the load is below this
+#define GOVERNOR_DOWN_HOLD 0.5 // seconds to wait after a tier change
+#define GOVERNOR_UP_HOLD 5.0
+
+// Measure the callback time against the buffer length, and change the
+// quality tier if needed.
+static void QP_AudioGovernor(QP_AudioCallbackData* S,Uint64 elapsed)
+{
+    double buffer = (double)S->SampleCount/S->SampleRate;
+    double load = (double)elapsed/SDL_GetPerformanceFrequency()/buffer;
+    int tier = S->QualityTier;
+
+    // the callback took longer than the buffer it filled
+    if(load > 1.0)
+        TRACE_INSTANT("deadline miss","load %",(int)(load*100));
+
+    // react to peaks quickly, but recover slowly
+    S->Load += (load - S->Load) * (load > S->Load ? 0.5 : 0.05);
+
+    if(S->QualityHold > 0)
+    {
+        S->QualityHold--;
+        return;
+    }
+
+    if(S->Load > GOVERNOR_HIGH && tier < QPAUDIO_TIER_COUNT-1)
+        tier++;
+    else if(S->Load < GOVERNOR_LOW && tier > QPAUDIO_TIER_FULL)
+        tier--;
+    else
+        return;
+
+    S->QualityHold = (tier > S->QualityTier ? GOVERNOR_DOWN_HOLD : GOVERNOR_UP_HOLD) / buffer;
+    S->QualityTier = tier;
+    S->TierChanges++;
+    Q_DEBUG("audio load %.0f%%, quality tier %d\n",S->Load*100,tier);
+}
+
+#define IDLE_DELAY 1.0 // seconds of silence before the audio goes idle
+
+// Returns nonzero if nothing is playing or requested, and the output has
+// been silent for a while. The driver and chip don't need to be updated
+// until this changes.
+static int QP_AudioIsIdle(QP_AudioCallbackData* S)
+{
+    int i;
+    if(Game->PlaylistControl || Game->QueueSong >= 0 || Game->ActionTimer || Game->VgmLog)
+        return 0;
+    if(S->TriggerRead != __atomic_load_n(&S->TriggerWrite,__ATOMIC_ACQUIRE))
+        return 0;
+    for(i=0;i<DriverGetSlotCount();i++)
+    {
+        if(DriverGetSongStatus(i))
+            return 0;
+    }
+    // the silence timer doesn't advance while idle
+    return S->Idle || DriverGetSilenceTime() >= IDLE_DELAY;
+}
+
+static void QP_AudioPreTickCallback(void* data)
+{
+    DriverUpdateBegin();
+}
+
+static void QP_AudioTickCallback(void* data)
+{
+    if(Game->VgmLog)
+    {
+        vgm_delay(&Game->Vgm,441000/DriverGetTickRate());
+    }
+    GameDoUpdate(Game);
+    DriverPublishSnapshot();
+    DriverUpdateEnd();
+}
+
+// Returns the buffer position of the next trigger, or SampleCount if there
+// is none. Triggers keep their position relative to the previous callback.
+static int QP_AudioTriggerPos(QP_AudioCallbackData* S,int pos)
+{
+    QP_AudioTrigger* t;
+    Uint64 elapsed;
+    int64_t frame;
+    if(S->TriggerRead == __atomic_load_n(&S->TriggerWrite,__ATOMIC_ACQUIRE))
+        return S->SampleCount;
+    t = &S->Trigger[S->TriggerRead & (QPAUDIO_TRIGGERS-1)];
+    elapsed = t->Time > S->LastCallback ? t->Time - S->LastCallback : 0;
+    frame = (double)elapsed * S->SampleRate / SDL_GetPerformanceFrequency();
+    if(!S->LastCallback || frame < pos)
+        frame = pos;
+    if(frame >= S->SampleCount)
+        frame = S->SampleCount-1;
+    return frame;
+}
+
+static void QP_AudioTriggerRun(QP_AudioCallbackData* S)
+{
+    QP_AudioTrigger* t = &S->Trigger[S->TriggerRead & (QPAUDIO_TRIGGERS-1)];
+    if(DriverInterface)
+    {
+        DriverUpdateBegin();
+        DriverRequestSong(t->Slot,t->Id);
+        DriverUpdateEnd();
+        QP_RenderTriggerTick(&S->Render);
+    }
+    __atomic_store_n(&S->TriggerRead,S->TriggerRead+1,__ATOMIC_RELEASE);
+}
 
 void QP_AudioCallback(void* data,Uint8* astream,int len)
 {
     QP_AudioCallbackData* S = (QP_AudioCallbackData*)data;
     float* stream = (float*)astream;
+    float chip[RENDER_BATCH*4];
+    float* ChipOut;
 
-    int i,j;
-    float ChipOut[4] = {0,0,0,0};
+    int i,j,k,n,next;
 
     int updatemode = S->UpdateRequest;
+    int flags = 0;
+    int quality = 0;
+    Uint64 start = SDL_GetPerformanceCounter();
+
+    TRACE_THREAD_NAME("audio");
+    TRACE_BEGIN_ARG("audio callback","frames",S->SampleCount);
+    if(QP_AudioIsIdle(S))
+    {
+        if(!S->Idle)
+        {
+            S->Idle = 1;
+            DriverPublishSnapshot();
+            Q_DEBUG("audio idle\n");
+        }
+        memset(astream,0,len);
+        if(S->FileLogging)
+        {
+            wav_write(S->WavFile,(float*)astream,S->SampleCount);
+            S->LogSamples += S->SampleCount;
+        }
+        S->LastCallback = start;
+        TRACE_END("audio callback");
+        return;
+    }
+    S->Idle = 0;
 
-    double ChipDelta = (double)DriverGetChipRate()/S->SampleRate;
-    double DriverDelta = (double)DriverGetTickRate()/S->SampleRate;
+    QP_RenderSetDriver(&S->Render,DriverInterface,S->SampleRate);
+    S->Render.PreTickCallback = QP_AudioPreTickCallback;
+    S->Render.TickCallback = QP_AudioTickCallback;
 
     if(S->FastForward)
-        DriverDelta *= 32;
+        S->Render.DriverDelta *= (S->QualityTier >= QPAUDIO_TIER_FF_LIMIT) ? 8 : 32;
 
-    for(i=0;i<S->SampleCount;i++)
-    {
-        if(updatemode & QPAUDIO_DRV_PLAY)
-        {
-            S->DriverUpdate += DriverDelta;
-            while(S->DriverUpdate > 1)
-            {
-                DriverUpdateTick();
-                //Q_UpdateTick(S->QDrv);
+    if(S->MuteRear)
+        quality |= QUALITY_NO_REAR;
+    if(S->QualityTier >= QPAUDIO_TIER_NO_INTERPOLATION)
+        quality |= QUALITY_NO_INTERPOLATION;
+    DriverSetQuality(quality);
 
-                if(Game->VgmLog)
-                {
-                    vgm_delay(441000/DriverGetTickRate());
-                }
-                S->DriverUpdate-=1;
+    if(updatemode & QPAUDIO_DRV_PLAY)
+        flags |= QP_RENDER_TICK;
+    if(updatemode & QPAUDIO_CHIP_PLAY)
+        flags |= QP_RENDER_CHIP;
 
-                GameDoUpdate(Game);
-            }
-        }
-        if(updatemode & QPAUDIO_CHIP_PLAY)
-        {
-            S->ChipUpdate += ChipDelta;
-            while(S->ChipUpdate > 1)
-            {
-                DriverUpdateChip();
-                S->ChipUpdate-=1;
-            }
+    for(i=0;i<S->SampleCount;i+=n)
+    {
+        // blocks are split at triggers, so that the tick is sample accurate
+        while((next = QP_AudioTriggerPos(S,i)) <= i)
+            QP_AudioTriggerRun(S);
+        n = QP_RenderRun(&S->Render,chip,next-i,flags,S->MuteRear ? 2 : 4);
 
-            DriverSampleChip(ChipOut,S->MuteRear ? 2 : 4);
-        }
-        if(~updatemode & QPAUDIO_MUTE)
+        // gain may be changed by the tick callback
+        for(k=0;k<n;k++)
         {
-            if(S->OutChannels==1)
-                *stream = S->Gain*(ChipOut[0]+ChipOut[1]+ChipOut[2]+ChipOut[3]);
-            else if(S->OutChannels==2)
-            {
-                stream[0] = S->Gain*(ChipOut[0]+ChipOut[2]);
-                stream[1] = S->Gain*(ChipOut[1]+ChipOut[3]);
-            }
-            else if(S->OutChannels==4)
+            ChipOut = chip+k*4;
+            if(~updatemode & QPAUDIO_MUTE)
             {
-                stream[0] = S->Gain*ChipOut[0];
-                stream[1] = S->Gain*ChipOut[1];
-                stream[2] = S->Gain*ChipOut[2];
-                stream[3] = S->Gain*ChipOut[3];
+                if(S->OutChannels==1)
+                    *stream = S->Gain*(ChipOut[0]+ChipOut[1]+ChipOut[2]+ChipOut[3]);
+                else if(S->OutChannels==2)
+                {
+                    stream[0] = S->Gain*(ChipOut[0]+ChipOut[2]);
+                    stream[1] = S->Gain*(ChipOut[1]+ChipOut[3]);
+                }
+                else if(S->OutChannels==4)
+                {
+                    stream[0] = S->Gain*ChipOut[0];
+                    stream[1] = S->Gain*ChipOut[1];
+                    stream[2] = S->Gain*ChipOut[2];
+                    stream[3] = S->Gain*ChipOut[3];
+                }
+                else
+                {
+                    // unlikely...
+                    for(j=0;j<S->OutChannels;j++)
+                        stream[j] = ChipOut[0]+ChipOut[1]+ChipOut[2]+ChipOut[3];
+                }
             }
             else
             {
-                // unlikely...
                 for(j=0;j<S->OutChannels;j++)
-                    stream[j] = ChipOut[0]+ChipOut[1]+ChipOut[2]+ChipOut[3];
+                    stream[j] = 0;
             }
-        }
-        else
-        {
-            for(j=0;j<S->OutChannels;j++)
-                stream[j] = 0;
-        }
 
-        stream += S->OutChannels;
+            stream += S->OutChannels;
+        }
     }
 
+    // the tick callback publishes the snapshot while the driver is running
+    if(~flags & QP_RENDER_TICK && DriverInterface)
+        DriverPublishSnapshot();
+
     if(S->FileLogging)
     {
-        fwrite(astream,S->OutChannels*4,S->SampleCount,S->logfile);
+        wav_write(S->WavFile,(float*)astream,S->SampleCount);
         S->LogSamples += S->SampleCount;
     }
 
+    QP_AudioGovernor(S,SDL_GetPerformanceCounter()-start);
+    S->LastCallback = start;
+    TRACE_END("audio callback");
 }
 
 int QP_AudioInit(QP_Audio* audio,int SampleRate,int SampleCount,int ChannelCount,char *AudioDevice)
 {
     audio->Enabled = 0;
     //audio->state.SampleRate = SampleRate;
-    audio->state.ChipUpdate = 0;
-    audio->state.DriverUpdate=0;
+    QP_RenderInit(&audio->state.Render);
     audio->state.MuteRear=0;
     audio->state.Gain=2.0;
     audio->state.FastForward=0;
     audio->state.FileLogging=0;
     audio->state.LogSamples=0;
+    audio->state.Load=0;
+    audio->state.QualityTier=QPAUDIO_TIER_FULL;
+    audio->state.QualityHold=0;
+    audio->state.TierChanges=0;
+    audio->state.Idle=0;
+    audio->state.TriggerWrite=0;
+    audio->state.TriggerRead=0;
+    audio->state.LastCallback=0;
 
     SDL_AudioSpec req;
     SDL_zero(req);
@@ -159,71 +303,72 @@ void QP_AudioTogglePause(QP_Audio* audio)
     SDL_PauseAudioDevice(audio->dev,audio->Enabled);
 }
 
-int QP_AudioWavOpen(QP_Audio* audio, char* filename)
+int QP_AudioTriggerSong(QP_Audio* audio,int slot,int id)
 {
-    audio->state.logfile = NULL;
-    audio->state.logfile = fopen(filename,"wb");
-    audio->state.LogSamples=0;
-    audio->state.FileLogging = 0;
-    if(!audio->state.logfile)
+    QP_AudioCallbackData* S = &audio->state;
+    uint32_t w = S->TriggerWrite;
+    QP_AudioTrigger* t;
+    // Enabled is set while paused
+    if(!audio->Initialized || audio->Enabled)
+        return -1;
+    if(w - __atomic_load_n(&S->TriggerRead,__ATOMIC_ACQUIRE) >= QPAUDIO_TRIGGERS)
+        return -1;
+    t = &S->Trigger[w & (QPAUDIO_TRIGGERS-1)];
+    t->Slot = slot;
+    t->Id = id;
+    t->Time = SDL_GetPerformanceCounter();
+    __atomic_store_n(&S->TriggerWrite,w+1,__ATOMIC_RELEASE);
+    return 0;
+}
+
+int QP_AudioWavOpen(QP_Audio* audio, char* filename, int format)
+{
+    wavfile_t* w = wav_open(filename,audio->state.OutChannels,audio->state.SampleRate,format);
+    if(!w)
         return -1;
+    QP_AudioWavAttach(audio,w);
+    return 0;
+}
+
+void QP_AudioWavAttach(QP_Audio* audio, wavfile_t* w)
+{
+    if(audio->Initialized)
+        SDL_LockAudioDevice(audio->dev);
+    audio->state.WavFile = w;
+    audio->state.LogSamples = 0;
     audio->state.FileLogging = 1;
+    if(audio->Initialized)
+        SDL_UnlockAudioDevice(audio->dev);
+}
 
-    int i;
-    for(i=0;i<58;i++)
+wavfile_t* QP_AudioWavDetach(QP_Audio* audio)
+{
+    // make sure the callback is done with the file
+    if(audio->Initialized)
+        SDL_LockAudioDevice(audio->dev);
+    wavfile_t* w = audio->state.FileLogging ? audio->state.WavFile : NULL;
+    audio->state.FileLogging = 0;
+    audio->state.WavFile = NULL;
+    if(audio->Initialized)
+        SDL_UnlockAudioDevice(audio->dev);
+    return w;
+}
+
+int QP_AudioWavFinish(wavfile_t* w)
+{
+    if(!w)
+        return 0;
+    if(wav_dropped(w))
+        printf("WAV log dropped %llu frames\n",(unsigned long long)wav_dropped(w));
+    if(wav_close(w))
     {
-        putc(0,audio->state.logfile);
+        printf("WAV log could not be written completely\n");
+        return -1;
     }
-
     return 0;
 }
 
-void QP_AudioWavClose(QP_Audio* audio)
+int QP_AudioWavClose(QP_Audio* audio)
 {
-    audio->state.FileLogging=0;
-    FILE* f = audio->state.logfile;
-    if(!f)
-        return;
-
-    uint32_t a;
-
-    uint32_t c = audio->state.OutChannels;
-    uint32_t b = audio->state.SampleRate;
-    uint32_t d = 4; // bytes per sample
-
-    uint32_t samplecount = audio->state.LogSamples * c;
-    uint32_t chunksize = samplecount * d;
-    uint32_t chunksize2 = chunksize+50;
-
-    fseek(f,0,SEEK_SET);
-    fwrite("RIFF",4,1,f);           // ms id
-    fwrite(&chunksize2,4,1,f);      // file size - 8
-
-    fwrite("WAVE",4,1,f);           // Format id
-
-    fwrite("fmt ",4,1,f);           // chunk id
-    a=18;                           // chunk size
-    fwrite(&a,4,1,f);
-    a=3;                            // audio format (Float)
-    fwrite(&a,2,1,f);
-    fwrite(&c,2,1,f);               // amount of channels
-    fwrite(&b,4,1,f);               // sample rate
-    a=d*c*b;                        // bytes per second
-    fwrite(&a,4,1,f);
-    a=d*c;                          // bytes per sample
-    fwrite(&a,2,1,f);
-    a=d*8;                          // bits per sample
-    fwrite(&a,2,1,f);
-    a=0;                            // extension
-    fwrite(&a,2,1,f);
-
-    fwrite("fact",4,1,f);           // chunk id
-    a=4;                            // chunk size
-    fwrite(&a,4,1,f);
-    fwrite(&samplecount,4,1,f);     // sample count
-
-    fwrite("data",4,1,f);           // chunk id
-    fwrite(&chunksize,4,1,f);       // data size
-
-    fclose(audio->state.logfile);
+    return QP_AudioWavFinish(QP_AudioWavDetach(audio));
 }
@@ -5,11 +5,32 @@
 
 #include "SDL2/SDL_audio.h"
 
+#include "render.h"
+#include "lib/wav.h"
+
 enum {
     QPAUDIO_DRV_PLAY = 1,
     QPAUDIO_CHIP_PLAY = 2,
     QPAUDIO_MUTE = 4,
 };
+// Quality tiers, the audio callback steps down when it can't keep up.
+enum {
+    QPAUDIO_TIER_FULL = 0,
+    QPAUDIO_TIER_FF_LIMIT, // fast forward speed is limited
+    QPAUDIO_TIER_NO_INTERPOLATION, // no sample interpolation
+    QPAUDIO_TIER_COUNT
+};
+// buffer size in low latency mode
+#define QPAUDIO_LOW_LATENCY_BUFFER 256
+#define QPAUDIO_TRIGGERS 64 // must be a power of two
+
+// Song request, acted on at the matching position in the next buffer.
+typedef struct {
+    int Slot;
+    int Id;
+    Uint64 Time; // SDL_GetPerformanceCounter when requested
+} QP_AudioTrigger;
+
 typedef struct {
 
     //Q_State *QDrv;
@@ -23,8 +44,7 @@ typedef struct {
 
     int FastForward;
 
-    double ChipUpdate;
-    double DriverUpdate;
+    QP_Render Render;
 
     float Gain;
 
@@ -33,8 +53,22 @@ typedef struct {
     int SampleCount;
 
     int FileLogging;
-    FILE* logfile;
-    uint32_t LogSamples;
+    wavfile_t* WavFile;
+    uint64_t LogSamples;
+
+    // load governor
+    double Load; // callback time / buffer length, smoothed
+    int QualityTier;
+    int QualityHold; // callbacks until the tier can change again
+    int TierChanges;
+
+    int Idle; // set while nothing is playing, the driver and chip are not updated
+
+    // song triggers, written by QP_AudioTriggerSong and read by the callback
+    QP_AudioTrigger Trigger[QPAUDIO_TRIGGERS];
+    uint32_t TriggerWrite;
+    uint32_t TriggerRead;
+    Uint64 LastCallback; // start time of the previous callback
 
 } QP_AudioCallbackData;
 
@@ -54,6 +88,22 @@ void QP_AudioClose(QP_Audio* audio);
 void QP_AudioSetPause(QP_Audio* audio,int pause);
 void QP_AudioTogglePause(QP_Audio* audio);
 
-int  QP_AudioWavOpen(QP_Audio* audio, char* filename);
-void QP_AudioWavClose(QP_Audio* audio);
+// Request a song with low latency. The request is timestamped, and the
+// callback starts the song at the same position within the next buffer,
+// with a driver tick run right there. Latency is then one buffer, without
+// the jitter of waiting for the next tick. Returns -1 if the queue is full
+// or audio is not playing, use DriverRequestSong then.
+int  QP_AudioTriggerSong(QP_Audio* audio,int slot,int id);
+
+// format is one of WAV_FLOAT, WAV_PCM16, WAV_PCM24
+int  QP_AudioWavOpen(QP_Audio* audio, char* filename, int format);
+// Returns -1 if the log could not be written completely.
+int  QP_AudioWavClose(QP_Audio* audio);
+// Log to a file opened with wav_open at the output rate and channel count.
+// Any previous log must be detached first.
+void QP_AudioWavAttach(QP_Audio* audio, wavfile_t* w);
+// Stop logging and return the file, so that it can be closed with
+// QP_AudioWavFinish without holding the audio lock.
+wavfile_t* QP_AudioWavDetach(QP_Audio* audio);
+int  QP_AudioWavFinish(wavfile_t* w);
 #endif // AUDIO_H_INCLUDED
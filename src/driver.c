@@ -2,51 +2,6 @@
 #include <string.h>
 
 #include "qp.h"
-#include "lib/vgm.h"
-
-#include "drv/quattro.h"
-#include "s2x/s2x.h"
-
-const struct QP_DriverTable DriverTable[DRIVER_COUNT] = {
-    {0,"none"},
-    {DRIVER_QUATTRO,"quattro"},
-    {DRIVER_SYSTEM2,"system2x"},
-};
-
-int DriverCreate(struct QP_DriverInterface *di,enum QP_DriverType dt)
-{
-    switch(dt)
-    {
-    case DRIVER_QUATTRO:
-        *di = Q_CreateInterface();
-
-        di->Driver = malloc(sizeof(Q_State));
-        if(!di->Driver)
-            return -1;
-        memset(di->Driver,0,sizeof(Q_State));
-        break;
-    case DRIVER_SYSTEM2:
-        *di = S2X_CreateInterface();
-
-        di->Driver = malloc(sizeof(S2X_State));
-        if(!di->Driver)
-            return -1;
-
-        memset(di->Driver,0,sizeof(S2X_State));
-        break;
-    default:
-        return -1;
-    }
-    return 0;
-}
-
-void DriverDestroy(struct QP_DriverInterface *di)
-{
-    if(!di)
-        return;
-    if(di->Driver)
-        free(di->Driver);
-}
 
 // Driver initialization
 int DriverInit()
@@ -61,11 +16,11 @@ void DriverDeinit()
 // VGM open/close
 void DriverInitVgm() // datablocks
 {
-    return DriverInterface->IVgmOpen(DriverInterface->Driver);
+    return DriverInterface->IVgmOpen(DriverInterface->Driver,&Game->Vgm);
 }
 void DriverCloseVgm() // header/clocks
 {
-    return DriverInterface->IVgmClose(DriverInterface->Driver);
+    return DriverInterface->IVgmClose(DriverInterface->Driver,Audio->state.MuteRear);
 }
 
 // Driver reset
@@ -145,12 +100,26 @@ void DriverResetLoopCount()
     return DriverInterface->IResetLoopCnt(DriverInterface->Driver);
 }
 
-// silence detection - return 1 if all voices are off
-// doesn't actually detect silence, just inactivity
+// silence detection - return 1 if the output is silent
 int DriverDetectSilence()
 {
     return DriverInterface->IDetectSilence(DriverInterface->Driver);
 }
+// returns the chip sample position where silence began, or -1 if audible
+int64_t DriverGetSilentSince()
+{
+    if(DriverInterface->ISilentSince)
+        return DriverInterface->ISilentSince(DriverInterface->Driver);
+    return DriverDetectSilence() ? 0 : -1;
+}
+// returns the length of the current silence in seconds
+double DriverGetSilenceTime()
+{
+    int64_t since = DriverGetSilentSince();
+    if(since < 0 || !DriverInterface->IChipPosition)
+        return 0;
+    return (DriverInterface->IChipPosition(DriverInterface->Driver)-since)/DriverGetChipRate();
+}
 
 double DriverGetTickRate()
 {
@@ -198,6 +167,13 @@ void DriverResetMute()
     DriverSetSolo(0);
 }
 
+// quality flags - set by the audio callback depending on load
+void DriverSetQuality(int flags)
+{
+    if(DriverInterface->ISetQuality)
+        return DriverInterface->ISetQuality(DriverInterface->Driver,flags);
+}
+
 void DriverDebugAction(int id)
 {
     if(DriverInterface->IDebugAction)
@@ -222,3 +198,82 @@ uint16_t DriverGetVoiceStatus(int voice)
         return DriverInterface->IGetVoiceStatus(DriverInterface->Driver,voice);
     return 0;
 }
+
+// Snapshots are triple buffered. The writer fills its own buffer, then
+// swaps it with the middle one. The reader takes the middle buffer only if
+// a new snapshot was published since the last swap.
+#define SNAPSHOT_NEW 4
+
+static struct QP_DriverSnapshot SnapshotBuffer[3];
+static int SnapshotWrite = 0;
+static int SnapshotMiddle = 1;
+static int SnapshotRead = 2;
+static uint32_t SnapshotCount = 0;
+
+void DriverPublishSnapshot()
+{
+    struct QP_DriverSnapshot *s = &SnapshotBuffer[SnapshotWrite];
+    int i;
+
+    s->Count = ++SnapshotCount;
+
+    s->SlotCount = DriverGetSlotCount();
+    if(s->SlotCount > SNAPSHOT_MAX_SLOTS)
+        s->SlotCount = SNAPSHOT_MAX_SLOTS;
+    for(i=0;i<s->SlotCount;i++)
+    {
+        s->SongStatus[i] = DriverGetSongStatus(i);
+        s->SongId[i] = DriverGetSongId(i);
+        s->SongTime[i] = DriverGetPlayingTime(i);
+        s->LoopCount[i] = DriverGetLoopCount(i);
+    }
+
+    s->VoiceCount = DriverGetVoiceCount();
+    if(s->VoiceCount > SNAPSHOT_MAX_VOICES)
+        s->VoiceCount = SNAPSHOT_MAX_VOICES;
+    for(i=0;i<s->VoiceCount;i++)
+    {
+        s->VoiceStatus[i] = DriverGetVoiceStatus(i);
+        s->VoiceInfoValid[i] = !DriverGetVoiceInfo(i,&s->VoiceInfo[i]);
+    }
+
+    SnapshotWrite = __atomic_exchange_n(&SnapshotMiddle,SnapshotWrite|SNAPSHOT_NEW,__ATOMIC_ACQ_REL) & 3;
+}
+
+void DriverUpdateSnapshot()
+{
+    if(__atomic_load_n(&SnapshotMiddle,__ATOMIC_RELAXED) & SNAPSHOT_NEW)
+        SnapshotRead = __atomic_exchange_n(&SnapshotMiddle,SnapshotRead,__ATOMIC_ACQ_REL) & 3;
+}
+
+const struct QP_DriverSnapshot* DriverGetSnapshot()
+{
+    return &SnapshotBuffer[SnapshotRead];
+}
+
+// Sequence counter for reading the driver state directly. It is odd while
+// the audio thread updates the driver, and is incremented again when done.
+// Readers copy what they need and retry if the counter was odd or changed.
+static uint32_t UpdateSequence = 0;
+
+void DriverUpdateBegin()
+{
+    __atomic_fetch_add(&UpdateSequence,1,__ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+}
+
+void DriverUpdateEnd()
+{
+    __atomic_fetch_add(&UpdateSequence,1,__ATOMIC_RELEASE);
+}
+
+uint32_t DriverReadBegin()
+{
+    return __atomic_load_n(&UpdateSequence,__ATOMIC_ACQUIRE);
+}
+
+int DriverReadRetry(uint32_t seq)
+{
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    return (seq & 1) || seq != __atomic_load_n(&UpdateSequence,__ATOMIC_RELAXED);
+}
@@ -4,6 +4,7 @@
 #include <stdint.h>
 
 #include "loader.h"
+#include "lib/vgm.h"
 
 enum QP_DriverType {
     DRIVER_NOT_LOADED = 0,
@@ -40,6 +41,20 @@ enum {
     PAN_TYPE_INVERT = 0x10, // negative values = right
 };
 
+// Quality flags for ISetQuality
+enum {
+    QUALITY_NO_REAR = 1, // rear channels are muted and need not be calculated
+    QUALITY_NO_INTERPOLATION = 2, // disable sample interpolation
+};
+
+// Stem grouping for IStemCount and IRenderStems
+enum {
+    STEM_VOICE = 0, // each sound chip voice
+    STEM_TRACK, // by the track that last used the voice, plus one for unused voices
+    STEM_CHIP, // by sound chip
+    STEM_MODES
+};
+
 struct QP_DriverVoiceInfo {
     int Status;
 
@@ -59,6 +74,27 @@ struct QP_DriverVoiceInfo {
     int Pan;
 };
 
+#define SNAPSHOT_MAX_SLOTS 32
+#define SNAPSHOT_MAX_VOICES 32
+
+// Copy of the driver state for the UI. This is published by the audio
+// thread after each driver tick, so that the UI never reads the driver
+// while it is being updated.
+struct QP_DriverSnapshot {
+    uint32_t Count; // incremented on each publish
+
+    int SlotCount;
+    int SongStatus[SNAPSHOT_MAX_SLOTS];
+    int SongId[SNAPSHOT_MAX_SLOTS];
+    double SongTime[SNAPSHOT_MAX_SLOTS];
+    int LoopCount[SNAPSHOT_MAX_SLOTS];
+
+    int VoiceCount;
+    uint16_t VoiceStatus[SNAPSHOT_MAX_VOICES];
+    int VoiceInfoValid[SNAPSHOT_MAX_VOICES]; // set if IGetVoiceInfo succeeded
+    struct QP_DriverVoiceInfo VoiceInfo[SNAPSHOT_MAX_VOICES];
+};
+
 struct QP_DriverInterface {
     char* Name;
 
@@ -73,8 +109,9 @@ struct QP_DriverInterface {
     // freed by this call
     void (*IDeinit)(void*);
     // Setup vgm logging for this sound driver
-    void (*IVgmOpen)(void*);
-    void (*IVgmClose)(void*);
+    void (*IVgmOpen)(void*,vgmfile_t* vgm);
+    // Finish vgm logging. muterear is set if the rear channels were muted.
+    void (*IVgmClose)(void*,int muterear);
     // Reset the sound driver. Initial is set to 1 for the initial setup (right after IInit)
     void (*IReset)(void*,QP_Game *game,int initial);
 
@@ -112,8 +149,13 @@ struct QP_DriverInterface {
     // Reset the loop count for all slots
     void (*IResetLoopCnt)(void*);
 
-    // Return zero if all voices are silent
+    // Return nonzero if the output is silent
     int (*IDetectSilence)(void*);
+    // Return the chip sample position where the output became silent,
+    // or -1 if the output is currently audible.
+    int64_t (*ISilentSince)(void*);
+    // Return the current chip sample position.
+    int64_t (*IChipPosition)(void*);
 
     // Get driver tick rate, in Hz
     double (*ITickRate)(void*);
@@ -125,6 +167,8 @@ struct QP_DriverInterface {
     void (*IUpdateChip)(void*);
     // Get samples from the audio
     void (*ISampleChip)(void*,float* samples,int samplecnt);
+    // Audio tick and get samples, for several ticks. Optional.
+    void (*IRender)(void*,float* out,int frames,int channels);
 
     // Channel mute bitmask
     uint32_t (*IGetMute)(void*);
@@ -133,6 +177,16 @@ struct QP_DriverInterface {
     uint32_t (*IGetSolo)(void*);
     void (*ISetSolo)(void*,uint32_t data);
 
+    // Number of stems for a STEM_ mode, 0 if not supported. Optional.
+    int (*IStemCount)(void*,int mode);
+    // Same as IRender, and also writes the output of each stem to stems as
+    // a left/right pair (front and rear mixed). The stems add up to the
+    // front+rear mix of out. Optional.
+    void (*IRenderStems)(void*,float* out,int frames,int channels,float* stems,int mode);
+
+    // Trade sound quality for speed, see QUALITY_ flags above. Optional.
+    void (*ISetQuality)(void*,int flags);
+
     void (*IDebugAction)(void*,int id);
 
     int (*IGetVoiceCount)(void*);
@@ -171,6 +225,8 @@ double DriverGetPlayingTime(int slot);
 int DriverGetLoopCount(int slot);
 void DriverResetLoopCount();
 int DriverDetectSilence();
+int64_t DriverGetSilentSince();
+double DriverGetSilenceTime();
 double DriverGetTickRate();
 void DriverUpdateTick();
 double DriverGetChipRate();
@@ -181,8 +237,25 @@ void DriverSetMute(uint32_t data);
 uint32_t DriverGetSolo();
 void DriverSetSolo(uint32_t data);
 void DriverResetMute();
+void DriverSetQuality(int flags);
 void DriverDebugAction(int id);
 int DriverGetVoiceCount();
 int DriverGetVoiceInfo(int voice,struct QP_DriverVoiceInfo *dv);
 uint16_t DriverGetVoiceStatus(int voice);
+
+// Called from the audio thread (or with the audio device locked).
+void DriverPublishSnapshot();
+// Called from the UI thread. DriverUpdateSnapshot switches to the latest
+// published snapshot, which is then returned by DriverGetSnapshot until
+// the next update.
+void DriverUpdateSnapshot();
+const struct QP_DriverSnapshot* DriverGetSnapshot();
+
+// The audio thread wraps driver updates with DriverUpdateBegin/End.
+// Readers that need more than the snapshot read the driver state between
+// DriverReadBegin and DriverReadRetry, and start over if the latter is set.
+void DriverUpdateBegin();
+void DriverUpdateEnd();
+uint32_t DriverReadBegin();
+int DriverReadRetry(uint32_t seq);
 #endif // DRIVER_H_INCLUDED
@@ -0,0 +1,53 @@
+/*
+    Sound driver creation. This is kept separate from the Driver* functions
+    (which operate on the global DriverInterface) so that it can be used by
+    the player library.
+*/
+#include <stdlib.h>
+#include <string.h>
+
+#include "driver.h"
+
+#include "drv/quattro.h"
+#include "s2x/s2x.h"
+
+const struct QP_DriverTable DriverTable[DRIVER_COUNT] = {
+    {0,"none"},
+    {DRIVER_QUATTRO,"quattro"},
+    {DRIVER_SYSTEM2,"system2x"},
+};
+
+int DriverCreate(struct QP_DriverInterface *di,enum QP_DriverType dt)
+{
+    switch(dt)
+    {
+    case DRIVER_QUATTRO:
+        *di = Q_CreateInterface();
+
+        di->Driver = malloc(sizeof(Q_State));
+        if(!di->Driver)
+            return -1;
+        memset(di->Driver,0,sizeof(Q_State));
+        break;
+    case DRIVER_SYSTEM2:
+        *di = S2X_CreateInterface();
+
+        di->Driver = malloc(sizeof(S2X_State));
+        if(!di->Driver)
+            return -1;
+
+        memset(di->Driver,0,sizeof(S2X_State));
+        break;
+    default:
+        return -1;
+    }
+    return 0;
+}
+
+void DriverDestroy(struct QP_DriverInterface *di)
+{
+    if(!di)
+        return;
+    if(di->Driver)
+        free(di->Driver);
+}
@@ -1,6 +1,7 @@
+#include <stdio.h>
 #include <string.h>
 
-#include "../qp.h"
+#include "../driver.h"
 #include "../lib/vgm.h"
 
 #include "quattro.h"
@@ -15,29 +16,34 @@ int Q_IInit(void* d,QP_Game *g)
     Q->ChipClock = g->ChipFreq;
     C352_init(&Q->Chip,g->ChipFreq);
     Q->Chip.mulaw_type = C352_MULAW_TYPE_C352;
-    Q->Chip.vgm_log = 0;
+    Q->Chip.vgm = NULL;
 
     Q->Chip.wave = g->WaveData;
     Q->Chip.wave_mask = g->WaveMask;
     Q->McuData = g->Data;
+
+    QP_SilenceDetectInit(&Q->Silence,Q->Chip.rate);
     return 0;
 }
 void Q_IDeinit(void* d)
 {
     Q_Deinit(d);
 }
-void Q_IVgmOpen(void* d)
+void Q_IVgmOpen(void* d,vgmfile_t* vgm)
 {
     Q_State *Q = d;
-    vgm_datablock(0x92,0x1000000,Q->Chip.wave,0x1000000,Q->Chip.wave_mask,0);
-    Q->Chip.vgm_log = 1;
+    vgm_datablock(vgm,0x92,0x1000000,Q->Chip.wave,0x1000000,Q->Chip.wave_mask,0);
+    Q->Chip.vgm = vgm;
 }
-void Q_IVgmClose(void* d)
+void Q_IVgmClose(void* d,int muterear)
 {
     Q_State *Q = d;
-    Q->Chip.vgm_log = 0;
-    vgm_poke32(0xdc,Q->ChipClock | Audio->state.MuteRear<<31);
-    vgm_poke8(0xd6,288/4);
+    vgmfile_t* vgm = Q->Chip.vgm;
+    if(!vgm)
+        return;
+    Q->Chip.vgm = NULL;
+    vgm_poke32(vgm,0xdc,Q->ChipClock | muterear<<31);
+    vgm_poke8(vgm,0xd6,288/4);
 }
 void Q_IReset(void* d,QP_Game* g,int initial)
 {
@@ -45,11 +51,19 @@ void Q_IReset(void* d,QP_Game* g,int initial)
     Q->PortaFix=g->PortaFix;
     Q->BootSong=g->BootSong;
 
-    if(initial)
-        Q_Init(Q);
+    if(initial && g->DriverInfoSize == sizeof(Q_McuInfo))
+        Q_Init(Q,(Q_McuInfo*)g->DriverInfo);
+    else if(initial)
+    {
+        Q_Init(Q,NULL);
+        Q_GetMcuInfo(Q,(Q_McuInfo*)g->DriverInfo);
+        g->DriverInfoSize = sizeof(Q_McuInfo);
+    }
     else
         Q_Reset(Q);
 
+    QP_SilenceDetectReset(&Q->Silence);
+
     if(initial && g->AutoPlay >= 0)
         Q->BootSong=2;
 }
@@ -141,11 +155,17 @@ void Q_IResetLoopCnt(void* d)
 int Q_IDetectSilence(void* d)
 {
     Q_State *Q = d;
-    int i, voicectr=0;
-    for(i=0;i<Q_MAX_VOICES;i++)
-        if(!Q->Voice[i].Enabled)
-            voicectr++;
-    return (voicectr == Q_MAX_VOICES);
+    return (Q->Silence.SilentSince >= 0);
+}
+int64_t Q_ISilentSince(void* d)
+{
+    Q_State *Q = d;
+    return Q->Silence.SilentSince;
+}
+int64_t Q_IChipPosition(void* d)
+{
+    Q_State *Q = d;
+    return Q->Silence.Position;
 }
 
 double Q_ITickRate(void* d)
@@ -165,6 +185,8 @@ void Q_IUpdateChip(void* d)
 {
     Q_State *Q = d;
     C352_update(&Q->Chip);
+    if(QP_SilenceDetectUpdate(&Q->Silence,Q->Chip.out,4,1.0/(1<<28)))
+        QP_SilenceDetectEnd(&Q->Silence,C352_ramp_pending(&Q->Chip));
 }
 void Q_ISampleChip(void* d,float* samples,int samplecnt)
 {
@@ -175,6 +197,81 @@ void Q_ISampleChip(void* d,float* samples,int samplecnt)
     for(i=0;i<samplecnt;i++)
         samples[i] = Q->Chip.out[i] / (1<<28);
 }
+void Q_IRender(void* d,float* out,int frames,int channels)
+{
+    Q_State *Q = d;
+    int i;
+    if(channels > 4)
+        channels=4;
+    while(frames--)
+    {
+        C352_update(&Q->Chip);
+        if(QP_SilenceDetectUpdate(&Q->Silence,Q->Chip.out,4,1.0/(1<<28)))
+            QP_SilenceDetectEnd(&Q->Silence,C352_ramp_pending(&Q->Chip));
+        for(i=0;i<channels;i++)
+            out[i] = Q->Chip.out[i] / (1<<28);
+        out += channels;
+    }
+}
+
+int Q_IStemCount(void* d,int mode)
+{
+    Q_State *Q = d;
+    switch(mode)
+    {
+    case STEM_VOICE:
+        return C352_VOICES;
+    case STEM_TRACK:
+        return Q->TrackCount+1;
+    case STEM_CHIP:
+        return 1;
+    default:
+        return 0;
+    }
+}
+void Q_IRenderStems(void* d,float* out,int frames,int channels,float* stems,int mode)
+{
+    Q_State *Q = d;
+    float voice[2*C352_VOICES];
+    int stem[C352_VOICES];
+    int count = Q_IStemCount(d,mode);
+    int i;
+
+    // the driver doesn't run during the block, so the stems can be found now
+    for(i=0;i<C352_VOICES;i++)
+    {
+        if(Q->Voice[i].TrackNo)
+            Q->StemTrack[i] = Q->Voice[i].TrackNo;
+        if(mode == STEM_VOICE)
+            stem[i] = i;
+        else if(mode == STEM_TRACK)
+            stem[i] = Q->StemTrack[i] && Q->StemTrack[i] < count ? Q->StemTrack[i]-1 : count-1;
+        else
+            stem[i] = 0;
+    }
+
+    Q->Chip.voice_out = voice;
+    if(channels > 4)
+        channels=4;
+    while(frames--)
+    {
+        C352_update(&Q->Chip);
+        if(QP_SilenceDetectUpdate(&Q->Silence,Q->Chip.out,4,1.0/(1<<28)))
+            QP_SilenceDetectEnd(&Q->Silence,C352_ramp_pending(&Q->Chip));
+        for(i=0;i<channels;i++)
+            out[i] = Q->Chip.out[i] / (1<<28);
+        out += channels;
+
+        memset(stems,0,2*count*sizeof(float));
+        for(i=0;i<C352_VOICES;i++)
+        {
+            stems[2*stem[i]] += voice[2*i] / (1<<28);
+            stems[2*stem[i]+1] += voice[2*i+1] / (1<<28);
+        }
+        stems += 2*count;
+    }
+    Q->Chip.voice_out = NULL;
+}
 
 uint32_t Q_IGetMute(void* d)
 {
@@ -198,6 +295,12 @@ void Q_ISetSolo(void* d,uint32_t data)
     Q->SoloMask = data;
     Q_UpdateMuteMask(Q);
 }
+void Q_ISetQuality(void* d,int flags)
+{
+    Q_State *Q = d;
+    Q->Chip.mute_rear = (flags & QUALITY_NO_REAR) != 0;
+    Q->Chip.no_interpolation = (flags & QUALITY_NO_INTERPOLATION) != 0;
+}
 int Q_IGetVoiceCount(void* d)
 {
     return Q_MAX_VOICES;
@@ -300,18 +403,25 @@ struct QP_DriverInterface Q_CreateInterface()
         .IResetLoopCnt = &Q_IResetLoopCnt,
 
         .IDetectSilence = &Q_IDetectSilence,
+        .ISilentSince = &Q_ISilentSince,
+        .IChipPosition = &Q_IChipPosition,
 
         .ITickRate = &Q_ITickRate,
         .IUpdateTick = &Q_IUpdateTick,
         .IChipRate = &Q_IChipRate,
         .IUpdateChip = &Q_IUpdateChip,
         .ISampleChip = &Q_ISampleChip,
+        .IRender = &Q_IRender,
+        .IStemCount = &Q_IStemCount,
+        .IRenderStems = &Q_IRenderStems,
 
         .IGetMute = &Q_IGetMute,
         .ISetMute = &Q_ISetMute,
         .IGetSolo = &Q_IGetSolo,
         .ISetSolo = &Q_ISetSolo,
 
+        .ISetQuality = &Q_ISetQuality,
+
         .IGetVoiceCount = &Q_IGetVoiceCount,
         .IGetVoiceInfo = &Q_IGetVoiceInfo,
         .IGetVoiceStatus = &Q_IGetVoiceStatus
@@ -123,6 +123,30 @@ Q_McuType Q_GetMcuType(Q_State* Q)
     return Q_MCUTYPE_UNIDENTIFIED;
 }
 
+static void Q_SetChipClock(Q_State* Q)
+{
+    if(!Q->ChipClock)
+    {
+        // Chip clock
+        switch(Q->McuType)
+        {
+        default:
+            Q->ChipClock = 24576000;
+            break;
+        case Q_MCUTYPE_C75:
+            Q->ChipClock = 24192000;
+            break;
+        case Q_MCUTYPE_C76:
+        case Q_MCUTYPE_S12:
+            Q->ChipClock = 25401600;
+            break;
+        }
+    }
+
+    if(!Q->Chip.rate)
+        Q->Chip.rate = Q->ChipClock/288;
+}
+
 void Q_GetMcuVer(Q_State* Q)
 {
     int i;
@@ -178,26 +202,7 @@ void Q_GetMcuVer(Q_State* Q)
     }
 skip:
 
-    if(!Q->ChipClock)
-    {
-        // Chip clock
-        switch(Q->McuType)
-        {
-        default:
-            Q->ChipClock = 24576000;
-            break;
-        case Q_MCUTYPE_C75:
-            Q->ChipClock = 24192000;
-            break;
-        case Q_MCUTYPE_C76:
-        case Q_MCUTYPE_S12:
-            Q->ChipClock = 25401600;
-            break;
-        }
-    }
-
-    if(!Q->Chip.rate)
-        Q->Chip.rate = Q->ChipClock/288;
+    Q_SetChipClock(Q);
 
     for(i=0;i<Q_TOFFSET_MAX;i++)
         Q->TableOffset[i] = Q_ReadWord(Q,Q->McuHeaderPos+(i*2))+Q->McuDataPosBase;
@@ -212,6 +217,36 @@ skip:
 
 }
 
+void Q_GetMcuInfo(Q_State* Q,Q_McuInfo* I)
+{
+    I->McuType = Q->McuType;
+    I->McuVer = Q->McuVer;
+    I->McuPosBase = Q->McuPosBase;
+    I->McuHeaderPos = Q->McuHeaderPos;
+    I->McuDataPosBase = Q->McuDataPosBase;
+    I->McuDrvStartPos = Q->McuDrvStartPos;
+    I->McuDrvEndPos = Q->McuDrvEndPos;
+    I->SongCount = Q->SongCount;
+    memcpy(I->TableOffset,Q->TableOffset,sizeof(I->TableOffset));
+    memcpy(I->PitchTable,Q->PitchTable,sizeof(I->PitchTable));
+}
+
+// Same result as Q_GetMcuVer, without searching the ROM.
+void Q_SetMcuInfo(Q_State* Q,Q_McuInfo* I)
+{
+    Q->McuType = I->McuType;
+    Q->McuVer = I->McuVer;
+    Q->McuPosBase = I->McuPosBase;
+    Q->McuHeaderPos = I->McuHeaderPos;
+    Q->McuDataPosBase = I->McuDataPosBase;
+    Q->McuDrvStartPos = I->McuDrvStartPos;
+    Q->McuDrvEndPos = I->McuDrvEndPos;
+    Q->SongCount = I->SongCount;
+    memcpy(Q->TableOffset,I->TableOffset,sizeof(Q->TableOffset));
+    memcpy(Q->PitchTable,I->PitchTable,sizeof(Q->PitchTable));
+
+    Q_SetChipClock(Q);
+}
 
 void Q_GetOffsets(Q_State *Q)
 {
@@ -13,6 +13,8 @@ uint16_t Q_ReadWordBE(Q_State *Q,uint32_t d);
 
 Q_McuType Q_GetMcuType(Q_State* Q);
 void Q_GetMcuVer(Q_State* Q);
+void Q_GetMcuInfo(Q_State* Q,Q_McuInfo* I);
+void Q_SetMcuInfo(Q_State* Q,Q_McuInfo* I);
 
 void Q_GetOffsets(Q_State* Q);
 void Q_MakePitchTable(Q_State *Q);
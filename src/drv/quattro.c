@@ -12,10 +12,14 @@
 #include "tables.h"
 #include "update.h"
 
-void Q_Init(Q_State *Q)
+// info can be NULL, otherwise ROM info is restored from the game cache
+void Q_Init(Q_State *Q,Q_McuInfo *info)
 {
     Q_LoopDetectionInit(Q);
-    Q_GetMcuVer(Q);
+    if(info)
+        Q_SetMcuInfo(Q,info);
+    else
+        Q_GetMcuVer(Q);
     Q_Reset(Q);
 }
 
@@ -54,6 +58,10 @@ void Q_Reset(Q_State *Q)
     memset(Q->Track,0,sizeof(Q->Track));
     memset(Q->ActiveChannel,0,sizeof(Q->ActiveChannel));
     memset(Q->ChannelPriority,0,sizeof(Q->ChannelPriority));
+    memset(Q->VoiceTrackMask,0,sizeof(Q->VoiceTrackMask));
+    memset(Q->TrackVoiceMask,0,sizeof(Q->TrackVoiceMask));
+    memset(Q->VoiceTopTrack,-1,sizeof(Q->VoiceTopTrack));
+    memset(Q->StemTrack,0,sizeof(Q->StemTrack));
 
     Q->BasePitch=0;
 
@@ -11,6 +11,7 @@
 #define Q_MAX_REGISTER 256
 
 #include "../emu/c352.h"
+#include "../lib/silence.h"
 
 #include "enum.h"
 #include "struct.h"
@@ -23,7 +24,7 @@ const char* Q_McuNames[Q_MCUTYPE_MAX];
 const char* Q_NoteNames[12];
 
 // Initialize driver
-void Q_Init(Q_State* Q);
+void Q_Init(Q_State* Q,Q_McuInfo* info);
 void Q_Deinit(Q_State* Q);
 
 // Reset driver
@@ -212,6 +212,20 @@ struct Q_Voice {
     uint8_t ChannelNo;
 };
 
+// ROM info found by Q_GetMcuVer, saved in the game cache.
+typedef struct {
+    Q_McuType McuType;
+    Q_McuDriverVersion McuVer;
+    uint32_t McuPosBase;
+    uint32_t McuHeaderPos;
+    uint32_t McuDataPosBase;
+    uint32_t McuDrvStartPos;
+    uint32_t McuDrvEndPos;
+    uint16_t SongCount;
+    uint32_t TableOffset[Q_TOFFSET_MAX];
+    uint16_t PitchTable[256];
+} Q_McuInfo;
+
 struct Q_State {
 
 // ========================================================================= //
@@ -231,6 +245,7 @@ struct Q_State {
 
     uint32_t ChipClock;
     C352 Chip;
+    QP_SilenceDetect Silence;
 
 // ========================================================================= //
 // Game hacks - hopefully we'll see as little of these as possible.
@@ -272,6 +287,15 @@ struct Q_State {
     Q_Channel* ActiveChannel[Q_MAX_VOICES];
     // List of allocated voices for each track and the associated priority.
     Q_ChannelPriority ChannelPriority[Q_MAX_VOICES][Q_MAX_TRACKS];
+    // Tracks with a nonzero priority on each voice, and the voices used by
+    // each track. Kept up to date by Q_VoiceSetPriority.
+    uint32_t VoiceTrackMask[Q_MAX_VOICES];
+    uint32_t TrackVoiceMask[Q_MAX_TRACKS];
+    // Highest priority track on each voice, -1 if it needs to be searched.
+    int8_t VoiceTopTrack[Q_MAX_VOICES];
+    // Last track (+1) that used each voice, for stems. Kept after the voice
+    // is released so that release tails stay on the same stem.
+    uint8_t StemTrack[Q_MAX_VOICES];
 
     uint16_t BasePitch;
     uint8_t BaseFadeout;
@@ -8,6 +8,7 @@
 #include "track.h"
 #include "voice.h"
 #include "helper.h"
+#include "../lib/profile.h"
 
 // Call 0x06 - initializes a track
 // source: 0x4baa
@@ -135,7 +136,8 @@ void Q_TrackUpdate(Q_State* Q,int TrackNo)
             }
             else
             {
-                Q_TrackCommandTable[Command&0x3f](Q,TrackNo,T,&T->Position,Command);
+                PROFILE(PROFILE_Q_TRACK_CMD,Command&0x3f,
+                        Q_TrackCommandTable[Command&0x3f](Q,TrackNo,T,&T->Position,Command));
             }
         }
     }
@@ -231,10 +233,12 @@ void Q_TrackDisable(Q_State *Q,int TrackNo)
     Q_Channel* c;
     int i;
     uint16_t cflags;
-    for(i=0;i<Q_MAX_VOICES;i++)
+    uint32_t mask = Q->TrackVoiceMask[TrackNo];
+    while(mask)
     {
-        Q->ChannelPriority[i][TrackNo].channel = 0;
-        Q->ChannelPriority[i][TrackNo].priority = 0;
+        i = __builtin_ctz(mask);
+        mask &= mask-1;
+        Q_VoiceSetPriority(Q,i,TrackNo,0,0);
     }
     for(i=0;i<Q_MAX_TRKCHN;i++)
     {
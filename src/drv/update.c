@@ -5,12 +5,15 @@
 #include "update.h"
 #include "track.h"
 #include "voice.h"
+#include "../lib/trace.h"
+#include "../lib/profile.h"
 
 // call 0x04 - update tracks and execute song requests
 // source: 0x4a56
 void Q_UpdateTracks(Q_State *Q)
 {
     int TrackNo;
+    int active = 0;
     for(TrackNo=0;TrackNo<Q->TrackCount;TrackNo++)
     {
         if(Q->SongRequest[TrackNo] & Q_TRACK_STATUS_START)
@@ -20,10 +23,12 @@ void Q_UpdateTracks(Q_State *Q)
         else if(Q->Track[TrackNo].Flags & Q_TRACK_STATUS_BUSY)
         {
             Q->Track[TrackNo].Flags = Q->SongRequest[Q->ParentSong[TrackNo]];
-            Q_TrackUpdate(Q,TrackNo);
+            PROFILE(PROFILE_Q_TRACK,TrackNo,Q_TrackUpdate(Q,TrackNo));
             Q_TrackCalcVolume(Q,TrackNo);
+            active++;
         }
     }
+    TRACE_COUNTER("active tracks",active);
 }
 
 // call 0x26 - update all voices
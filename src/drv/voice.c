@@ -5,6 +5,7 @@
 #include "voice.h"
 #include "helper.h"
 #include "tables.h"
+#include "../lib/profile.h"
 
 // Call 0x08 - Allocate a voice to a channel and disables previous channel on voice.
 // source: 0x4dd6 (call 0x14 at 0x4e78 has a similar function)
@@ -31,23 +32,47 @@ void Q_VoiceClearChannel(Q_State *Q,int VoiceNo)
     Q->Voice[VoiceNo].TrackNo = 0;
 }
 
-// Call 0x0e - find highest priority for the voice
-// source: 0x4e44
-uint16_t Q_VoiceGetPriority(Q_State *Q,int VoiceNo,int* TrackNo,int* ChannelNo)
+// Find the highest priority track out of a mask. On a tie, the lowest
+// track number wins. Returns -1 if the mask is empty.
+static int Q_VoiceFindPriority(Q_State *Q,int VoiceNo,uint32_t mask)
 {
     int i;
-    int track = 0;
-    int channel=0;
+    int track=-1;
     int priority=0;
-    for(i=0;i<Q->TrackCount;i++)
+    while(mask)
     {
+        i = __builtin_ctz(mask);
+        mask &= mask-1;
         if(Q->ChannelPriority[VoiceNo][i].priority > priority)
         {
             track=i;
-            channel=Q->ChannelPriority[VoiceNo][i].channel;
             priority=Q->ChannelPriority[VoiceNo][i].priority;
         }
     }
+    return track;
+}
+
+// Call 0x0e - find highest priority for the voice
+// source: 0x4e44
+uint16_t Q_VoiceGetPriority(Q_State *Q,int VoiceNo,int* TrackNo,int* ChannelNo)
+{
+    int track = Q->VoiceTopTrack[VoiceNo];
+    if(track < 0)
+        track = Q->VoiceTopTrack[VoiceNo] = Q_VoiceFindPriority(Q,VoiceNo,Q->VoiceTrackMask[VoiceNo]);
+
+    // the track count may have been lowered since the priority was set
+    if(track >= Q->TrackCount)
+        track = Q_VoiceFindPriority(Q,VoiceNo,Q->VoiceTrackMask[VoiceNo] & ((1ULL<<Q->TrackCount)-1));
+
+    int channel=0;
+    int priority=0;
+    if(track < 0)
+        track=0;
+    else
+    {
+        channel=Q->ChannelPriority[VoiceNo][track].channel;
+        priority=Q->ChannelPriority[VoiceNo][track].priority;
+    }
 
     if(TrackNo != NULL)
         *TrackNo = track;
@@ -61,8 +86,38 @@ uint16_t Q_VoiceGetPriority(Q_State *Q,int VoiceNo,int* TrackNo,int* ChannelNo)
 // source: 0x4d88
 void Q_VoiceSetPriority(Q_State *Q,int VoiceNo,int TrackNo,int ChannelNo,int Priority)
 {
-    Q->ChannelPriority[VoiceNo][TrackNo].channel = ChannelNo;
-    Q->ChannelPriority[VoiceNo][TrackNo].priority = Priority;
+    Q_ChannelPriority *P = &Q->ChannelPriority[VoiceNo][TrackNo];
+    int top = Q->VoiceTopTrack[VoiceNo];
+    uint16_t old = P->priority;
+
+    P->channel = ChannelNo;
+    P->priority = Priority;
+
+    if(P->priority)
+    {
+        Q->VoiceTrackMask[VoiceNo] |= 1U<<TrackNo;
+        Q->TrackVoiceMask[TrackNo] |= 1U<<VoiceNo;
+    }
+    else
+    {
+        Q->VoiceTrackMask[VoiceNo] &= ~(1U<<TrackNo);
+        Q->TrackVoiceMask[TrackNo] &= ~(1U<<VoiceNo);
+    }
+
+    // update the highest priority track if it can be done without a search
+    if(top < 0)
+        return;
+    else if(top == TrackNo)
+    {
+        if(P->priority < old)
+            Q->VoiceTopTrack[VoiceNo] = -1;
+    }
+    else
+    {
+        uint16_t top_priority = Q->ChannelPriority[VoiceNo][top].priority;
+        if(P->priority > top_priority || (P->priority && P->priority == top_priority && TrackNo < top))
+            Q->VoiceTopTrack[VoiceNo] = TrackNo;
+    }
 }
 
 // Call 0x24 - process an event
@@ -191,7 +246,7 @@ void Q_VoiceUpdate(Q_State *Q,int VoiceNo,Q_Voice* V)
     if(flags & C352_FLG_BUSY)
     {
         if(flags & C352_FLG_LINK)
-            Q_WaveLinkUpdate(Q,VoiceNo,V);
+            PROFILE(PROFILE_Q_VOICE,PROFILE_Q_LINK,Q_WaveLinkUpdate(Q,VoiceNo,V));
     }
     else if(~flags & C352_FLG_KEYON)
     {
@@ -206,15 +261,15 @@ void Q_VoiceUpdate(Q_State *Q,int VoiceNo,Q_Voice* V)
         V->Detune = Q->Register[V->PitchReg]&0xff;
     }
 
-    Q_VoiceEnvUpdate(Q,VoiceNo,V);
-    Q_VoicePitchEnvUpdate(Q,VoiceNo,V);
+    PROFILE(PROFILE_Q_VOICE,PROFILE_Q_ENV,Q_VoiceEnvUpdate(Q,VoiceNo,V));
+    PROFILE(PROFILE_Q_VOICE,PROFILE_Q_PITCH_ENV,Q_VoicePitchEnvUpdate(Q,VoiceNo,V));
     V->PitchTarget = (V->BaseNote<<8) | V->Detune;
 
     if(V->Portamento)
-        Q_VoicePortaUpdate(Q,VoiceNo,V);
+        PROFILE(PROFILE_Q_VOICE,PROFILE_Q_PORTA,Q_VoicePortaUpdate(Q,VoiceNo,V));
     else
         V->Pitch = V->PitchTarget;
-    Q_VoiceLfoUpdate(Q,VoiceNo,V);
+    PROFILE(PROFILE_Q_VOICE,PROFILE_Q_LFO,Q_VoiceLfoUpdate(Q,VoiceNo,V));
 
     // calculate pitch
     pitch = V->Pitch+V->PitchEnvMod+V->LfoMod+Q->BasePitch+V->WaveTranspose;
@@ -233,7 +288,7 @@ void Q_VoiceUpdate(Q_State *Q,int VoiceNo,Q_Voice* V)
         vol = 0xff;
     V->VolumeMod = vol;
 
-    return Q_VoicePanUpdate(Q,VoiceNo,V);
+    PROFILE(PROFILE_Q_VOICE,PROFILE_Q_PAN,Q_VoicePanUpdate(Q,VoiceNo,V));
 }
 
 // source: 0x7714
@@ -0,0 +1,81 @@
+/*
+    C30 WSG emulator for QuattroPlay
+
+    The output has the same scale as the C352 emulator, so that both can
+    be mixed together. The noise generator is the C352 one.
+*/
+#include <stdint.h>
+#include <string.h>
+
+#include "c30.h"
+
+void C30_init(C30 *c,uint32_t rate)
+{
+    c->rate = rate;
+    c->mute_mask = 0;
+    c->voice_out = NULL;
+
+    memset(c->v,0,sizeof(c->v));
+    c->out[0] = c->out[1] = 0;
+
+    c->wave = NULL;
+    c->wave_count = 0;
+
+    c->random = 0x1234;
+}
+
+void C30_update(C30 *c)
+{
+    int i;
+    int32_t s;
+    uint16_t steps;
+    uint32_t next;
+    C30_Voice *v;
+
+    c->out[0] = c->out[1] = 0;
+    if(c->voice_out)
+        memset(c->voice_out,0,2*C30_VOICES*sizeof(float));
+
+    for(i=0;i<C30_VOICES;i++)
+    {
+        v = &c->v[i];
+        next = v->phase + v->freq;
+
+        if(!(v->vol[0] | v->vol[1]) || c->mute_mask & 1<<i)
+        {
+            v->phase = next;
+            continue;
+        }
+
+        if(v->noise)
+        {
+            // step the noise generator once per wave step. at high
+            // frequencies there can be several steps per sample.
+            steps = (next>>16) - (v->phase>>16);
+            while(steps--)
+            {
+                c->random = (c->random>>1) ^ ((-(c->random&1)) & 0xfff6);
+                v->sample = c->random;
+            }
+            s = v->sample;
+        }
+        else if(v->wave < c->wave_count)
+        {
+            s = c->wave[(v->wave<<5) | ((next>>16)&31)] << 8;
+        }
+        else
+        {
+            s = 0;
+        }
+
+        v->phase = next;
+
+        c->out[0] += s * v->vol[0];
+        c->out[1] += s * v->vol[1];
+        if(c->voice_out)
+        {
+            c->voice_out[2*i] = s * v->vol[0];
+            c->voice_out[2*i+1] = s * v->vol[1];
+        }
+    }
+}
@@ -0,0 +1,51 @@
+/*
+    C30 WSG emulator for QuattroPlay
+
+    8 voice, 32 step wavetable sound generator with noise, as used on
+    Namco System 1. Voices are set directly by the sound driver and the
+    chip can run at any output rate.
+*/
+#ifndef C30_H_INCLUDED
+#define C30_H_INCLUDED
+
+#include <stdint.h>
+
+#define C30_VOICES 8
+
+typedef struct {
+
+    uint32_t freq;  // wave steps per output sample (16.16)
+    uint32_t phase;
+
+    uint8_t wave;   // waveform number
+    uint8_t noise;  // play noise instead of waveform
+    uint8_t vol[2]; // left, right
+
+    int16_t sample; // current noise sample
+
+} C30_Voice;
+
+typedef struct {
+
+    uint32_t rate;
+
+    C30_Voice v[C30_VOICES];
+    double out[2];
+
+    int8_t* wave;   // 32 signed samples per waveform
+    uint8_t wave_count;
+
+    uint16_t random;
+
+    // special
+    uint32_t mute_mask;
+    float* voice_out; // if set, left/right output of each voice
+
+} C30;
+
+void C30_init(C30 *c,uint32_t rate);
+
+// run this at the rate specified in C30_init (hz)
+void C30_update(C30 *c);
+
+#endif // C30_H_INCLUDED
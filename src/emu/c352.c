@@ -17,6 +17,9 @@
 int C352_init(C352 *c, uint32_t clk)
 {
     c->mute_mask=0;
+    c->mute_rear=0;
+    c->no_interpolation=0;
+    c->voice_out=NULL;
     c->rate = clk/288;
 
     memset(c->v,0,sizeof(C352_Voice)*C352_VOICES);
@@ -88,8 +91,8 @@ uint16_t C352RegMap[8] = {
 
 void C352_write(C352 *c, uint16_t addr, uint16_t data)
 {
-    if(c->vgm_log)
-        vgm_write(0xe1,0,addr,data);
+    if(c->vgm)
+        vgm_write(c->vgm,0xe1,0,addr,data);
 
     int i;
 
@@ -135,6 +138,22 @@ uint16_t C352_read(C352 *c, uint16_t addr)
 }
 
 
+int C352_ramp_pending(C352 *c)
+{
+    int i;
+    C352_Voice *v;
+    for(i=0;i<C352_VOICES;i++)
+    {
+        v = &c->v[i];
+        if(~v->flags & C352_FLG_BUSY || c->mute_mask & 1<<i)
+            continue;
+        if(v->curr_vol[0] < (v->vol_f>>8) || v->curr_vol[1] < (v->vol_f&0xff) ||
+           v->curr_vol[2] < (v->vol_r>>8) || v->curr_vol[3] < (v->vol_r&0xff))
+            return 1;
+    }
+    return 0;
+}
+
 static inline void C352_fetch_sample(C352 *c, int i)
 {
     C352_Voice *v = &c->v[i];
@@ -232,7 +251,7 @@ static inline int16_t C352_update_voice(C352 *c, int i)
 
 	int32_t temp = v->sample;
 	// Interpolate samples
-    if((v->latch_flags & C352_FLG_FILTER) == 0)
+    if((v->latch_flags & C352_FLG_FILTER) == 0 && !c->no_interpolation)
          temp = v->last_sample + (v->counter*(v->sample-v->last_sample)>>16);
 
     return temp;
@@ -245,26 +264,49 @@ void C352_update(C352 *c)
     uint16_t flags;
 
     c->out[0]=c->out[1]=c->out[2]=c->out[3]=0;
+    if(c->voice_out)
+        memset(c->voice_out,0,2*C352_VOICES*sizeof(float));
 
     for(i=0;i<C352_VOICES;i++)
     {
+        // idle voices don't add to the output. the counter and volume are
+        // reset on the next key on, so they can be left alone.
+        if(~c->v[i].flags & C352_FLG_BUSY && !c->v[i].sample && !c->v[i].last_sample)
+            continue;
+
         s = C352_update_voice(c,i);
 
         if(!(c->mute_mask & 1<<i))
         {
+            int32_t l,r;
             flags = c->v[i].latch_flags;
 
-            // Left
-            c->out[0] += (flags & C352_FLG_PHASEFL) ? -s * (c->v[i].curr_vol[0])
-                                                    :  s * (c->v[i].curr_vol[0]);
-            c->out[2] += (flags & C352_FLG_PHASERL) ? -s * (c->v[i].curr_vol[2])
-                                                    :  s * (c->v[i].curr_vol[2]);
-
-            // Right
-            c->out[1] += (flags & C352_FLG_PHASEFR) ? -s * (c->v[i].curr_vol[1])
-                                                    :  s * (c->v[i].curr_vol[1]);
-            c->out[3] += (flags & C352_FLG_PHASEFR) ? -s * (c->v[i].curr_vol[3])
-                                                    :  s * (c->v[i].curr_vol[3]);
+            // Front
+            l = (flags & C352_FLG_PHASEFL) ? -s * (c->v[i].curr_vol[0])
+                                           :  s * (c->v[i].curr_vol[0]);
+            r = (flags & C352_FLG_PHASEFR) ? -s * (c->v[i].curr_vol[1])
+                                           :  s * (c->v[i].curr_vol[1]);
+            c->out[0] += l;
+            c->out[1] += r;
+
+            if(!c->mute_rear)
+            {
+                // Rear
+                int32_t rl = (flags & C352_FLG_PHASERL) ? -s * (c->v[i].curr_vol[2])
+                                                        :  s * (c->v[i].curr_vol[2]);
+                int32_t rr = (flags & C352_FLG_PHASEFR) ? -s * (c->v[i].curr_vol[3])
+                                                        :  s * (c->v[i].curr_vol[3]);
+                c->out[2] += rl;
+                c->out[3] += rr;
+                l += rl;
+                r += rr;
+            }
+
+            if(c->voice_out)
+            {
+                c->voice_out[2*i] = l;
+                c->voice_out[2*i+1] = r;
+            }
         }
     }
 }
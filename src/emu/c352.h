@@ -9,6 +9,8 @@
 
 #include <stdint.h>
 
+#include "../lib/vgm.h"
+
 #define C352_VOICES 32
 
 enum {
@@ -91,8 +93,10 @@ typedef struct {
 
     // special
     uint32_t mute_mask;
-    uint8_t mute_rear;
-    int vgm_log;
+    uint8_t mute_rear; // rear outputs are not calculated
+    uint8_t no_interpolation; // faster, at lower quality
+    float* voice_out; // if set, left/right output of each voice (front and rear mixed)
+    vgmfile_t* vgm; // vgm logging, set to NULL to disable
     int mulaw_type;
 
 } C352;
@@ -106,5 +110,8 @@ void C352_update(C352 *c);
 void C352_write(C352 *c, uint16_t addr, uint16_t data);
 uint16_t C352_read(C352 *c, uint16_t addr);
 
+// returns nonzero if any unmuted voice is still ramping up its volume
+int C352_ramp_pending(C352 *c);
+
 
 #endif // C352_H_INCLUDED
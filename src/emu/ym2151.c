@@ -324,7 +324,12 @@ static int tl_tab[YM2151_TL_TAB_LEN];
 static unsigned int sin_tab[YM2151_SIN_LEN];
 static uint32_t d1l_tab[16];
 
-void init_tables()
+/* the tables above are shared by all chip instances, they are only
+   calculated once */
+static volatile int tables_ready = 0;
+static volatile int tables_lock = 0;
+
+static void init_tables()
 {
     int i,j;
     int x;
@@ -437,6 +442,20 @@ void init_tables()
 	}
 }
 
+static void init_tables_once()
+{
+	if(__atomic_load_n(&tables_ready,__ATOMIC_ACQUIRE))
+		return;
+	while(__sync_lock_test_and_set(&tables_lock,1))
+		;
+	if(!tables_ready)
+	{
+		init_tables();
+		__atomic_store_n(&tables_ready,1,__ATOMIC_RELEASE);
+	}
+	__sync_lock_release(&tables_lock);
+}
+
 
 void YM2151Operator_key_on(YM2151Operator* op,uint32_t key_set, uint32_t eg_cnt)
 {
@@ -672,6 +691,8 @@ void YM2151_write_reg(YM2151* ym,int r, int v)
 	r &= 0xff;
 	v &= 0xff;
 
+	ym->eg_dirty = 1;
+
 #if 0
 	/* There is no info on what YM2151 really does when busy flag is set */
 	if ( status & 0x80 ) return;
@@ -987,6 +1008,15 @@ int YM2151_op_calc1(YM2151Operator * OP, unsigned int env, signed int pm)
 
 
 
+/* nonzero if all operators are in EG_OFF and the channel has nothing left
+   in the feedback or MEM registers. The output is then 0. */
+static inline int YM2151_chan_idle(YM2151 *ym,unsigned int chan)
+{
+	YM2151Operator *op = &ym->oper[chan*4];
+	return ((ym->eg_off >> (chan*4)) & 15) == 15
+		&& !op->fb_out_prev && !op->fb_out_curr && !op->mem_value;
+}
+
 #define volume_calc(OP) ((OP)->tl + ((uint32_t)(OP)->volume) + (AM & (OP)->AMmask))
 //#define volume_calc2(OP) ((OP)->tl + ((uint32_t)(OP)->volume) + (AM & (OP)->AMmask))
 #define volume_calc2(OP) (/*(OP)->tl + */((uint32_t)(OP)->volume)/* + (AM & (OP)->AMmask)*/)
@@ -1105,10 +1135,73 @@ void YM2151_chan7_calc(YM2151 *ym)
 }
 
 
+/* Put an operator in eg_mask, unless its next EG steps can't change
+   anything (EG_OFF, or a rate 0 phase that won't switch state) */
+static void YM2151_eg_schedule(YM2151* ym,unsigned int i)
+{
+	YM2151Operator *op = &ym->oper[i];
+	uint8_t sh, sel;
+	int idle;
+
+	if (ym->eg_op_sh[i] != 0xff)
+		ym->eg_mask[ym->eg_op_sh[i]] &= ~(1u<<i);
+	ym->eg_op_sh[i] = 0xff;
+	ym->eg_off &= ~(1u<<i);
+
+	switch(op->state)
+	{
+	case EG_ATT:
+		sh = op->eg_sh_ar;
+		sel = op->eg_sel_ar;
+		idle = !(op->volume <= MIN_ATT_INDEX);
+		break;
+	case EG_DEC:
+		sh = op->eg_sh_d1r;
+		sel = op->eg_sel_d1r;
+		idle = !(op->volume >= op->d1l);
+		break;
+	case EG_SUS:
+		sh = op->eg_sh_d2r;
+		sel = op->eg_sel_d2r;
+		idle = !(op->volume >= MAX_ATT_INDEX);
+		break;
+	case EG_REL:
+		sh = op->eg_sh_rr;
+		sel = op->eg_sel_rr;
+		idle = !(op->volume >= MAX_ATT_INDEX);
+		break;
+	default:
+		ym->eg_off |= 1u<<i;
+		return;
+	}
+
+	if (sel == 18*YM2151_RATE_STEPS && idle)
+		return;
+
+	ym->eg_op_sh[i] = sh;
+	ym->eg_mask[sh] |= 1u<<i;
+}
+
+static void YM2151_eg_schedule_all(YM2151* ym)
+{
+	unsigned int i;
+	memset(ym->eg_mask,0,sizeof(ym->eg_mask));
+	memset(ym->eg_op_sh,0xff,sizeof(ym->eg_op_sh));
+	ym->eg_off = 0;
+	for(i=0;i<32;i++)
+		YM2151_eg_schedule(ym,i);
+	ym->eg_dirty = 0;
+}
+
 void YM2151_advance_eg(YM2151* ym)
 {
 	YM2151Operator *op;
-	unsigned int i;
+	unsigned int i, sh, state;
+	uint32_t mask;
+
+	/* also used by the phase generator, so update after register writes */
+	if (ym->eg_dirty)
+		YM2151_eg_schedule_all(ym);
 
 	ym->eg_timer += ym->eg_timer_add;
 
@@ -1118,68 +1211,67 @@ void YM2151_advance_eg(YM2151* ym)
 
 		ym->eg_cnt++;
 
+		/* operators are stepped when the low eg_sh bits of eg_cnt are 0 */
+		sh = ym->eg_cnt ? __builtin_ctz(ym->eg_cnt) : 15;
+		if (sh > 15)
+			sh = 15;
+		mask = 0;
+		do
+			mask |= ym->eg_mask[sh];
+		while (sh--);
+
 		/* envelope generator */
-		for(i=0;i<32;i++)
-        {
-            op = &ym->oper[i]; /* CH 0 M1 */
+		while (mask)
+		{
+			i = __builtin_ctz(mask);
+			mask &= mask-1;
+			op = &ym->oper[i];
+			state = op->state;
 
 			switch(op->state)
 			{
 			case EG_ATT:    /* attack phase */
-				if ( !(ym->eg_cnt & ((1<<op->eg_sh_ar)-1) ) )
-				{
-					op->volume += (~op->volume *
-									(eg_inc[op->eg_sel_ar + ((ym->eg_cnt>>op->eg_sh_ar)&7)])
-									) >>4;
-
-					if (op->volume <= MIN_ATT_INDEX)
-					{
-						op->volume = MIN_ATT_INDEX;
-						op->state = EG_DEC;
-					}
+				op->volume += (~op->volume *
+								(eg_inc[op->eg_sel_ar + ((ym->eg_cnt>>op->eg_sh_ar)&7)])
+								) >>4;
 
+				if (op->volume <= MIN_ATT_INDEX)
+				{
+					op->volume = MIN_ATT_INDEX;
+					op->state = EG_DEC;
 				}
 			break;
 
 			case EG_DEC:    /* decay phase */
-				if ( !(ym->eg_cnt & ((1<<op->eg_sh_d1r)-1) ) )
-				{
-					op->volume += eg_inc[op->eg_sel_d1r + ((ym->eg_cnt>>op->eg_sh_d1r)&7)];
+				op->volume += eg_inc[op->eg_sel_d1r + ((ym->eg_cnt>>op->eg_sh_d1r)&7)];
 
-					if ( op->volume >= op->d1l )
-                        op->state = EG_SUS;
-
-				}
+				if ( op->volume >= op->d1l )
+					op->state = EG_SUS;
 			break;
 
 			case EG_SUS:    /* sustain phase */
-				if ( !(ym->eg_cnt & ((1<<op->eg_sh_d2r)-1) ) )
-				{
-					op->volume += eg_inc[op->eg_sel_d2r + ((ym->eg_cnt>>op->eg_sh_d2r)&7)];
-
-					if ( op->volume >= MAX_ATT_INDEX )
-					{
-						op->volume = MAX_ATT_INDEX;
-						op->state = EG_OFF;
-					}
+				op->volume += eg_inc[op->eg_sel_d2r + ((ym->eg_cnt>>op->eg_sh_d2r)&7)];
 
+				if ( op->volume >= MAX_ATT_INDEX )
+				{
+					op->volume = MAX_ATT_INDEX;
+					op->state = EG_OFF;
 				}
 			break;
 
 			case EG_REL:    /* release phase */
-				if ( !(ym->eg_cnt & ((1<<op->eg_sh_rr)-1) ) )
-				{
-					op->volume += eg_inc[op->eg_sel_rr + ((ym->eg_cnt>>op->eg_sh_rr)&7)];
-
-					if ( op->volume >= MAX_ATT_INDEX )
-					{
-						op->volume = MAX_ATT_INDEX;
-						op->state = EG_OFF;
-					}
+				op->volume += eg_inc[op->eg_sel_rr + ((ym->eg_cnt>>op->eg_sh_rr)&7)];
 
+				if ( op->volume >= MAX_ATT_INDEX )
+				{
+					op->volume = MAX_ATT_INDEX;
+					op->state = EG_OFF;
 				}
 			break;
 			}
+
+			if (op->state != state)
+				YM2151_eg_schedule(ym,i);
 		}
 	}
 }
@@ -1293,7 +1385,10 @@ void YM2151_advance(YM2151 *ym)
 	i = 8;
 	do
 	{
-		if (op->pms)    /* only when phase modulation from LFO is enabled for this channel */
+		/* the phase is reset at key on, so it doesn't matter for operators in EG_OFF */
+		if (((ym->eg_off >> ((8-i)*4)) & 15) == 15)
+			;
+		else if (op->pms)    /* only when phase modulation from LFO is enabled for this channel */
 		{
 			int32_t mod_ind = ym->lfp;       /* -128..+127 (8bits signed) */
 			if (op->pms < 6)
@@ -1341,6 +1436,7 @@ void YM2151_advance(YM2151 *ym)
 
 	if (ym->csm_req)           /* CSM KEYON/KEYOFF seqeunce request */
 	{
+		ym->eg_dirty = 1;
 		if (ym->csm_req==2)    /* KEY ON */
 		{
 			op = &ym->oper[0]; /* CH 0 M1 */
@@ -1374,7 +1470,7 @@ void YM2151_advance(YM2151 *ym)
 
 void YM2151_init(YM2151* ym,int clk)
 {
-	init_tables();
+	init_tables_once();
     ym->rate = clk/64;
 
 	//m_stream = stream_alloc(0, 2, clock() / 64);
@@ -1388,6 +1484,7 @@ void YM2151_init(YM2151* ym,int clk)
 
 	ym->eg_timer_add  = 1 << EG_SH;
 	ym->eg_timer_overflow = 3 * ym->eg_timer_add;
+	ym->eg_dirty = 1;
 
     int i;
     memset(&ym->connect,0, sizeof(ym->connect));
@@ -1395,7 +1492,6 @@ void YM2151_init(YM2151* ym,int clk)
 		YM2151_set_connect(ym,&ym->oper[i*4], i, ym->connect[i]);
 
     ym->mute_mask=0;
-
 }
 
 
@@ -1461,12 +1557,19 @@ void YM2151_update(YM2151* ym)
         ym->chanout[ch] = 0;
 
     for(ch=0; ch<7; ch++)
-        YM2151_chan_calc(ym,ch);
-    YM2151_chan7_calc(ym);
+        if(!YM2151_chan_idle(ym,ch))
+            YM2151_chan_calc(ym,ch);
+    if(!YM2151_chan_idle(ym,7))
+        YM2151_chan7_calc(ym);
 
     int outl = 0;
     int outr = 0;
     int32_t out = 0;
+    if(ym->voice_out)
+    {
+        memcpy(ym->voice_out+16,ym->voice_out,16*sizeof(float));
+        memset(ym->voice_out,0,16*sizeof(float));
+    }
     for(ch=0; ch<8; ch++) {
         if(!(ym->mute_mask & 1<<ch))
         {
@@ -1475,6 +1578,11 @@ void YM2151_update(YM2151* ym)
                 out = 16383^(out>>31);
             outl += out & ym->pan[2*ch];
             outr += out & ym->pan[2*ch+1];
+            if(ym->voice_out)
+            {
+                ym->voice_out[2*ch] = (out & ym->pan[2*ch])/32768.0;
+                ym->voice_out[2*ch+1] = (out & ym->pan[2*ch+1])/32768.0;
+            }
         }
     }
 
@@ -1498,4 +1606,15 @@ void YM2151_update(YM2151* ym)
     YM2151_advance(ym);
 }
 
-
+int YM2151_attack_pending(YM2151* ym)
+{
+    int i;
+    for(i=0;i<32;i++)
+    {
+        if(ym->mute_mask & 1<<(i/4))
+            continue;
+        if(ym->oper[i].state == EG_ATT)
+            return 1;
+    }
+    return 0;
+}
@@ -131,6 +131,10 @@ struct YM2151
 	uint32_t      eg_timer;               /* global envelope generator counter works at frequency = chipclock/64/3 */
 	uint32_t      eg_timer_add;           /* step of eg_timer */
 	uint32_t      eg_timer_overflow;      /* envelope generator timer overlfows every 3 samples (on real chip) */
+	uint32_t      eg_mask[16];            /* operators with an EG step pending, by counter shift */
+	uint8_t       eg_op_sh[32];           /* counter shift of each operator in eg_mask, 0xff = idle */
+	uint32_t      eg_off;                 /* operators in EG_OFF state */
+	int           eg_dirty;               /* set when eg_mask must be recalculated */
 
 	uint32_t      lfo_phase;              /* accumulated LFO phase (0 to 255) */
 	uint32_t      lfo_timer;              /* LFO timer                        */
@@ -167,6 +171,7 @@ struct YM2151
 
     uint32_t mute_mask;
     double out[4];
+    float* voice_out; // if set, left/right output of each channel, then the previous values
 
     int rate;
 
@@ -191,4 +196,7 @@ void YM2151_init(YM2151* ym,int clk);
 void YM2151_reset(YM2151* ym);
 void YM2151_update(YM2151* ym);
 
+// returns nonzero if any unmuted channel has an operator in attack phase
+int YM2151_attack_pending(YM2151* ym);
+
 #endif // YM2151_H_INCLUDED
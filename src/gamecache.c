@@ -0,0 +1,370 @@
+/*
+    Game cache
+*/
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#ifdef WIN32
+#include <io.h>
+#else
+#include <sys/mman.h>
+#endif
+
+#include "gamecache.h"
+
+#define CACHE_MAGIC "QPCACHE"
+#define CACHE_VERSION 2
+// data and wave images are aligned so they can be mapped
+#define CACHE_ALIGN 0x10000
+// source files are hashed in up to three blocks of this size
+#define CACHE_HASH_BLOCK 0x1000
+
+typedef struct {
+    char path[256];
+    int64_t size;
+    int64_t mtime;
+    uint64_t hash;
+} cache_source_t;
+
+typedef struct {
+    char magic[8];
+    uint32_t version;
+    uint32_t layout[4]; // struct sizes, to catch changes
+    uint32_t source_count;
+    uint32_t flags;
+
+    char driver[128];
+    char title[1024];
+    char type[64];
+    float gain;
+    int32_t muterear;
+    int32_t chipfreq;
+    uint32_t config_count;
+    uint32_t song_count;
+    uint32_t driver_info_size;
+
+    uint32_t data_offset;
+    uint32_t data_size;
+    uint32_t wave_offset;
+    uint32_t wave_size;
+    uint32_t wave_mask;
+} cache_header_t;
+
+typedef struct {
+    char filename[512];
+    cache_header_t header;
+    cache_source_t source[GAMECACHE_MAX_SOURCES];
+} cache_save_t;
+
+static void cache_layout(uint32_t* layout)
+{
+    layout[0] = sizeof(cache_header_t);
+    layout[1] = sizeof(QP_GameAction);
+    layout[2] = sizeof(QP_GameConfig);
+    layout[3] = sizeof(QP_PlaylistEntry);
+}
+
+// cache filename is a hash of the ini and rom paths.
+static void cache_filename(char* out,int size,const char* cachepath,const char* inifile,const char* datapath,const char* wavepath)
+{
+    const char* str[3] = {inifile,datapath,wavepath};
+    const char* c;
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    int i;
+    for(i=0;i<3;i++)
+    {
+        for(c=str[i];*c;c++)
+            hash = (hash ^ (uint8_t)*c) * 0x100000001b3ULL;
+        hash = (hash ^ '\n') * 0x100000001b3ULL;
+    }
+    snprintf(out,size,"%s/%016llx.qpc",cachepath,(unsigned long long)hash);
+}
+
+// Hash the start, middle and end of a file (or all of it, if it is small).
+// This catches files replaced with the same size and modification time
+// without reading whole roms on every load.
+static int cache_hash(uint64_t* out,const char* filename,int64_t size)
+{
+    static uint8_t buf[CACHE_HASH_BLOCK];
+    int64_t offset[3] = {0, size/2-CACHE_HASH_BLOCK/2, size-CACHE_HASH_BLOCK};
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    size_t len;
+    int i, j, count = 3;
+    FILE* f = fopen(filename,"rb");
+    if(!f)
+        return -1;
+    if(size <= CACHE_HASH_BLOCK*3)
+    {
+        offset[0] = 0;
+        count = 1;
+    }
+    for(i=0;i<count;i++)
+    {
+        len = count == 1 ? size : CACHE_HASH_BLOCK;
+        while(len)
+        {
+            size_t n = len < sizeof(buf) ? len : sizeof(buf);
+            if(fseek(f,offset[i],SEEK_SET) || fread(buf,1,n,f) != n)
+            {
+                fclose(f);
+                return -1;
+            }
+            for(j=0;j<n;j++)
+                hash = (hash ^ buf[j]) * 0x100000001b3ULL;
+            offset[i] += n;
+            len -= n;
+        }
+    }
+    fclose(f);
+    *out = hash;
+    return 0;
+}
+
+static int cache_stat(cache_source_t* src,const char* filename)
+{
+    struct stat st;
+    if(stat(filename,&st))
+        return -1;
+    snprintf(src->path,sizeof(src->path),"%s",filename);
+    src->size = st.st_size;
+    src->mtime = st.st_mtime;
+    return cache_hash(&src->hash,filename,src->size);
+}
+
+static uint32_t cache_align(uint32_t pos)
+{
+    return (pos+CACHE_ALIGN-1) & ~(CACHE_ALIGN-1);
+}
+
+#ifndef WIN32
+// Map data and wave images over a reserved area of the full buffer size,
+// so that reads past the end of the images return zeroes.
+static int cache_map(QP_Game *G,FILE* f,cache_header_t* h)
+{
+    int fd = fileno(f);
+    int prot = PROT_READ|PROT_WRITE;
+    uint8_t* base = mmap(NULL,GAME_DATA_MAX+GAME_WAVE_MAX,prot,MAP_PRIVATE|MAP_ANONYMOUS,-1,0);
+    if(base == MAP_FAILED)
+        return -1;
+    if((h->data_size && mmap(base,h->data_size,prot,MAP_PRIVATE|MAP_FIXED,fd,h->data_offset) == MAP_FAILED) ||
+       (h->wave_size && mmap(base+GAME_DATA_MAX,h->wave_size,prot,MAP_PRIVATE|MAP_FIXED,fd,h->wave_offset) == MAP_FAILED))
+    {
+        munmap(base,GAME_DATA_MAX+GAME_WAVE_MAX);
+        return -1;
+    }
+    G->Data = base;
+    G->WaveData = base+GAME_DATA_MAX;
+    G->Cached = 1;
+    return 0;
+}
+#else
+static int cache_map(QP_Game *G,FILE* f,cache_header_t* h)
+{
+    G->Data = malloc(GAME_DATA_MAX);
+    G->WaveData = calloc(GAME_WAVE_MAX,1);
+    if(G->Data && G->WaveData &&
+       !fseek(f,h->data_offset,SEEK_SET) && fread(G->Data,1,h->data_size,f) == h->data_size &&
+       !fseek(f,h->wave_offset,SEEK_SET) && fread(G->WaveData,1,h->wave_size,f) == h->wave_size)
+        return 0;
+    free(G->Data);
+    free(G->WaveData);
+    G->Data = NULL;
+    G->WaveData = NULL;
+    return -1;
+}
+#endif
+
+int QP_GameCacheLoad(QP_Game *G,const char* inifile,const char* datapath,const char* wavepath,char* driver)
+{
+    char filename[512];
+    cache_header_t h;
+    cache_source_t src, cmp;
+    uint32_t layout[4];
+    FILE* f;
+    int i;
+
+    cache_filename(filename,sizeof(filename),G->CachePath,inifile,datapath,wavepath);
+    f = fopen(filename,"rb");
+    if(!f)
+        return -1;
+
+    cache_layout(layout);
+    if(fread(&h,sizeof(h),1,f) != 1 || memcmp(h.magic,CACHE_MAGIC,8) || h.version != CACHE_VERSION ||
+       memcmp(h.layout,layout,sizeof(layout)) || h.source_count > GAMECACHE_MAX_SOURCES ||
+       h.config_count > GAME_CONFIG_MAX || h.song_count > 256 || h.driver_info_size > GAME_DRIVER_INFO_MAX ||
+       h.data_size > GAME_DATA_MAX || h.wave_size > GAME_WAVE_MAX)
+        goto fail;
+
+    for(i=0;i<h.source_count;i++)
+    {
+        if(fread(&src,sizeof(src),1,f) != 1 || cache_stat(&cmp,src.path) ||
+           cmp.size != src.size || cmp.mtime != src.mtime || cmp.hash != src.hash)
+            goto fail;
+    }
+
+    memset(G->Action,0,sizeof(G->Action));
+    memset(G->Config,0,sizeof(G->Config));
+    if(fread(G->Action,sizeof(G->Action),1,f) != 1 ||
+       fread(G->Config,sizeof(QP_GameConfig),h.config_count,f) != h.config_count ||
+       fread(G->Playlist,sizeof(QP_PlaylistEntry),h.song_count,f) != h.song_count ||
+       fread(G->DriverInfo,1,h.driver_info_size,f) != h.driver_info_size)
+        goto fail;
+
+    if(cache_map(G,f,&h))
+        goto fail;
+    fclose(f);
+
+    strcpy(driver,h.driver);
+    strcpy(G->Title,h.title);
+    strcpy(G->Type,h.type);
+    if(h.flags & GAMECACHE_GAIN)
+        G->Gain = h.gain;
+    if(h.flags & GAMECACHE_MUTEREAR)
+        G->MuteRear = h.muterear;
+    G->ChipFreq = h.chipfreq;
+    G->ConfigCount = h.config_count;
+    G->SongCount = h.song_count;
+    G->DriverInfoSize = h.driver_info_size;
+    G->DataSize = h.data_size;
+    G->WaveMask = h.wave_mask;
+    return 0;
+
+fail:
+    G->SongCount = 0;
+    G->ConfigCount = 0;
+    G->DriverInfoSize = 0;
+    fclose(f);
+    return -1;
+}
+
+void QP_GameCacheBegin(QP_Game *G,const char* inifile,const char* datapath,const char* wavepath)
+{
+    cache_save_t* c;
+    if(!*G->CachePath || !(c = calloc(1,sizeof(cache_save_t))))
+        return;
+    cache_filename(c->filename,sizeof(c->filename),G->CachePath,inifile,datapath,wavepath);
+    G->CacheSave = c;
+    QP_GameCacheAddSource(G,inifile);
+}
+
+void QP_GameCacheAddSource(QP_Game *G,const char* filename)
+{
+    cache_save_t* c = G->CacheSave;
+    int i;
+    if(!c)
+        return;
+    for(i=0;i<c->header.source_count;i++)
+    {
+        if(!strcmp(c->source[i].path,filename))
+            return;
+    }
+    // can't validate the cache without all the sources
+    if(i == GAMECACHE_MAX_SOURCES || cache_stat(&c->source[i],filename))
+    {
+        QP_GameCacheClose(G);
+        return;
+    }
+    c->header.source_count++;
+}
+
+void QP_GameCacheEnd(QP_Game *G,const char* driver,int flags)
+{
+    cache_save_t* c = G->CacheSave;
+    if(!c)
+        return;
+    snprintf(c->header.driver,sizeof(c->header.driver),"%s",driver);
+    c->header.flags = flags;
+}
+
+void QP_GameCacheSave(QP_Game *G)
+{
+    cache_save_t* c = G->CacheSave;
+    cache_header_t* h;
+    char tempname[520];
+    uint32_t size;
+    FILE* f;
+    int ok;
+
+    if(!c)
+        return;
+    h = &c->header;
+    memcpy(h->magic,CACHE_MAGIC,8);
+    h->version = CACHE_VERSION;
+    cache_layout(h->layout);
+    snprintf(h->title,sizeof(h->title),"%s",G->Title);
+    snprintf(h->type,sizeof(h->type),"%s",G->Type);
+    h->gain = G->Gain;
+    h->muterear = G->MuteRear;
+    h->chipfreq = G->ChipFreq;
+    h->config_count = G->ConfigCount;
+    h->song_count = G->SongCount;
+    h->driver_info_size = G->DriverInfoSize;
+    h->wave_mask = G->WaveMask;
+
+    // unused wave rom space is not saved
+    size = GAME_WAVE_MAX;
+    while(size && !G->WaveData[size-1])
+        size--;
+
+    h->data_size = G->DataSize;
+    h->wave_size = size;
+    h->data_offset = cache_align(sizeof(*h) + h->source_count*sizeof(cache_source_t) + sizeof(G->Action) +
+                                 h->config_count*sizeof(QP_GameConfig) + h->song_count*sizeof(QP_PlaylistEntry) +
+                                 h->driver_info_size);
+    h->wave_offset = cache_align(h->data_offset + h->data_size);
+
+#ifdef WIN32
+    mkdir(G->CachePath);
+#else
+    mkdir(G->CachePath,0755);
+#endif
+
+    // write to a temporary file first, so that other instances never see
+    // an incomplete cache file.
+    snprintf(tempname,sizeof(tempname),"%s.tmp",c->filename);
+    f = fopen(tempname,"wb");
+    if(f)
+    {
+        ok = fwrite(h,sizeof(*h),1,f) == 1 &&
+             fwrite(c->source,sizeof(cache_source_t),h->source_count,f) == h->source_count &&
+             fwrite(G->Action,sizeof(G->Action),1,f) == 1 &&
+             fwrite(G->Config,sizeof(QP_GameConfig),h->config_count,f) == h->config_count &&
+             fwrite(G->Playlist,sizeof(QP_PlaylistEntry),h->song_count,f) == h->song_count &&
+             fwrite(G->DriverInfo,1,h->driver_info_size,f) == h->driver_info_size &&
+             !fseek(f,h->data_offset,SEEK_SET) &&
+             fwrite(G->Data,1,h->data_size,f) == h->data_size &&
+             !fseek(f,h->wave_offset,SEEK_SET) &&
+             fwrite(G->WaveData,1,h->wave_size,f) == h->wave_size;
+        if(fclose(f) || !ok)
+            remove(tempname);
+        else
+        {
+#ifdef WIN32
+            remove(c->filename);
+#endif
+            if(rename(tempname,c->filename))
+                remove(tempname);
+        }
+    }
+
+    free(c);
+    G->CacheSave = NULL;
+}
+
+void QP_GameCacheClose(QP_Game *G)
+{
+    free(G->CacheSave);
+    G->CacheSave = NULL;
+    if(!G->Cached)
+        return;
+#ifndef WIN32
+    munmap(G->Data,GAME_DATA_MAX+GAME_WAVE_MAX);
+    G->Data = NULL;
+    G->WaveData = NULL;
+#endif
+    G->Cached = 0;
+}
@@ -0,0 +1,40 @@
+/*
+    Game cache
+
+    Saves the processed sound data, wave roms and game configuration to one
+    file per game, which is mapped directly the next time the game is loaded
+    instead of parsing the ini and reading the roms again. The cache is
+    checked against the size and modification time of the ini and rom files,
+    and a hash of the start, middle and end of each file. A file changed
+    only elsewhere, keeping its size and timestamp, is not detected.
+*/
+#ifndef GAMECACHE_H_INCLUDED
+#define GAMECACHE_H_INCLUDED
+
+#include "loader.h"
+
+#define GAMECACHE_MAX_SOURCES 40
+
+// values that are only changed if they are set in the ini
+enum {
+    GAMECACHE_GAIN = 1,
+    GAMECACHE_MUTEREAR = 2,
+};
+
+// Load game from the cache. driver is set to the driver name.
+// Returns 0 if successful, or -1 if the cache is missing or out of date.
+int QP_GameCacheLoad(QP_Game *G,const char* inifile,const char* datapath,const char* wavepath,char* driver);
+
+// Record the files used to load a game, for a new cache file.
+void QP_GameCacheBegin(QP_Game *G,const char* inifile,const char* datapath,const char* wavepath);
+void QP_GameCacheAddSource(QP_Game *G,const char* filename);
+void QP_GameCacheEnd(QP_Game *G,const char* driver,int flags);
+
+// Write the cache file. Call after the initial driver reset, so that
+// driver info (G->DriverInfo) is included.
+void QP_GameCacheSave(QP_Game *G);
+
+// Unmap the game data and free the recorded sources.
+void QP_GameCacheClose(QP_Game *G);
+
+#endif // GAMECACHE_H_INCLUDED
@@ -0,0 +1,842 @@
+/*
+    Game data loader
+*/
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <errno.h>
+
+#ifdef WIN32
+#include "windows.h"
+#else
+#include "libgen.h"
+#endif // WIN32
+
+#include "macro.h"
+#include "driver.h"
+#include "loader.h"
+#include "gamecache.h"
+
+#include "lib/ini.h"
+#include "lib/fileio.h"
+#include "lib/zip.h"
+#include "lib/thread.h"
+#include "lib/trace.h"
+
+// rom files are read in parallel, which helps a lot on network storage
+#define ROM_LOAD_THREADS 8
+#define ROM_JOB_MAX 48
+
+// zip files opened while loading a game
+#define ROM_ZIP_MAX 4
+typedef struct {
+    char name[128];
+    int status; // 0 = open, -1 = failed
+    zipfile_t zip;
+} rom_zip_t;
+
+typedef struct {
+    int count;
+    rom_zip_t zip[ROM_ZIP_MAX];
+} rom_zips_t;
+
+// rom location, either a plain file or a zip entry
+typedef struct {
+    char filename[256];
+    const char* source; // file to check for the game cache
+    zipfile_t* zip;
+    zip_entry_t* entry;
+} rom_loc_t;
+
+// rom load job. all roms are located first, then read.
+typedef struct {
+    const char* base;
+    const char* file;
+    rom_loc_t loc;
+    uint32_t size; // file size, 0 if not found
+    uint8_t* dest; // NULL = don't read
+    uint32_t length;
+    uint32_t offset;
+    int byteswap;
+    int stride;
+    uint32_t limit; // max length, set to the length read
+    int status;
+    char error[128];
+} rom_job_t;
+
+typedef struct {
+    rom_zips_t zips;
+    thread_mutex_t lock; // for zips
+    const char* path;
+    const char* parent;
+    const char* inipath;
+    int count;
+    rom_job_t job[ROM_JOB_MAX];
+} rom_jobs_t;
+
+// Only the first half needs a copy. Byte 2i+1 is written after byte
+// max+i has been read, and max+i >= 2i+1.
+static int rom_deinterleave(QP_Game *G)
+{
+    int max = G->DataSize/2;
+    uint8_t* temp = malloc(max*sizeof(*temp));
+    if(!temp)
+        return -1;
+    int i;
+    memcpy(temp,G->Data,max*sizeof(*temp));
+    for(i=0;i<max;i++)
+    {
+        G->Data[i*2] = temp[i];
+        G->Data[i*2+1] = G->Data[max+i];
+    }
+    free(temp);
+    return 0;
+}
+
+static rom_zip_t* rom_zip_open(rom_zips_t* z,const char* name)
+{
+    int i;
+    rom_zip_t* r;
+    for(i=0;i<z->count;i++)
+    {
+        r = &z->zip[i];
+        if(!strcmp(r->name,name))
+            return r->status ? NULL : r;
+    }
+    if(z->count == ROM_ZIP_MAX)
+        return NULL;
+    r = &z->zip[z->count++];
+    snprintf(r->name,sizeof(r->name),"%s",name);
+    r->status = zip_open(&r->zip,name);
+    return r->status ? NULL : r;
+}
+
+static void rom_zip_close(rom_zips_t* z)
+{
+    int i;
+    for(i=0;i<z->count;i++)
+    {
+        if(!z->zip[i].status)
+            zip_close(&z->zip[i].zip);
+    }
+    z->count = 0;
+}
+
+// Look for a rom in <base>/<set>/ and <base>/<set>.zip, where set is the
+// game path and then the parent set. If not found, the ini directory is used.
+static void rom_locate(rom_zips_t* z,thread_mutex_t* lock,rom_loc_t* loc,const char* base,const char* path,const char* parent,const char* inipath,const char* file)
+{
+    const char* set[2] = {path,parent};
+    char zipname[256];
+    rom_zip_t* r;
+    FILE* f;
+    int i;
+
+    loc->source = loc->filename;
+    loc->zip = NULL;
+    loc->entry = NULL;
+    for(i=0;i<2;i++)
+    {
+        if(!set[i] || !*set[i])
+            continue;
+        snprintf(loc->filename,sizeof(loc->filename),"%s/%s/%s",base,set[i],file);
+        if((f = fopen(loc->filename,"rb")))
+        {
+            fclose(f);
+            return;
+        }
+        snprintf(zipname,sizeof(zipname),"%s/%s.zip",base,set[i]);
+        thread_mutex_lock(lock);
+        r = rom_zip_open(z,zipname);
+        thread_mutex_unlock(lock);
+        if(r && (loc->entry = zip_find(&r->zip,file)))
+        {
+            snprintf(loc->filename,sizeof(loc->filename),"%s/%s",zipname,file);
+            loc->source = r->name;
+            loc->zip = &r->zip;
+            return;
+        }
+    }
+    snprintf(loc->filename,sizeof(loc->filename),"%s/%s",inipath,file);
+}
+
+// Returns the rom file size, or 0 if it can't be opened.
+static uint32_t rom_size(rom_loc_t* loc)
+{
+    FILE* f;
+    uint32_t size;
+    if(loc->entry)
+        return loc->entry->size;
+    if(!(f = fopen(loc->filename,"rb")))
+        return 0;
+    fseek(f,0,SEEK_END);
+    size = ftell(f);
+    fclose(f);
+    return size;
+}
+
+// Same as read_file, but byte n is written to dataptr[n*stride].
+static int rom_read(rom_loc_t* loc,uint8_t* dataptr,uint32_t load_size,uint32_t load_offset,int byteswap,int stride,uint32_t* fsize)
+{
+    zipfile_t z;
+    int ret;
+    if(loc->entry)
+    {
+        // several files from the same zip may be read at once, so each
+        // reader uses its own file handle.
+        z = *loc->zip;
+        if(!(z.file = fopen(loc->source,"rb")))
+        {
+            snprintf(fileio_error,sizeof(fileio_error),"%s",strerror(errno));
+            return -1;
+        }
+        ret = zip_read(&z,loc->entry,dataptr,load_size,load_offset,byteswap,stride,fsize);
+        fclose(z.file);
+        return ret;
+    }
+    return read_file_stride(loc->filename,dataptr,load_size,load_offset,byteswap,stride,fsize);
+}
+
+static void rom_job_locate(void* arg,int index)
+{
+    rom_jobs_t* j = arg;
+    rom_job_t* job = &j->job[index];
+    rom_locate(&j->zips,&j->lock,&job->loc,job->base,j->path,j->parent,j->inipath,job->file);
+    job->size = rom_size(&job->loc);
+}
+
+static void rom_job_read(void* arg,int index)
+{
+    rom_job_t* job = &((rom_jobs_t*)arg)->job[index];
+    if(!job->dest)
+        return;
+    job->status = rom_read(&job->loc,job->dest,job->length,job->offset,job->byteswap,job->stride,&job->limit);
+    // fileio_error is per thread, so keep the message here
+    if(job->status)
+        snprintf(job->error,sizeof(job->error),"%s",my_strerror(job->loc.filename));
+}
+
+// Returns 1 if any jobs from first and up would write to the same area of
+// the buffer at base.
+static int rom_job_overlap(rom_jobs_t* j,int first,uint8_t* base)
+{
+    uint32_t start[ROM_JOB_MAX], end[ROM_JOB_MAX];
+    rom_job_t* job;
+    int i,k;
+    for(i=first;i<j->count;i++)
+    {
+        job = &j->job[i];
+        start[i] = job->dest ? job->dest-base : 0;
+        end[i] = start[i];
+        if(!job->dest || job->offset >= job->size)
+            continue;
+        end[i] += job->length ? job->length : job->size-job->offset;
+        for(k=first;k<i;k++)
+        {
+            if(start[i] < end[k] && start[k] < end[i])
+                return 1;
+        }
+    }
+    return 0;
+}
+
+// Clear the parts of the buffer at base that were not loaded by any job
+// from first and up.
+static void rom_zero_gaps(rom_jobs_t* j,int first,uint8_t* base,uint32_t size)
+{
+    uint32_t pos = 0, next, start, end;
+    int i;
+    while(pos < size)
+    {
+        next = size;
+        for(i=first;i<j->count;i++)
+        {
+            if(j->job[i].status || !j->job[i].dest)
+                continue;
+            start = j->job[i].dest-base;
+            end = start+j->job[i].limit;
+            // skip loaded area
+            if(start <= pos && end > pos)
+                break;
+            if(start > pos && start < next)
+                next = start;
+        }
+        if(i < j->count)
+        {
+            pos = end;
+            continue;
+        }
+        memset(base+pos,0,next-pos);
+        pos = next;
+    }
+}
+
+static char* my_realpath(char* filepath)
+{
+#ifdef WIN32
+    char *buf = malloc(1024), *filepart;
+    if(buf)
+        *buf = 0;
+    GetFullPathName(filepath,1024,buf,&filepart);
+    if(filepart)
+        *filepart = 0;
+#else
+    char *buf = strdup(filepath);
+    char *filepart = dirname(buf);
+#endif
+    return buf;
+}
+
+static void load_error(char* msg,int msglen,char* msgstring)
+{
+    if(msg && msglen)
+        snprintf(msg,msglen,"%s",msgstring);
+}
+
+static int load_driver(struct QP_DriverInterface *di,char* driver_name,char* msg,int msglen,char* msgstring)
+{
+    int i;
+    for(i=0;driver_name[i];i++)
+        driver_name[i] = tolower(driver_name[i]);
+
+    for(i=0;i<DRIVER_COUNT;i++)
+    {
+        if(!strcmp(driver_name,DriverTable[i].name))
+        {
+            printf("loading driver: %s\n",DriverTable[i].name);
+            if(DriverCreate(di,i))
+                break;
+            return 0;
+        }
+    }
+    if(i==DRIVER_COUNT)
+        sprintf(msgstring,"%s Unable to find matching driver type for \"%s\"",msgstring,driver_name);
+    else
+        sprintf(msgstring,"%s Failed to create driver \"%s\"",msgstring,driver_name);
+    load_error(msg,msglen,msgstring);
+    return -1;
+}
+
+// Loads game ini, then the sound data and wave roms...
+// this is a huge and messy function and needs to be replaced.
+static int game_load(QP_Game *G,struct QP_DriverInterface *di,const char* inipath,const char* datapath,const char* wavepath,char* msg,int msglen)
+{
+    char msgstring[1024];
+    char *filename;
+    char *path;
+    //char gamehackname[128];
+    char wave0[16];
+    char wave1[16];
+
+    int byteswap = 0;
+    int interleave=0;
+    int cache_flags = 0;
+
+    int data_count = 0;
+    int data_pos = 0;
+    uint32_t data_size = 0;
+
+    int wave_count = 0;
+    int wave_pos[16];
+    int wave_length[16];
+    int wave_offset[16];
+    int wave_byteswap[16];
+    G->ChipFreq = 0;
+    G->SongCount = 0;
+    G->ConfigCount = 0;
+
+    int patchtype_set = 0;
+    int patchaddr_set = 0;
+    int patchdata_set = 0;
+    int patchcount = 0;
+
+    unsigned int action_id = 0;
+    unsigned int action_reg = 0;
+    unsigned int action_data = 0;
+
+    int patchtype[64];
+    int patchaddr[64];
+    int patchdata[64];
+
+    char wave_filename[16][128];
+    char data_filename[16][128];
+    char driver_name[128];
+
+    char *ini_realpath = 0;
+    char parent[128];
+
+    rom_jobs_t* jobs;
+    rom_job_t* job;
+    int wave_job = 0;
+    uint32_t data_len[16];
+
+    G->Data = NULL;
+    G->WaveData = NULL;
+    G->Cached = 0;
+    G->CacheSave = NULL;
+    G->DriverInfoSize = 0;
+    memset(di,0,sizeof(struct QP_DriverInterface));
+
+    filename = malloc(2048);
+    path = malloc(2048);
+    msgstring[0] = 0;
+    path[0] = 0;
+
+    sprintf(msgstring,"Failed to load '%s':",G->Name);
+    int loadok = strlen(msgstring);
+
+    // if dot is found, direct path to ini is assumed
+    if(strrchr(G->Name,'.'))
+        snprintf(filename,127,"%s",G->Name);
+    else
+        snprintf(filename,127,"%s/%s.ini",inipath,G->Name);
+
+#ifdef DEBUG
+    printf("Now loading '%s' ...\n",filename);
+#endif
+
+    if(*G->CachePath)
+    {
+        if(!QP_GameCacheLoad(G,filename,datapath,wavepath,driver_name))
+        {
+            free(filename);
+            free(path);
+            return load_driver(di,driver_name,msg,msglen,msgstring);
+        }
+        QP_GameCacheBegin(G,filename,datapath,wavepath);
+    }
+
+    strcpy(G->Title,G->Name);
+    memset(wave_pos,0,sizeof(wave_pos));
+    memset(wave_length,0,sizeof(wave_length));
+    memset(wave_offset,0,sizeof(wave_offset));
+    memset(wave_filename,0,sizeof(wave_filename));
+    memset(wave_byteswap,0,sizeof(wave_byteswap));
+    memset(G->Action,0,sizeof(G->Action));
+    memset(G->Config,0,sizeof(G->Config));
+    memset(G->Type,0,sizeof(G->Type));
+    memset(driver_name,0,sizeof(driver_name));
+    memset(parent,0,sizeof(parent));
+
+    inifile_t initest;
+    if(!ini_open(filename,&initest))
+    {
+        ini_realpath = my_realpath(filename);
+        while(!ini_readnext(&initest))
+        {
+            //printf("'%s'.'%s' = '%s'\n",initest.section,initest.key,initest.value);
+            snprintf(wave0,15,"wave.%d",wave_count);
+            snprintf(wave1,15,"wave.%d",wave_count+1);
+
+            // this will be updated with more options as needed.
+            if(!strcmp(initest.section,"data"))
+            {
+                if(!strcmp(initest.key,"name"))
+                    strcpy(G->Title,initest.value);
+                else if(!strcmp(initest.key,"path"))
+                    strcpy(path,initest.value);
+                else if(!strcmp(initest.key,"parent"))
+                    snprintf(parent,sizeof(parent),"%s",initest.value);
+                else if(!strcmp(initest.key,"filename"))
+                {
+                    if(data_count < 16)
+                    {
+                        strcpy(data_filename[data_count],initest.value);
+                        data_count++;
+                    }
+                }
+                else if(!strcmp(initest.key,"driver"))
+                    strcpy(driver_name,initest.value);
+                else if(!strcmp(initest.key,"type"))
+                    strcpy(G->Type,initest.value);
+                else if(!strcmp(initest.key,"byteswap"))
+                    byteswap = atoi(initest.value) & 1;
+                else if(!strcmp(initest.key,"interleave"))
+                    interleave = atoi(initest.value) & 1;
+                else if(!strcmp(initest.key,"gain"))
+                {
+                    G->Gain = atof(initest.value);
+                    cache_flags |= GAMECACHE_GAIN;
+                }
+                else if(!strcmp(initest.key,"muterear"))
+                {
+                    G->MuteRear = atoi(initest.value);
+                    cache_flags |= GAMECACHE_MUTEREAR;
+                }
+                else if(!strcmp(initest.key,"chipfreq"))
+                    G->ChipFreq = atoi(initest.value);
+//                else if(!strcmp(initest.key,"gamehack"))
+//                    strcpy(gamehackname,initest.value);
+            }
+
+            if(!strcmp(initest.section,"patch"))
+            {
+                patchtype_set=0;
+                patchdata_set = strtol(initest.value,NULL,0);
+
+                if(!strcmp(initest.key,"address"))
+                    patchaddr_set = patchdata_set;
+                else if(!strcmp(initest.key,"song"))
+                    patchaddr_set = patchdata_set*3;
+                else if(!strcmp(initest.key,"byte"))
+                    patchtype_set = 1;
+                else if(!strcmp(initest.key,"word"))
+                    patchtype_set = 2;
+                else if(!strcmp(initest.key,"pos"))
+                    patchtype_set = 3;
+
+                if(patchtype_set)
+                {
+                    patchtype[patchcount] = patchtype_set;
+                    patchaddr[patchcount] = patchaddr_set;
+                    patchdata[patchcount] = patchdata_set;
+                    patchaddr_set+=patchtype_set;
+                    patchcount++;
+                }
+            }
+
+            // at the next wave rom section?
+            if(!strcmp(initest.section,wave1))
+            {
+                if(wave_count < 16)
+                    wave_count++;
+
+                snprintf(wave0,15,"wave.%d",wave_count);
+            }
+            if(!strcmp(initest.section,wave0))
+            {
+                if(!strcmp(initest.key,"filename"))
+                    strcpy(wave_filename[wave_count],initest.value);
+                else if(!strcmp(initest.key,"length"))
+                    wave_length[wave_count] = strtol(initest.value,NULL,0);
+                else if(!strcmp(initest.key,"position"))
+                    wave_pos[wave_count] = strtol(initest.value,NULL,0);
+                else if(!strcmp(initest.key,"offset"))
+                    wave_offset[wave_count] = strtol(initest.value,NULL,0);
+                else if(!strcmp(initest.key,"byteswap"))
+                    wave_byteswap[wave_count] = strtol(initest.value,NULL,0);
+            }
+            if(!strcmp(initest.section,"playlist"))
+            {
+                if(!strcmp(initest.key,"loops"))
+                {
+                    G->Playlist[G->SongCount-1].script[action_id].wait_type=0;
+                    G->Playlist[G->SongCount-1].script[action_id].wait_count=strtol(initest.value,NULL,0);
+                }
+                else if(!strcmp(initest.key,"time"))
+                {
+                    G->Playlist[G->SongCount-1].script[action_id].wait_type=1;
+                    G->Playlist[G->SongCount-1].script[action_id].wait_count=strtol(initest.value,NULL,0);
+                }
+                else if(!strcmp(initest.key,"action"))
+                {
+                    G->Playlist[G->SongCount-1].script[action_id].action_id=strtol(initest.value,NULL,0);
+                    action_id++;
+                    G->Playlist[G->SongCount-1].script[action_id].action_id = -1;
+                    G->Playlist[G->SongCount-1].script[action_id].wait_type = 1; // end immediately...
+                }
+                else if(!strcmp(initest.key,"loop"))
+                {
+                    G->Playlist[G->SongCount-1].script[action_id].wait_type=2;
+                    G->Playlist[G->SongCount-1].script[action_id].wait_count=strtol(initest.value,NULL,0);
+                }
+                else if(!strcmp(initest.key,"bank"))
+                {
+                    G->Playlist[G->SongCount-1].Bank = strtol(initest.value,NULL,0);
+                }
+                else if(sscanf(initest.key,"%x",&action_reg)==1)
+                {
+                    action_id=0;
+                    G->Playlist[G->SongCount].SongID = action_reg;
+                    G->Playlist[G->SongCount].Bank = -1;
+                    strncpy(G->Playlist[G->SongCount].Title,initest.value,254);
+                    G->Playlist[G->SongCount].script[action_id].wait_type=0;
+                    G->Playlist[G->SongCount].script[action_id].wait_count=2;
+                    G->Playlist[G->SongCount].script[action_id].action_id=-1;
+                    G->SongCount++;
+                }
+                Q_DEBUG("playlist %s = %s\n",initest.key,initest.value);
+            }
+            if(sscanf(initest.section,"action.%d",&action_id)==1 && action_id < 256)
+            {
+                if(sscanf(initest.key,"r%x",&action_reg)==1)
+                {
+                    action_data = strtol(initest.value,NULL,0);
+                    G->Action[action_id].reg[G->Action[action_id].cnt] = action_reg;
+                    G->Action[action_id].data[G->Action[action_id].cnt] = action_data;
+                    Q_DEBUG("action %d (%02x) =  r%02x = %04x\n",action_id,G->Action[action_id].cnt,action_reg,action_data);
+                    G->Action[action_id].cnt++;
+                }
+                else if(sscanf(initest.key,"t%x",&action_reg)==1)
+                {
+                    action_data = strtol(initest.value,NULL,0);
+                    G->Action[action_id].reg[G->Action[action_id].cnt] = action_reg+0x100;
+                    G->Action[action_id].data[G->Action[action_id].cnt] = action_data;
+                    Q_DEBUG("action %d (%02x) =  t%02x = %04x\n",action_id,G->Action[action_id].cnt,action_reg,action_data);
+                    G->Action[action_id].cnt++;
+                }
+            }
+            if(!strcmp(initest.section,"config"))
+            {
+                strncpy(G->Config[G->ConfigCount].name,initest.key,15);
+                strncpy(G->Config[G->ConfigCount++].data,initest.value,45);
+            }
+        }
+    }
+
+    if(initest.status)
+    {
+        if(initest.status == INI_FILE_LOAD_ERROR)
+            strcat(msgstring,my_strerror(filename));
+        else
+            strcat(msgstring,ini_error[initest.status]);
+
+        load_error(msg,msglen,msgstring);
+        ini_close(&initest);
+        QP_GameCacheClose(G);
+
+        free(filename);
+        free(path);
+        return -1;
+    }
+
+    ini_close(&initest);
+
+    int i;
+
+    if(strlen(path) == 0)
+        strcpy(path,G->Name);
+
+    G->WaveMask=0;
+    G->DataSize = GAME_DATA_MAX;
+    G->Data = (uint8_t*)malloc(G->DataSize);
+    data_pos = G->DataSize;
+
+#ifdef DEBUG
+    printf("Game title: '%s'\n",G->Title);
+    //printf("Data filename: '%s'\n",data_filename);
+    printf("Wave count: %d\n",wave_count+1);
+    if(byteswap)
+        printf("Data file byteswapped\n");
+    printf("Playlist Song count: %d\n",G->SongCount);
+#endif
+
+    jobs = calloc(1,sizeof(rom_jobs_t));
+    G->WaveData = (uint8_t*)malloc(GAME_WAVE_MAX);
+    if(!G->Data || !G->WaveData || !jobs)
+    {
+        strcat(msgstring," Out of memory");
+        load_error(msg,msglen,msgstring);
+        QP_GameCacheClose(G);
+        free(jobs);
+        free(ini_realpath);
+        free(filename);
+        free(path);
+        return -1;
+    }
+
+    // find all roms first
+    thread_mutex_init(&jobs->lock);
+    jobs->path = path;
+    jobs->parent = parent;
+    jobs->inipath = ini_realpath;
+    for(i=0;i<data_count;i++)
+    {
+        job = &jobs->job[jobs->count++];
+        job->base = datapath;
+        job->file = data_filename[i];
+    }
+    wave_job = jobs->count;
+    for(i=0;i<wave_count+1;i++)
+    {
+        if(!strlen(wave_filename[i]))
+            continue;
+        job = &jobs->job[jobs->count++];
+        job->base = wavepath;
+        job->file = wave_filename[i];
+    }
+    thread_for(jobs->count,ROM_LOAD_THREADS,rom_job_locate,jobs);
+    for(i=0;i<jobs->count;i++)
+        QP_GameCacheAddSource(G,jobs->job[i].loc.source);
+
+    // interleaved roms are written directly to their final positions, as
+    // long as none of them cross the middle of the data.
+    if(interleave)
+    {
+        data_pos=0;
+        for(i=0;i<data_count;i++)
+        {
+            data_len[i] = jobs->job[i].size;
+            if(!data_len[i])
+                break;
+            if(data_len[i] > G->DataSize-data_pos)
+                data_len[i] = G->DataSize-data_pos;
+            data_pos += data_len[i];
+        }
+        data_size = data_pos/2;
+        if(i<data_count || data_pos&1)
+            data_size = 0;
+        data_pos=0;
+        for(i=0;data_size && i<data_count;i++)
+        {
+            if(data_pos < data_size && data_pos+data_len[i] > data_size)
+                data_size = 0;
+            data_pos += data_len[i];
+        }
+        if(data_size)
+            interleave = 2;
+    }
+
+    // data roms are placed after each other
+    data_pos=0;
+    for(i=0;i<data_count;i++)
+    {
+        job = &jobs->job[i];
+        job->byteswap = byteswap;
+        if(interleave == 2)
+        {
+            if(data_pos < data_size)
+                job->dest = G->Data+data_pos*2;
+            else
+                job->dest = G->Data+(data_pos-data_size)*2+1;
+            job->stride = 2;
+            job->limit = data_len[i];
+            data_pos += data_len[i];
+            continue;
+        }
+        job->stride = 1;
+        job->limit = G->DataSize-data_pos;
+        if(!job->limit)
+            continue;
+        job->dest = G->Data+data_pos;
+#ifdef DEBUG
+        printf("Data %d\n",i);
+        printf("\tFilename: '%s'\n",job->loc.filename);
+        printf("\tPosition: %06x\n",data_pos);
+        printf("\tLength: %06x\n",job->size < job->limit ? job->size : job->limit);
+#endif // DEBUG
+        // size is 0 if the rom can't be opened. the read fails then.
+        data_pos += job->size < job->limit ? job->size : job->limit;
+    }
+    G->DataSize = data_pos;
+
+    // wave roms have fixed positions
+    job = &jobs->job[wave_job];
+    for(i=0;i<wave_count+1;i++)
+    {
+        if(!strlen(wave_filename[i]))
+            continue;
+#ifdef DEBUG
+        printf("Wave %d\n",i);
+        printf("\tFilename: '%s'\n",job->loc.filename);
+        printf("\tPosition: %06x\n",wave_pos[i]);
+        printf("\tLength: %06x\n",wave_length[i]);
+        printf("\tOffset: %06x\n",wave_offset[i]);
+#endif
+        job->dest = G->WaveData+wave_pos[i];
+        job->length = wave_length[i];
+        job->offset = wave_offset[i];
+        job->byteswap = wave_byteswap[i];
+        job->stride = 1;
+        job->limit = GAME_WAVE_MAX - wave_pos[i];
+        G->WaveMask |= wave_pos[i]+wave_length[i]-1;
+        job++;
+    }
+
+    // overlapping roms must be loaded in order
+    thread_for(jobs->count,rom_job_overlap(jobs,wave_job,G->WaveData) ? 1 : ROM_LOAD_THREADS,rom_job_read,jobs);
+    for(i=0;i<jobs->count;i++)
+        strcat(msgstring,jobs->job[i].error);
+    rom_zero_gaps(jobs,wave_job,G->WaveData,GAME_WAVE_MAX);
+
+    if(interleave == 1)
+    {
+        if(rom_deinterleave(G))
+            strcat(msgstring,"rom_deinterleave failed");
+    }
+
+    for(i=0;i<patchcount;i++)
+    {
+        printf("Patch type %d addr %06x data %06x\n",patchtype[i],patchaddr[i],patchdata[i]);
+
+        if(patchaddr[i]+patchtype[i] > G->DataSize)
+            printf("patch address out of bounds\n");
+        else if(patchtype[i] == 1) // byte
+            *(uint8_t*)(G->Data+patchaddr[i]) = patchdata[i];
+        else if(patchtype[i] == 3) // song table
+        {
+            patchaddr_set = patchaddr[i];
+            if(!strcmp(G->Type,"H8") || !strcmp(G->Type,"H8_ND")) // for most cases....
+            {
+                if(patchaddr_set < 0x1800)
+                    patchaddr_set += 0x800e;
+                patchdata_set = patchdata[i];
+            }
+            else
+            {
+                if(patchaddr_set < 0x1800)
+                    patchaddr_set += 0x1000e;
+                patchdata_set = patchdata[i] + 0x200000;
+            }
+
+            *(uint16_t*)(G->Data+patchaddr_set) = patchdata_set&0xffff;
+            *(uint8_t*)(G->Data+patchaddr_set+2) = patchdata_set>>16;
+        }
+        else //if (patchtype[i] == 2) // word
+            *(uint16_t*)(G->Data+patchaddr[i]) = patchdata[i];
+    }
+
+    rom_zip_close(&jobs->zips);
+    thread_mutex_destroy(&jobs->lock);
+    free(jobs);
+    free(ini_realpath);
+    free(filename);
+    free(path);
+
+#ifdef DEBUG
+    printf("Wave Mask = %06x\n",G->WaveMask);
+#endif
+
+    if(loadok != strlen(msgstring))
+    {
+        load_error(msg,msglen,msgstring);
+        QP_GameCacheClose(G);
+        return -1;
+    }
+
+    QP_GameCacheEnd(G,driver_name,cache_flags);
+    return load_driver(di,driver_name,msg,msglen,msgstring);
+}
+
+int QP_GameLoad(QP_Game *G,struct QP_DriverInterface *di,const char* inipath,const char* datapath,const char* wavepath,char* msg,int msglen)
+{
+    int status;
+    TRACE_BEGIN("game load");
+    status = game_load(G,di,inipath,datapath,wavepath,msg,msglen);
+    TRACE_END("game load");
+    return status;
+}
+
+void QP_GameUnload(QP_Game *G,struct QP_DriverInterface *di)
+{
+    QP_GameCacheClose(G);
+    if(G->Data)
+        free(G->Data);
+    if(G->WaveData)
+        free(G->WaveData);
+    G->Data = NULL;
+    G->WaveData = NULL;
+    DriverDestroy(di);
+    di->Driver = NULL;
+}
+
+const char* QP_GameSongTitle(QP_Game *G,int songid)
+{
+    int i;
+    for(i=0;i<G->SongCount;i++)
+        if(G->Playlist[i].SongID == songid)
+            return G->Playlist[i].Title;
+    return NULL;
+}
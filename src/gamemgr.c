@@ -0,0 +1,452 @@
+/*
+    Game manager
+*/
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "SDL2/SDL.h"
+
+#include "qp.h"
+#include "legacy.h"
+#include "gamemgr.h"
+#include "gamecache.h"
+
+#include "lib/vgm.h"
+
+// Load the game data. Called from the preload thread, so globals must not
+// be touched here. The caller sets the slot state.
+static int gamemgr_load(QP_GameSlot *s)
+{
+    if(QP_GameLoad(s->Game,s->Driver,QP_IniPath,QP_DataPath,QP_WavePath,s->Error,sizeof(s->Error)))
+        return GAMEMGR_FAILED;
+    // cached images only use memory for the pages that are read
+    s->Size = sizeof(QP_Game);
+    if(s->Game->Cached)
+        s->Size += s->Game->DataSize + (s->Game->WaveMask < GAME_WAVE_MAX ? s->Game->WaveMask+1 : GAME_WAVE_MAX);
+    else
+        s->Size += GAME_DATA_MAX + GAME_WAVE_MAX;
+    return GAMEMGR_LOADED;
+}
+
+static int gamemgr_thread(void *data)
+{
+    QP_GameManager *m = data;
+    QP_GameSlot *s;
+    int state;
+
+    SDL_LockMutex(m->Lock);
+    while(!m->Quit)
+    {
+        if(!m->Pending)
+        {
+            SDL_CondWait(m->Cond,m->Lock);
+            continue;
+        }
+        s = m->Pending;
+        m->Pending = NULL;
+        SDL_UnlockMutex(m->Lock);
+
+        state = gamemgr_load(s);
+
+        SDL_LockMutex(m->Lock);
+        s->State = state;
+        SDL_CondBroadcast(m->Cond);
+    }
+    SDL_UnlockMutex(m->Lock);
+    return 0;
+}
+
+// Must be called with the lock held.
+static QP_GameSlot* gamemgr_find(QP_GameManager *m,const char *name)
+{
+    int i;
+    for(i=0;i<GAMEMGR_MAX_SLOTS;i++)
+    {
+        if(m->Slot[i].State != GAMEMGR_EMPTY && !strcmp(m->Slot[i].Name,name))
+            return &m->Slot[i];
+    }
+    return NULL;
+}
+
+// Free a slot that is not being loaded and not active.
+static void gamemgr_free(QP_GameSlot *s)
+{
+    if(s->Initialized)
+        s->Driver->IDeinit(s->Driver->Driver);
+    if(s->Game && s->Driver)
+        QP_GameUnload(s->Game,s->Driver);
+    free(s->Game);
+    free(s->Driver);
+    memset(s,0,sizeof(*s));
+}
+
+// Evict the least recently used inactive game. Returns -1 if there is none.
+static int gamemgr_evict(QP_GameManager *m)
+{
+    QP_GameSlot *s, *lru = NULL;
+    int i;
+
+    SDL_LockMutex(m->Lock);
+    for(i=0;i<GAMEMGR_MAX_SLOTS;i++)
+    {
+        s = &m->Slot[i];
+        if(s == m->Active || (s->State != GAMEMGR_LOADED && s->State != GAMEMGR_FAILED))
+            continue;
+        if(!lru || (int32_t)(s->LastUse - lru->LastUse) < 0)
+            lru = s;
+    }
+    SDL_UnlockMutex(m->Lock);
+
+    if(!lru)
+        return -1;
+    gamemgr_free(lru);
+    return 0;
+}
+
+// Evict games until inactive games fit in the memory limit.
+static void gamemgr_prune(QP_GameManager *m)
+{
+    size_t total;
+    int i;
+    do
+    {
+        total = 0;
+        SDL_LockMutex(m->Lock);
+        for(i=0;i<GAMEMGR_MAX_SLOTS;i++)
+        {
+            if(&m->Slot[i] != m->Active && m->Slot[i].State == GAMEMGR_LOADED)
+                total += m->Slot[i].Size;
+        }
+        SDL_UnlockMutex(m->Lock);
+    }
+    while(total > m->MemoryLimit && !gamemgr_evict(m));
+}
+
+// Allocate a slot for a new game. Must be called with the lock held.
+static QP_GameSlot* gamemgr_claim(QP_GameManager *m,const char *name)
+{
+    QP_GameSlot *s = NULL;
+    int i;
+
+    for(i=0;i<GAMEMGR_MAX_SLOTS;i++)
+    {
+        if(m->Slot[i].State == GAMEMGR_EMPTY)
+        {
+            s = &m->Slot[i];
+            break;
+        }
+    }
+    if(!s)
+    {
+        SDL_UnlockMutex(m->Lock);
+        i = gamemgr_evict(m);
+        SDL_LockMutex(m->Lock);
+        if(i)
+            return NULL;
+        return gamemgr_claim(m,name);
+    }
+
+    s->Game = malloc(sizeof(QP_Game));
+    s->Driver = calloc(1,sizeof(struct QP_DriverInterface));
+    if(!s->Game || !s->Driver)
+    {
+        free(s->Game);
+        free(s->Driver);
+        s->Game = NULL;
+        s->Driver = NULL;
+        return NULL;
+    }
+    memcpy(s->Game,m->Config,sizeof(QP_Game));
+    snprintf(s->Game->Name,sizeof(s->Game->Name),"%s",name);
+    snprintf(s->Name,sizeof(s->Name),"%s",name);
+    s->State = GAMEMGR_LOADING;
+    s->LastUse = ++m->UseCount;
+    return s;
+}
+
+// Close the VGM log of the active game. Audio must be locked or closed.
+// The WAV log is closed separately, as closing it waits for the disk.
+static void gamemgr_close_logs(QP_GameSlot *s)
+{
+    QP_Game *G = s->Game;
+
+    if(G->VgmLog)
+    {
+        s->Driver->IVgmClose(s->Driver->Driver,Audio->state.MuteRear);
+        vgm_stop(&G->Vgm);
+        vgm_write_tag(&G->Vgm,strlen(G->Title) ? G->Title : G->Name,G->AutoPlay);
+        vgm_close(&G->Vgm);
+        G->VgmLog = 0;
+    }
+}
+
+int QP_GameManagerInit(QP_GameManager *m,QP_Game *config,size_t limit)
+{
+    memset(m,0,sizeof(*m));
+    m->Config = config;
+    m->MemoryLimit = limit;
+    m->Lock = SDL_CreateMutex();
+    m->Cond = SDL_CreateCond();
+    if(!m->Lock || !m->Cond)
+        return -1;
+    // without the thread, games are only loaded on activation
+    m->Thread = SDL_CreateThread(gamemgr_thread,"GameManager",m);
+    return 0;
+}
+
+void QP_GameManagerDeinit(QP_GameManager *m)
+{
+    int i;
+
+    if(m->Thread)
+    {
+        SDL_LockMutex(m->Lock);
+        m->Quit = 1;
+        SDL_CondBroadcast(m->Cond);
+        SDL_UnlockMutex(m->Lock);
+        SDL_WaitThread(m->Thread,NULL);
+    }
+
+    QP_AudioClose(Audio);
+    QP_AudioWavClose(Audio);
+    if(m->Active)
+        gamemgr_close_logs(m->Active);
+    m->Active = NULL;
+    Game = m->Config;
+    DriverInterface = NULL;
+    QDrv = NULL;
+
+    for(i=0;i<GAMEMGR_MAX_SLOTS;i++)
+        gamemgr_free(&m->Slot[i]);
+
+    if(m->Cond)
+        SDL_DestroyCond(m->Cond);
+    if(m->Lock)
+        SDL_DestroyMutex(m->Lock);
+    m->Cond = NULL;
+    m->Lock = NULL;
+}
+
+void QP_GameManagerPreload(QP_GameManager *m,const char *name)
+{
+    QP_GameSlot *s;
+
+    if(!m->Thread || !*name)
+        return;
+
+    SDL_LockMutex(m->Lock);
+    s = gamemgr_find(m,name);
+    if(s)
+    {
+        s->LastUse = ++m->UseCount;
+        SDL_UnlockMutex(m->Lock);
+        return;
+    }
+    // replace a preload that hasn't started yet
+    if(m->Pending)
+    {
+        s = m->Pending;
+        m->Pending = NULL;
+        SDL_UnlockMutex(m->Lock);
+        gamemgr_free(s);
+        SDL_LockMutex(m->Lock);
+    }
+    s = gamemgr_claim(m,name);
+    if(s)
+    {
+        m->Pending = s;
+        SDL_CondBroadcast(m->Cond);
+    }
+    SDL_UnlockMutex(m->Lock);
+
+    gamemgr_prune(m);
+}
+
+// Initialize the driver of a newly loaded game.
+static int gamemgr_init(QP_GameManager *m,QP_GameSlot *s)
+{
+    static char filename[FILENAME_MAX];
+    struct QP_DriverInterface *di = s->Driver;
+    QP_Game *G = s->Game;
+
+    if(di->IInit(di->Driver,G))
+        return -1;
+    s->Initialized = 1;
+
+    G->VgmLog = m->Config->VgmLog;
+    if(G->VgmLog)
+    {
+        strcpy(filename,"qp_log.vgm");
+        if(G->AutoPlay >= 0)
+            sprintf(filename,"%s_%03x.vgm",G->Name,G->AutoPlay&0x7ff);
+        if(vgm_open(&G->Vgm,filename))
+            G->VgmLog = 0;
+        else
+            di->IVgmOpen(di->Driver,&G->Vgm);
+    }
+
+    di->IReset(di->Driver,G,1);
+    QP_GameCacheSave(G);
+    return 0;
+}
+
+int QP_GameManagerActivate(QP_GameManager *m,const char *name)
+{
+    static char filename[FILENAME_MAX];
+    QP_GameSlot *s;
+    QP_Game *G;
+    char *audiodev = NULL;
+    wavfile_t *oldlog = NULL, *newlog = NULL;
+    int switching;
+    int buffer = m->Config->AudioBuffer;
+    int sync = 0;
+    int state;
+    int initial = 0;
+
+    SDL_LockMutex(m->Lock);
+    s = gamemgr_find(m,name);
+    if(s && s == m->Pending)
+    {
+        // preload hasn't started, do it now instead
+        m->Pending = NULL;
+        sync = 1;
+    }
+    else if(!s)
+    {
+        s = gamemgr_claim(m,name);
+        sync = 1;
+    }
+    while(s && !sync && s->State == GAMEMGR_LOADING)
+        SDL_CondWait(m->Cond,m->Lock);
+    SDL_UnlockMutex(m->Lock);
+
+    if(!s)
+    {
+        SDL_ShowSimpleMessageBox(SDL_MESSAGEBOX_ERROR,"Error","Failed to allocate memory",NULL);
+        return -1;
+    }
+    if(sync)
+    {
+        state = gamemgr_load(s);
+        SDL_LockMutex(m->Lock);
+        s->State = state;
+        SDL_UnlockMutex(m->Lock);
+    }
+    if(s->State == GAMEMGR_FAILED)
+    {
+        SDL_ShowSimpleMessageBox(SDL_MESSAGEBOX_ERROR,"Error",s->Error,NULL);
+        gamemgr_free(s);
+        return -1;
+    }
+
+    G = s->Game;
+
+    // the vgm log must start from the initial reset
+    if(s->Initialized && s != m->Active && m->Config->VgmLog)
+    {
+        s->Driver->IDeinit(s->Driver->Driver);
+        s->Initialized = 0;
+    }
+
+    if(!s->Initialized)
+    {
+        if(gamemgr_init(m,s))
+        {
+            SDL_ShowSimpleMessageBox(SDL_MESSAGEBOX_ERROR,"Error","Failed to initialize driver",NULL);
+            gamemgr_free(s);
+            return -1;
+        }
+        if(m->HalfGain)
+            G->Gain/=2;
+        initial = 1;
+    }
+
+    // The audio device is opened once and kept open. Games with a different
+    // chip rate are resampled by the renderer.
+    if(!Audio->Initialized)
+    {
+        if(m->Config->LowLatency && buffer > QPAUDIO_LOW_LATENCY_BUFFER)
+            buffer = QPAUDIO_LOW_LATENCY_BUFFER;
+        if(strlen(m->Config->AudioDevice))
+            audiodev = m->Config->AudioDevice;
+        if(QP_AudioInit(Audio,s->Driver->IChipRate(s->Driver->Driver),buffer,4,audiodev))
+        {
+            // we couldn't initialize audio with 4 channels, let's try 2 instead...
+            m->HalfGain = 1;
+            G->Gain/=2; // you'll thank me for this
+            if(QP_AudioInit(Audio,s->Driver->IChipRate(s->Driver->Driver),buffer,2,audiodev))
+                return -1;
+        }
+    }
+
+    // The WAV logs are opened and closed without the audio lock, so that
+    // the callback doesn't wait for the disk.
+    switching = m->Active && m->Active != s;
+    if(G->WavLog && (switching || !Audio->state.FileLogging))
+    {
+        const char* ext = wav_extension(G->WavFormat);
+        sprintf(filename,"qp_log.%s",ext);
+        if(G->AutoPlay >= 0)
+            sprintf(filename,"%s_%03x.%s",G->Name,G->AutoPlay&0x7ff,ext);
+        newlog = wav_open(filename,Audio->state.OutChannels,Audio->state.SampleRate,G->WavFormat);
+        if(newlog)
+        {
+            wav_tag(newlog,"ALBUM",G->Title);
+            if(G->AutoPlay >= 0)
+            {
+                const char* title = QP_GameSongTitle(G,G->AutoPlay);
+                sprintf(filename,"0x%03x",G->AutoPlay&0x7ff);
+                wav_tag(newlog,"SONGID",filename);
+                if(title)
+                    wav_tag(newlog,"TITLE",title);
+            }
+        }
+    }
+
+    SDL_LockAudioDevice(Audio->dev);
+
+    if(switching)
+    {
+        oldlog = QP_AudioWavDetach(Audio);
+        gamemgr_close_logs(m->Active);
+    }
+    if(newlog)
+        QP_AudioWavAttach(Audio,newlog);
+
+    if(!initial)
+        s->Driver->IReset(s->Driver->Driver,G,0);
+
+    G->PlaylistPosition = 0;
+    G->PlaylistLoop = 0;
+    G->PlaylistControl = 0;
+    G->PlaylistSongID = 0;
+    G->ActionTimer = 0;
+    G->Fadeout = 0;
+    G->QueueSong = G->AutoPlay;
+
+    // triggers are for the previous driver
+    Audio->state.TriggerRead = Audio->state.TriggerWrite;
+    Game = G;
+    DriverInterface = s->Driver;
+    QDrv = s->Driver->Type == DRIVER_QUATTRO ? s->Driver->Driver : NULL;
+
+    Audio->state.AutoPlaySong = G->AutoPlay;
+    Audio->state.MuteRear = G->MuteRear;
+    Audio->state.Gain = G->BaseGain*G->Gain;
+
+    SDL_LockMutex(m->Lock);
+    m->Active = s;
+    s->LastUse = ++m->UseCount;
+    SDL_UnlockMutex(m->Lock);
+
+    DriverPublishSnapshot();
+    SDL_UnlockAudioDevice(Audio->dev);
+
+    // waits for the writer thread to finish the file
+    QP_AudioWavFinish(oldlog);
+
+    gamemgr_prune(m);
+    return 0;
+}
@@ -0,0 +1,65 @@
+/*
+    Game manager
+
+    Keeps recently used games loaded, with their sound drivers initialized,
+    so that switching between them doesn't need a reload. The audio device
+    stays open between games. Games can be preloaded on a background thread.
+*/
+#ifndef GAMEMGR_H_INCLUDED
+#define GAMEMGR_H_INCLUDED
+
+#include <stddef.h>
+
+#include "SDL2/SDL_thread.h"
+
+#include "loader.h"
+
+#define GAMEMGR_MAX_SLOTS 32
+
+enum {
+    GAMEMGR_EMPTY = 0,
+    GAMEMGR_LOADING,
+    GAMEMGR_LOADED,
+    GAMEMGR_FAILED,
+};
+
+typedef struct {
+    int State;
+    char Name[256];
+    QP_Game *Game;
+    struct QP_DriverInterface *Driver;
+    int Initialized; // driver IInit has been called
+    size_t Size; // approximate memory usage
+    uint32_t LastUse;
+    char Error[1024];
+} QP_GameSlot;
+
+typedef struct {
+    QP_Game *Config; // global configuration, copied to each game
+    size_t MemoryLimit; // memory for inactive games
+
+    QP_GameSlot Slot[GAMEMGR_MAX_SLOTS];
+    QP_GameSlot *Active;
+    uint32_t UseCount;
+    int HalfGain; // set if the audio device had to fall back to 2 channels
+
+    SDL_mutex *Lock;
+    SDL_cond *Cond;
+    SDL_Thread *Thread;
+    QP_GameSlot *Pending; // next slot for the preload thread
+    int Quit;
+} QP_GameManager;
+
+int  QP_GameManagerInit(QP_GameManager *m,QP_Game *config,size_t limit);
+// Closes the audio device and unloads all games.
+void QP_GameManagerDeinit(QP_GameManager *m);
+
+// Load a game in the background, if it isn't already loaded.
+void QP_GameManagerPreload(QP_GameManager *m,const char *name);
+
+// Make a game the current one. The game is loaded if needed, then the
+// globals (Game, DriverInterface) are switched while the audio device is
+// locked, so that there is no gap in the audio output.
+int  QP_GameManagerActivate(QP_GameManager *m,const char *name);
+
+#endif // GAMEMGR_H_INCLUDED
@@ -12,14 +12,55 @@
 #include "../qp.h"
 #include "ini.h"
 #include "audit.h"
+#include "zip.h"
+
+// the last opened zip file is kept open, since most sets have several roms.
+static int audit_zip_find(zipfile_t* zip,char* zipname,char* filename,char* name)
+{
+    if(strcmp(zipname,filename))
+    {
+        if(zip->file)
+            zip_close(zip);
+        strcpy(zipname,filename);
+        zip_open(zip,filename);
+    }
+    return zip->file && zip_find(zip,name);
+}
+
+static int audit_file(char* filename)
+{
+    FILE* file = fopen(filename,"rb");
+    if(file)
+        fclose(file);
+    return file != NULL;
+}
+
+// check <path>/<name>, <path>.zip, then the same in the parent set.
+static int audit_rom(struct QP_AuditRom* rom,char* parent,zipfile_t* zip,char* zipname)
+{
+    char filename[128];
+    char* base = rom->PathType == AUDIT_PATH_WAVE ? QP_WavePath : QP_DataPath;
+
+    if(audit_file(rom->Path) || audit_zip_find(zip,zipname,rom->Zip,rom->Name))
+        return 1;
+    if(!*parent)
+        return 0;
+    snprintf(filename,127,"%s/%s/%s",base,parent,rom->Name);
+    if(audit_file(filename))
+        return 1;
+    snprintf(filename,127,"%s/%s.zip",base,parent);
+    return audit_zip_find(zip,zipname,filename,rom->Name);
+}
 
 int AuditRoms(void* data)
 {
     QP_Audit* audit = data;
     audit->AuditFlag = 1;
 
-    FILE* file;
     struct QP_AuditRom* rom;
+    zipfile_t zip;
+    char zipname[128] = "";
+    zip.file = NULL;
 
     audit->OkCount = audit->BadCount = audit->CheckCount = 0;
     int okflag;
@@ -31,18 +72,9 @@ int AuditRoms(void* data)
         for(j=0;j<audit->Entry[i].RomCount;j++)
         {
             rom = &audit->Entry[i].Rom[j];
-            file = NULL;
-            file = fopen(rom->Path,"rb");
-            if(file)
-            {
-                rom->Ok = 1;
-                fclose(file);
-            }
-            else
-            {
-                rom->Ok = 0;
+            rom->Ok = audit_rom(rom,audit->Entry[i].Parent,&zip,zipname);
+            if(!rom->Ok)
                 okflag = 0;
-            }
         }
         if(okflag)
         {
@@ -55,20 +87,26 @@ int AuditRoms(void* data)
         }
         audit->CheckCount++;
     }
+    if(zip.file)
+        zip_close(&zip);
     audit->AuditFlag = 0;
     return 0;
 }
 
 void WriteRomEntry(struct QP_AuditRom *rom,int PathType,char* Path1,char* Path2)
 {
+    rom->PathType = PathType;
+    snprintf(rom->Name,127,"%s",Path2);
     switch(PathType)
     {
     default:
     case AUDIT_PATH_DATA:
         snprintf(rom->Path,127,"%s/%s/%s",QP_DataPath,Path1,Path2);
+        snprintf(rom->Zip,127,"%s/%s.zip",QP_DataPath,Path1);
         break;
     case AUDIT_PATH_WAVE:
         snprintf(rom->Path,127,"%s/%s/%s",QP_WavePath,Path1,Path2);
+        snprintf(rom->Zip,127,"%s/%s.zip",QP_WavePath,Path1);
         break;
     }
     /*
@@ -100,6 +138,7 @@ void WriteAuditEntry(QP_AuditEntry *entry, char *name)
     strcpy(entry->Name,name);
     strcpy(rompath,name);
     strcpy(entry->DisplayName,"");
+    strcpy(entry->Parent,"");
     entry->HasMeta=0;
     entry->HasPlaylist=0;
     entry->RomCount=0;
@@ -117,6 +156,8 @@ void WriteAuditEntry(QP_AuditEntry *entry, char *name)
                     strcpy(entry->DisplayName,initest.value);
                 else if(!strcmp(initest.key,"path"))
                     strcpy(rompath,initest.value);
+                else if(!strcmp(initest.key,"parent"))
+                    snprintf(entry->Parent,127,"%s",initest.value);
                 else if(!strcmp(initest.key,"filename"))
                 {
                     if(entry->RomCount < AUDIT_MAX_ROMS)
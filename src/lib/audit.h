@@ -13,12 +13,16 @@ enum {
 };
 struct QP_AuditRom{
     char Path[128];
+    char Zip[128];  // <base>/<path>.zip
+    char Name[128];
+    int PathType;
     int Ok;
 };
 
 struct QP_AuditEntry{
     char Name[256];
     char DisplayName[256];
+    char Parent[128];
     int HasPlaylist;
     int HasMeta;
     int RomCount;
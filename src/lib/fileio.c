@@ -9,7 +9,7 @@
 
 #include "fileio.h"
 
-    char fileio_error[100];
+FILEIO_TLS char fileio_error[100];
 
 int load_file(char* filename, uint8_t** dataptr, uint32_t* filesize)
 {
@@ -41,12 +41,42 @@ int load_file(char* filename, uint8_t** dataptr, uint32_t* filesize)
     return 0;
 }
 
+// Swap each pair of bytes. An odd last byte is left alone. Written with
+// whole words so that the compiler can vectorize it.
+void byteswap16(uint8_t* data, uint32_t size)
+{
+    uint64_t w;
+    uint8_t temp;
+    uint32_t cnt;
+    for(cnt=0;cnt+8<=size;cnt+=8)
+    {
+        memcpy(&w,data+cnt,8);
+        w = ((w>>8)&0x00ff00ff00ff00ffULL) | ((w&0x00ff00ff00ff00ffULL)<<8);
+        memcpy(data+cnt,&w,8);
+    }
+    for(;cnt+2<=size;cnt+=2)
+    {
+        temp = data[cnt];
+        data[cnt] = data[cnt+1];
+        data[cnt+1] = temp;
+    }
+}
+
 // This does not allocate new resources
 int read_file(char* filename, uint8_t* dataptr, uint32_t load_size, uint32_t load_offset, int byteswap, uint32_t* fsize)
 {
-    uint32_t cnt;
+    return read_file_stride(filename,dataptr,load_size,load_offset,byteswap,1,fsize);
+}
+
+// Strided reads go through a small buffer, so interleaved roms are written
+// to their final position without a copy of the whole file.
+#define READ_CHUNK 0x10000
+
+int read_file_stride(char* filename, uint8_t* dataptr, uint32_t load_size, uint32_t load_offset, int byteswap, int stride, uint32_t* fsize)
+{
+    uint32_t cnt, i, len;
     uint32_t filesize;
-    uint8_t temp;
+    uint8_t chunk[READ_CHUNK];
 
     FILE* sourcefile;
     sourcefile = fopen(filename,"rb");
@@ -84,13 +114,31 @@ int read_file(char* filename, uint8_t* dataptr, uint32_t load_size, uint32_t loa
         load_size = filesize - load_offset;
     }
 
-    rewind(sourcefile);
+    fseek(sourcefile,load_offset,SEEK_SET);
 
-    if(load_offset)
-        fseek(sourcefile,load_offset,SEEK_SET);
+    for(cnt=0;cnt<load_size;cnt+=len)
+    {
+        len = load_size-cnt;
+        if(stride == 1)
+        {
+            // read directly to the destination
+            if(fread(dataptr+cnt,1,len,sourcefile) != len)
+                break;
+            if(byteswap)
+                byteswap16(dataptr+cnt,len);
+            continue;
+        }
+        if(len > READ_CHUNK)
+            len = READ_CHUNK;
+        if(fread(chunk,1,len,sourcefile) != len)
+            break;
+        if(byteswap)
+            byteswap16(chunk,len);
+        for(i=0;i<len;i++)
+            dataptr[(cnt+i)*stride] = chunk[i];
+    }
 
-    int32_t res = fread(dataptr,1,load_size,sourcefile);
-    if(res != load_size)
+    if(cnt < load_size)
     {
         strcpy(fileio_error,"Read error");
         fputs(fileio_error,stderr);
@@ -98,16 +146,6 @@ int read_file(char* filename, uint8_t* dataptr, uint32_t load_size, uint32_t loa
         return -1;
     }
 
-    if(byteswap)
-    {
-        for(cnt=0;cnt<load_size;cnt+=2)
-        {
-            temp = dataptr[cnt];
-            dataptr[cnt] = dataptr[cnt+1];
-            dataptr[cnt+1] = temp;
-        }
-    }
-
     if(fsize)
         *fsize = load_size;
 
@@ -143,7 +181,7 @@ int write_file(char* filename, uint8_t* dataptr, uint32_t datasize)
 
 char* my_strerror(char* filename)
 {
-    static char msg[100];
+    static FILEIO_TLS char msg[100];
     snprintf(msg,100,"\n'%s': %s",filename,fileio_error);
     return msg;
 }
@@ -4,10 +4,20 @@
 #ifndef FILEIO_H_INCLUDED
 #define FILEIO_H_INCLUDED
 
-    char fileio_error[100];
+// error messages are kept per thread, so that several games can be loaded at once.
+#ifdef _MSC_VER
+#define FILEIO_TLS __declspec(thread)
+#else
+#define FILEIO_TLS __thread
+#endif
+
+extern FILEIO_TLS char fileio_error[100];
 
 int load_file(char* filename, uint8_t** dataptr, uint32_t* filesize);
 int read_file(char* filename, uint8_t* dataptr, uint32_t load_size, uint32_t load_offset, int byteswap, uint32_t* fsize);
+// Same as read_file, but byte n is written to dataptr[n*stride].
+int read_file_stride(char* filename, uint8_t* dataptr, uint32_t load_size, uint32_t load_offset, int byteswap, int stride, uint32_t* fsize);
+void byteswap16(uint8_t* data, uint32_t size);
 int write_file(char* filename, uint8_t* dataptr, uint32_t datasize);
 
 char* my_strerror(char* filename);
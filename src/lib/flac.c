@@ -0,0 +1,861 @@
+/*
+    FLAC encoding
+
+    Each channel is encoded with the best of the fixed predictors and a few
+    LPC orders, with partitioned Rice coding of the residual. Stereo files
+    also try the left/side, right/side and mid/side channel assignments.
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <strings.h>
+#include <math.h>
+
+#include "flac.h"
+#include "thread.h"
+
+#define FLAC_BLOCK 4096 // samples per frame
+#define FLAC_BATCH 32 // frames encoded in parallel
+#define FLAC_THREADS 4 // default number of encoding threads
+#define FLAC_MAX_CHANNELS 8
+#define FLAC_MAX_LPC 12
+#define FLAC_PRECISION 14 // LPC coefficient precision
+#define FLAC_MAX_PORDER 8 // Rice partition order
+#define FLAC_SEEK_MAX 1024 // seek table size
+#define FLAC_SEEK_INTERVAL 10 // seconds between seek points
+#define FLAC_TAG_MAX 16
+#define FLAC_TAG_SPACE 8192 // space for the comments and padding blocks
+#define FLAC_HEADER_SIZE (4 + 4+34 + 4+FLAC_SEEK_MAX*18 + FLAC_TAG_SPACE)
+
+enum {
+    SUB_CONSTANT = 0,
+    SUB_VERBATIM,
+    SUB_FIXED,
+    SUB_LPC,
+};
+
+typedef struct {
+    uint8_t* data;
+    uint32_t pos;
+    uint64_t acc;
+    int bits; // bits in acc not yet written
+} flac_bits_t;
+
+typedef struct {
+    int type;
+    int order;
+    int bps;
+    int precision;
+    int shift;
+    int32_t coef[FLAC_MAX_LPC];
+    int porder;
+    uint8_t param[1<<FLAC_MAX_PORDER];
+    uint64_t bits;
+    const int32_t* signal;
+    int32_t* residual;
+    int32_t* temp; // residual of the candidate being tested
+    int32_t buf[2][FLAC_BLOCK];
+} flac_subframe_t;
+
+typedef struct {
+    uint64_t sample;
+    uint64_t offset;
+} flac_seek_t;
+
+struct flacfile_t {
+    FILE* file;
+    int channels;
+    uint32_t rate;
+    int bps;
+    int threads;
+    int error;
+
+    char tag[FLAC_TAG_MAX][512];
+    int tag_count;
+
+    // samples waiting to be encoded
+    int32_t* batch;
+    int batch_frames;
+
+    // encoded frames
+    uint8_t* out[FLAC_BATCH];
+    uint32_t out_size[FLAC_BATCH];
+    uint32_t frame_max;
+
+    uint32_t frame; // next frame number
+    uint64_t samples;
+    uint64_t offset; // bytes since the first frame
+    uint32_t min_frame, max_frame; // frame size in bytes
+
+    flac_seek_t* seek;
+    int seek_count;
+    int seek_alloc;
+    uint64_t next_seek;
+};
+
+// CRC-8 (poly 0x07) and CRC-16 (poly 0x8005) lookup tables
+static const uint8_t crc8_table[256] = {
+    0x00,0x07,0x0e,0x09,0x1c,0x1b,0x12,0x15,0x38,0x3f,0x36,0x31,0x24,0x23,0x2a,0x2d,
+    0x70,0x77,0x7e,0x79,0x6c,0x6b,0x62,0x65,0x48,0x4f,0x46,0x41,0x54,0x53,0x5a,0x5d,
+    0xe0,0xe7,0xee,0xe9,0xfc,0xfb,0xf2,0xf5,0xd8,0xdf,0xd6,0xd1,0xc4,0xc3,0xca,0xcd,
+    0x90,0x97,0x9e,0x99,0x8c,0x8b,0x82,0x85,0xa8,0xaf,0xa6,0xa1,0xb4,0xb3,0xba,0xbd,
+    0xc7,0xc0,0xc9,0xce,0xdb,0xdc,0xd5,0xd2,0xff,0xf8,0xf1,0xf6,0xe3,0xe4,0xed,0xea,
+    0xb7,0xb0,0xb9,0xbe,0xab,0xac,0xa5,0xa2,0x8f,0x88,0x81,0x86,0x93,0x94,0x9d,0x9a,
+    0x27,0x20,0x29,0x2e,0x3b,0x3c,0x35,0x32,0x1f,0x18,0x11,0x16,0x03,0x04,0x0d,0x0a,
+    0x57,0x50,0x59,0x5e,0x4b,0x4c,0x45,0x42,0x6f,0x68,0x61,0x66,0x73,0x74,0x7d,0x7a,
+    0x89,0x8e,0x87,0x80,0x95,0x92,0x9b,0x9c,0xb1,0xb6,0xbf,0xb8,0xad,0xaa,0xa3,0xa4,
+    0xf9,0xfe,0xf7,0xf0,0xe5,0xe2,0xeb,0xec,0xc1,0xc6,0xcf,0xc8,0xdd,0xda,0xd3,0xd4,
+    0x69,0x6e,0x67,0x60,0x75,0x72,0x7b,0x7c,0x51,0x56,0x5f,0x58,0x4d,0x4a,0x43,0x44,
+    0x19,0x1e,0x17,0x10,0x05,0x02,0x0b,0x0c,0x21,0x26,0x2f,0x28,0x3d,0x3a,0x33,0x34,
+    0x4e,0x49,0x40,0x47,0x52,0x55,0x5c,0x5b,0x76,0x71,0x78,0x7f,0x6a,0x6d,0x64,0x63,
+    0x3e,0x39,0x30,0x37,0x22,0x25,0x2c,0x2b,0x06,0x01,0x08,0x0f,0x1a,0x1d,0x14,0x13,
+    0xae,0xa9,0xa0,0xa7,0xb2,0xb5,0xbc,0xbb,0x96,0x91,0x98,0x9f,0x8a,0x8d,0x84,0x83,
+    0xde,0xd9,0xd0,0xd7,0xc2,0xc5,0xcc,0xcb,0xe6,0xe1,0xe8,0xef,0xfa,0xfd,0xf4,0xf3
+};
+static const uint16_t crc16_table[256] = {
+    0x0000,0x8005,0x800f,0x000a,0x801b,0x001e,0x0014,0x8011,
+    0x8033,0x0036,0x003c,0x8039,0x0028,0x802d,0x8027,0x0022,
+    0x8063,0x0066,0x006c,0x8069,0x0078,0x807d,0x8077,0x0072,
+    0x0050,0x8055,0x805f,0x005a,0x804b,0x004e,0x0044,0x8041,
+    0x80c3,0x00c6,0x00cc,0x80c9,0x00d8,0x80dd,0x80d7,0x00d2,
+    0x00f0,0x80f5,0x80ff,0x00fa,0x80eb,0x00ee,0x00e4,0x80e1,
+    0x00a0,0x80a5,0x80af,0x00aa,0x80bb,0x00be,0x00b4,0x80b1,
+    0x8093,0x0096,0x009c,0x8099,0x0088,0x808d,0x8087,0x0082,
+    0x8183,0x0186,0x018c,0x8189,0x0198,0x819d,0x8197,0x0192,
+    0x01b0,0x81b5,0x81bf,0x01ba,0x81ab,0x01ae,0x01a4,0x81a1,
+    0x01e0,0x81e5,0x81ef,0x01ea,0x81fb,0x01fe,0x01f4,0x81f1,
+    0x81d3,0x01d6,0x01dc,0x81d9,0x01c8,0x81cd,0x81c7,0x01c2,
+    0x0140,0x8145,0x814f,0x014a,0x815b,0x015e,0x0154,0x8151,
+    0x8173,0x0176,0x017c,0x8179,0x0168,0x816d,0x8167,0x0162,
+    0x8123,0x0126,0x012c,0x8129,0x0138,0x813d,0x8137,0x0132,
+    0x0110,0x8115,0x811f,0x011a,0x810b,0x010e,0x0104,0x8101,
+    0x8303,0x0306,0x030c,0x8309,0x0318,0x831d,0x8317,0x0312,
+    0x0330,0x8335,0x833f,0x033a,0x832b,0x032e,0x0324,0x8321,
+    0x0360,0x8365,0x836f,0x036a,0x837b,0x037e,0x0374,0x8371,
+    0x8353,0x0356,0x035c,0x8359,0x0348,0x834d,0x8347,0x0342,
+    0x03c0,0x83c5,0x83cf,0x03ca,0x83db,0x03de,0x03d4,0x83d1,
+    0x83f3,0x03f6,0x03fc,0x83f9,0x03e8,0x83ed,0x83e7,0x03e2,
+    0x83a3,0x03a6,0x03ac,0x83a9,0x03b8,0x83bd,0x83b7,0x03b2,
+    0x0390,0x8395,0x839f,0x039a,0x838b,0x038e,0x0384,0x8381,
+    0x0280,0x8285,0x828f,0x028a,0x829b,0x029e,0x0294,0x8291,
+    0x82b3,0x02b6,0x02bc,0x82b9,0x02a8,0x82ad,0x82a7,0x02a2,
+    0x82e3,0x02e6,0x02ec,0x82e9,0x02f8,0x82fd,0x82f7,0x02f2,
+    0x02d0,0x82d5,0x82df,0x02da,0x82cb,0x02ce,0x02c4,0x82c1,
+    0x8243,0x0246,0x024c,0x8249,0x0258,0x825d,0x8257,0x0252,
+    0x0270,0x8275,0x827f,0x027a,0x826b,0x026e,0x0264,0x8261,
+    0x0220,0x8225,0x822f,0x022a,0x823b,0x023e,0x0234,0x8231,
+    0x8213,0x0216,0x021c,0x8219,0x0208,0x820d,0x8207,0x0202
+};
+
+static uint8_t crc8(const uint8_t* d,uint32_t len)
+{
+    uint8_t crc = 0;
+    while(len--)
+        crc = crc8_table[crc ^ *d++];
+    return crc;
+}
+
+static uint16_t crc16(const uint8_t* d,uint32_t len)
+{
+    uint16_t crc = 0;
+    while(len--)
+        crc = (crc<<8) ^ crc16_table[(crc>>8) ^ *d++];
+    return crc;
+}
+
+static void bits_put(flac_bits_t* b,uint32_t v,int n)
+{
+    if(!n)
+        return;
+    if(n < 32)
+        v &= (1U<<n)-1;
+    b->acc = (b->acc<<n) | v;
+    b->bits += n;
+    while(b->bits >= 8)
+    {
+        b->bits -= 8;
+        b->data[b->pos++] = b->acc >> b->bits;
+    }
+}
+
+static void bits_rice(flac_bits_t* b,int32_t v,int k)
+{
+    uint32_t u = ((uint32_t)v<<1) ^ (uint32_t)(v>>31);
+    uint32_t q = u>>k;
+    while(q >= 32)
+    {
+        bits_put(b,0,32);
+        q -= 32;
+    }
+    bits_put(b,1,q+1);
+    bits_put(b,u,k);
+}
+
+static void bits_align(flac_bits_t* b)
+{
+    bits_put(b,0,(8-b->bits)&7);
+}
+
+// Choose the partition order and Rice parameters for a residual.
+// Returns the exact size in bits.
+static uint64_t rice_plan(const int32_t* r,int n,int order,int* porder_out,uint8_t* param)
+{
+    uint64_t sum[1<<FLAC_MAX_PORDER];
+    uint64_t best_bits = ~0ULL;
+    int max_porder = 0, porder, p, i, k;
+
+    while(max_porder < FLAC_MAX_PORDER && !(n & ((2<<max_porder)-1)) && (n>>(max_porder+1)) > order)
+        max_porder++;
+
+    // sums of the zigzag coded residual for each partition at max_porder
+    for(p=0;p<1<<max_porder;p++)
+    {
+        int start = p ? p*(n>>max_porder) : order;
+        int end = (p+1)*(n>>max_porder);
+        sum[p] = 0;
+        for(i=start;i<end;i++)
+            sum[p] += ((uint32_t)r[i]<<1) ^ (uint32_t)(r[i]>>31);
+    }
+
+    for(porder=max_porder;porder>=0;porder--)
+    {
+        uint64_t bits = 0;
+        uint8_t kp[1<<FLAC_MAX_PORDER];
+        if(porder < max_porder)
+            for(p=0;p<1<<porder;p++)
+                sum[p] = sum[2*p] + sum[2*p+1];
+
+        for(p=0;p<1<<porder;p++)
+        {
+            uint64_t cnt = (n>>porder) - (p ? 0 : order);
+            uint64_t best = ~0ULL, est;
+            for(k=0;k<=30;k++)
+            {
+                est = cnt*(k+1) + (sum[p]>>k);
+                if(est < best)
+                {
+                    best = est;
+                    kp[p] = k;
+                }
+            }
+            bits += best;
+        }
+        if(bits < best_bits)
+        {
+            best_bits = bits;
+            *porder_out = porder;
+            memcpy(param,kp,1<<porder);
+        }
+    }
+
+    // exact size
+    porder = *porder_out;
+    best_bits = 6;
+    for(p=0;p<1<<porder;p++)
+        if(param[p] > 14)
+            break;
+    k = p < 1<<porder ? 5 : 4;
+    for(p=0;p<1<<porder;p++)
+    {
+        int start = p ? p*(n>>porder) : order;
+        int end = (p+1)*(n>>porder);
+        best_bits += k + (uint64_t)(end-start)*(param[p]+1);
+        for(i=start;i<end;i++)
+            best_bits += (((uint32_t)r[i]<<1) ^ (uint32_t)(r[i]>>31)) >> param[p];
+    }
+    return best_bits;
+}
+
+// Keep the candidate in s->temp if it is smaller.
+static void subframe_try(flac_subframe_t* s,int n,int type,int order,int32_t* coef,int precision,int shift)
+{
+    int porder;
+    uint8_t param[1<<FLAC_MAX_PORDER];
+    uint64_t bits = 8 + (uint64_t)order*s->bps + rice_plan(s->temp,n,order,&porder,param);
+    if(type == SUB_LPC)
+        bits += 4 + 5 + order*precision;
+    if(bits < s->bits)
+    {
+        int32_t* t = s->residual;
+        s->residual = s->temp;
+        s->temp = t;
+        s->bits = bits;
+        s->type = type;
+        s->order = order;
+        s->porder = porder;
+        memcpy(s->param,param,1<<porder);
+        if(type == SUB_LPC)
+        {
+            memcpy(s->coef,coef,order*sizeof(int32_t));
+            s->precision = precision;
+            s->shift = shift;
+        }
+    }
+}
+
+static void lpc_levinson(const double* autoc,int max_order,double lpc[][FLAC_MAX_LPC])
+{
+    double a[FLAC_MAX_LPC];
+    double err = autoc[0];
+    int i,j;
+    for(i=0;i<max_order;i++)
+    {
+        double r = -autoc[i+1];
+        for(j=0;j<i;j++)
+            r -= a[j]*autoc[i-j];
+        r /= err;
+        a[i] = r;
+        for(j=0;j<(i>>1);j++)
+        {
+            double t = a[j];
+            a[j] += r*a[i-1-j];
+            a[i-1-j] += r*t;
+        }
+        if(i & 1)
+            a[j] += a[j]*r;
+        err *= 1.0 - r*r;
+        for(j=0;j<=i;j++)
+            lpc[i][j] = -a[j];
+        if(err <= 0.0)
+            break;
+    }
+    for(i++;i<max_order;i++)
+        memset(lpc[i],0,sizeof(lpc[i]));
+}
+
+// Returns -1 if the coefficients can't be quantized.
+static int lpc_quantize(const double* lpc,int order,int precision,int32_t* q,int* shift)
+{
+    double cmax = 0, err = 0;
+    int qmax = (1<<(precision-1))-1;
+    int i, log2cmax;
+    for(i=0;i<order;i++)
+        if(fabs(lpc[i]) > cmax)
+            cmax = fabs(lpc[i]);
+    if(cmax <= 0)
+        return -1;
+    frexp(cmax,&log2cmax);
+    log2cmax--;
+    *shift = precision - log2cmax - 2;
+    if(*shift > 15)
+        *shift = 15;
+    if(*shift < 0)
+        return -1;
+    for(i=0;i<order;i++)
+    {
+        long v;
+        err += lpc[i] * (1<<*shift);
+        v = lround(err);
+        v = v > qmax ? qmax : v < -qmax-1 ? -qmax-1 : v;
+        err -= v;
+        q[i] = v;
+    }
+    return 0;
+}
+
+static void subframe_plan(flac_subframe_t* s,const int32_t* x,int n,int bps)
+{
+    static const int lpc_orders[] = {2,4,8,FLAC_MAX_LPC};
+    double autoc[FLAC_MAX_LPC+1];
+    double lpc[FLAC_MAX_LPC][FLAC_MAX_LPC];
+    int32_t coef[FLAC_MAX_LPC];
+    int i,j,order,shift;
+
+    s->signal = x;
+    s->bps = bps;
+    s->residual = s->buf[0];
+    s->temp = s->buf[1];
+
+    for(i=1;i<n;i++)
+        if(x[i] != x[0])
+            break;
+    if(i == n)
+    {
+        s->type = SUB_CONSTANT;
+        s->bits = 8 + bps;
+        return;
+    }
+    s->type = SUB_VERBATIM;
+    s->bits = 8 + (uint64_t)n*bps;
+
+    for(order=0;order<=4 && order<n;order++)
+    {
+        int32_t* r = s->temp;
+        for(i=order;i<n;i++)
+        {
+            switch(order)
+            {
+            case 0: r[i] = x[i]; break;
+            case 1: r[i] = x[i] - x[i-1]; break;
+            case 2: r[i] = x[i] - 2*x[i-1] + x[i-2]; break;
+            case 3: r[i] = x[i] - 3*(x[i-1]-x[i-2]) - x[i-3]; break;
+            case 4: r[i] = x[i] - 4*(x[i-1]+x[i-3]) + 6*x[i-2] + x[i-4]; break;
+            }
+        }
+        subframe_try(s,n,SUB_FIXED,order,NULL,0,0);
+    }
+
+    if(n <= FLAC_MAX_LPC*2)
+        return;
+
+    // autocorrelation with a Welch window
+    {
+        double w[FLAC_BLOCK];
+        double c = (n-1)/2.0;
+        for(i=0;i<n;i++)
+        {
+            double t = (i-c)/(c+1);
+            w[i] = x[i]*(1.0-t*t);
+        }
+        for(j=0;j<=FLAC_MAX_LPC;j++)
+        {
+            double a = 0;
+            for(i=j;i<n;i++)
+                a += w[i]*w[i-j];
+            autoc[j] = a;
+        }
+    }
+    if(autoc[0] <= 0)
+        return;
+    lpc_levinson(autoc,FLAC_MAX_LPC,lpc);
+
+    for(j=0;j<(int)(sizeof(lpc_orders)/sizeof(int));j++)
+    {
+        int32_t* r = s->temp;
+        order = lpc_orders[j];
+        if(lpc_quantize(lpc[order-1],order,FLAC_PRECISION,coef,&shift))
+            continue;
+        for(i=order;i<n;i++)
+        {
+            int64_t sum = 0, v;
+            int k;
+            for(k=0;k<order;k++)
+                sum += (int64_t)coef[k]*x[i-k-1];
+            v = x[i] - (sum>>shift);
+            if(v > INT32_MAX || v < INT32_MIN)
+                break;
+            r[i] = v;
+        }
+        if(i == n)
+            subframe_try(s,n,SUB_LPC,order,coef,FLAC_PRECISION,shift);
+    }
+}
+
+static void subframe_write(flac_subframe_t* s,flac_bits_t* b,int n)
+{
+    const int32_t* x = s->signal;
+    int i,p;
+
+    switch(s->type)
+    {
+    case SUB_CONSTANT:
+        bits_put(b,0x00,8);
+        bits_put(b,x[0],s->bps);
+        return;
+    case SUB_VERBATIM:
+        bits_put(b,0x02,8);
+        for(i=0;i<n;i++)
+            bits_put(b,x[i],s->bps);
+        return;
+    case SUB_FIXED:
+        bits_put(b,(0x08|s->order)<<1,8);
+        for(i=0;i<s->order;i++)
+            bits_put(b,x[i],s->bps);
+        break;
+    case SUB_LPC:
+        bits_put(b,(0x20|(s->order-1))<<1,8);
+        for(i=0;i<s->order;i++)
+            bits_put(b,x[i],s->bps);
+        bits_put(b,s->precision-1,4);
+        bits_put(b,s->shift,5);
+        for(i=0;i<s->order;i++)
+            bits_put(b,s->coef[i],s->precision);
+        break;
+    }
+
+    // residual
+    for(p=0;p<1<<s->porder;p++)
+        if(s->param[p] > 14)
+            break;
+    int wide = p < 1<<s->porder;
+    bits_put(b,wide,2);
+    bits_put(b,s->porder,4);
+    for(p=0;p<1<<s->porder;p++)
+    {
+        int start = p ? p*(n>>s->porder) : s->order;
+        int end = (p+1)*(n>>s->porder);
+        bits_put(b,s->param[p],wide ? 5 : 4);
+        for(i=start;i<end;i++)
+            bits_rice(b,s->residual[i],s->param[p]);
+    }
+}
+
+static int flac_rate_code(uint32_t rate)
+{
+    static const uint32_t rates[] = {0,88200,176400,192000,8000,16000,22050,24000,32000,44100,48000,96000};
+    int i;
+    for(i=1;i<12;i++)
+        if(rate == rates[i])
+            return i;
+    if(rate <= 255000 && rate%1000 == 0)
+        return 12;
+    if(rate <= 65535)
+        return 13;
+    if(rate <= 655350 && rate%10 == 0)
+        return 14;
+    return 0; // from stream info
+}
+
+// Encode frame i of the batch into f->out[i].
+static void flac_encode(void* arg,int index)
+{
+    flacfile_t* f = arg;
+    int ch = f->channels;
+    int n = f->batch_frames - index*FLAC_BLOCK;
+    const int32_t* in = f->batch + index*FLAC_BLOCK*ch;
+    uint32_t num = f->frame + index;
+    int i,c,assign,rate_code,bs_code;
+    flac_bits_t b = {f->out[index],0,0,0};
+    flac_subframe_t* s;
+    int32_t* x;
+    int sub[FLAC_MAX_CHANNELS];
+
+    if(n > FLAC_BLOCK)
+        n = FLAC_BLOCK;
+
+    // stereo also has side and mid channels
+    s = malloc((ch+2)*sizeof(*s));
+    x = malloc((ch+2)*FLAC_BLOCK*sizeof(int32_t));
+    if(!s || !x)
+    {
+        free(s);
+        free(x);
+        f->out_size[index] = 0;
+        return;
+    }
+
+    for(c=0;c<ch;c++)
+        for(i=0;i<n;i++)
+            x[c*FLAC_BLOCK+i] = in[i*ch+c];
+    for(c=0;c<ch;c++)
+        subframe_plan(&s[c],x+c*FLAC_BLOCK,n,f->bps);
+
+    assign = ch-1;
+    for(c=0;c<ch;c++)
+        sub[c] = c;
+    if(ch == 2)
+    {
+        int32_t* side = x+2*FLAC_BLOCK;
+        int32_t* mid = x+3*FLAC_BLOCK;
+        uint64_t bits[4];
+        for(i=0;i<n;i++)
+        {
+            side[i] = x[i] - x[FLAC_BLOCK+i];
+            mid[i] = (x[i] + x[FLAC_BLOCK+i])>>1;
+        }
+        subframe_plan(&s[2],side,n,f->bps+1);
+        subframe_plan(&s[3],mid,n,f->bps);
+        bits[0] = s[0].bits + s[1].bits;
+        bits[1] = s[0].bits + s[2].bits; // left/side
+        bits[2] = s[2].bits + s[1].bits; // right/side
+        bits[3] = s[3].bits + s[2].bits; // mid/side
+        for(c=1,i=0;c<4;c++)
+            if(bits[c] < bits[i])
+                i = c;
+        if(i)
+        {
+            static const int subs[4][2] = {{0,1},{0,2},{2,1},{3,2}};
+            assign = 7+i;
+            sub[0] = subs[i][0];
+            sub[1] = subs[i][1];
+        }
+    }
+
+    // frame header
+    rate_code = flac_rate_code(f->rate);
+    bs_code = 7;
+    for(i=0;i<8;i++)
+        if(n == 256<<i)
+            bs_code = 8+i;
+    bits_put(&b,0xfff8,16);
+    bits_put(&b,bs_code,4);
+    bits_put(&b,rate_code,4);
+    bits_put(&b,assign,4);
+    bits_put(&b,f->bps == 16 ? 4 : 6,3);
+    bits_put(&b,0,1);
+    if(num < 0x80)
+        bits_put(&b,num,8);
+    else
+    {
+        int len = num < 0x800 ? 2 : num < 0x10000 ? 3 : num < 0x200000 ? 4 : num < 0x4000000 ? 5 : 6;
+        bits_put(&b,(0xff00>>len) | (num>>(6*(len-1))),8);
+        for(i=len-2;i>=0;i--)
+            bits_put(&b,0x80|((num>>(6*i))&0x3f),8);
+    }
+    if(bs_code == 7)
+        bits_put(&b,n-1,16);
+    if(rate_code == 12)
+        bits_put(&b,f->rate/1000,8);
+    else if(rate_code == 13)
+        bits_put(&b,f->rate,16);
+    else if(rate_code == 14)
+        bits_put(&b,f->rate/10,16);
+    bits_put(&b,crc8(b.data,b.pos),8);
+
+    for(c=0;c<ch;c++)
+        subframe_write(&s[sub[c]],&b,n);
+    bits_align(&b);
+    bits_put(&b,crc16(b.data,b.pos),16);
+
+    f->out_size[index] = b.pos;
+    free(s);
+    free(x);
+}
+
+static uint8_t* put_le32(uint8_t* d,uint32_t v)
+{
+    d[0]=v; d[1]=v>>8; d[2]=v>>16; d[3]=v>>24;
+    return d+4;
+}
+
+// length prefixed string
+static uint8_t* put_string(uint8_t* d,const char* str)
+{
+    uint32_t len = strlen(str);
+    d = put_le32(d,len);
+    memcpy(d,str,len);
+    return d+len;
+}
+
+static void flac_metadata(flacfile_t* f,uint8_t* d)
+{
+    flac_bits_t b = {d,0,0,0};
+    int i, len, pad;
+    int count = f->seek_count < FLAC_SEEK_MAX ? f->seek_count : FLAC_SEEK_MAX;
+    static const char* vendor = "QuattroPlay";
+
+    memcpy(d,"fLaC",4);
+    b.pos = 4;
+
+    // stream info. The MD5 is not calculated (zero = unknown)
+    bits_put(&b,0x00,8);
+    bits_put(&b,34,24);
+    bits_put(&b,FLAC_BLOCK,16);
+    bits_put(&b,FLAC_BLOCK,16);
+    bits_put(&b,f->min_frame,24);
+    bits_put(&b,f->max_frame,24);
+    bits_put(&b,f->rate,20);
+    bits_put(&b,f->channels-1,3);
+    bits_put(&b,f->bps-1,5);
+    bits_put(&b,f->samples>>32,4);
+    bits_put(&b,f->samples,32);
+    for(i=0;i<4;i++)
+        bits_put(&b,0,32);
+
+    // seek table, evenly spaced points. unused points are placeholders
+    bits_put(&b,0x03,8);
+    bits_put(&b,FLAC_SEEK_MAX*18,24);
+    for(i=0;i<FLAC_SEEK_MAX;i++)
+    {
+        if(i < count)
+        {
+            flac_seek_t* s = &f->seek[(int64_t)i*f->seek_count/count];
+            bits_put(&b,s->sample>>32,32);
+            bits_put(&b,s->sample,32);
+            bits_put(&b,s->offset>>32,32);
+            bits_put(&b,s->offset,32);
+            bits_put(&b,FLAC_BLOCK,16);
+        }
+        else
+        {
+            bits_put(&b,0xffffffff,32);
+            bits_put(&b,0xffffffff,32);
+            bits_put(&b,0,32);
+            bits_put(&b,0,32);
+            bits_put(&b,0,16);
+        }
+    }
+
+    // vorbis comments, tags that don't fit are dropped
+    uint8_t* start = d+b.pos+4;
+    uint8_t* end = d+FLAC_HEADER_SIZE-4;
+    uint8_t* p = put_string(start,vendor);
+    uint8_t* count_pos = p;
+    uint32_t n = 0;
+    p += 4;
+    for(i=0;i<f->tag_count;i++)
+    {
+        if(p+4+strlen(f->tag[i]) > end)
+            continue;
+        p = put_string(p,f->tag[i]);
+        n++;
+    }
+    put_le32(count_pos,n);
+    len = p-start;
+    bits_put(&b,0x04,8);
+    bits_put(&b,len,24);
+    b.pos += len;
+
+    // padding
+    pad = FLAC_HEADER_SIZE - b.pos - 4;
+    bits_put(&b,0x81,8);
+    bits_put(&b,pad,24);
+    memset(d+b.pos,0,pad);
+}
+
+static void flac_flush(flacfile_t* f)
+{
+    int i, count = (f->batch_frames+FLAC_BLOCK-1)/FLAC_BLOCK;
+    if(!count)
+        return;
+
+    thread_for(count,f->threads,flac_encode,f);
+
+    for(i=0;i<count;i++)
+    {
+        uint32_t size = f->out_size[i];
+        if(!size)
+        {
+            f->error = 1;
+            continue;
+        }
+        if(f->samples >= f->next_seek)
+        {
+            if(f->seek_count == f->seek_alloc)
+            {
+                int alloc = f->seek_alloc ? f->seek_alloc*2 : 256;
+                flac_seek_t* seek = realloc(f->seek,alloc*sizeof(flac_seek_t));
+                if(seek)
+                {
+                    f->seek = seek;
+                    f->seek_alloc = alloc;
+                }
+            }
+            if(f->seek_count < f->seek_alloc)
+            {
+                f->seek[f->seek_count].sample = f->samples;
+                f->seek[f->seek_count].offset = f->offset;
+                f->seek_count++;
+            }
+            f->next_seek = f->samples + (uint64_t)f->rate*FLAC_SEEK_INTERVAL;
+        }
+        if(fwrite(f->out[i],1,size,f->file) != size)
+            f->error = 1;
+        if(!f->min_frame || size < f->min_frame)
+            f->min_frame = size;
+        if(size > f->max_frame)
+            f->max_frame = size;
+        f->offset += size;
+        f->samples += f->batch_frames - i*FLAC_BLOCK < FLAC_BLOCK ? f->batch_frames - i*FLAC_BLOCK : FLAC_BLOCK;
+    }
+    f->frame += count;
+    f->batch_frames = 0;
+}
+
+flacfile_t* flac_open(const char* filename,int channels,uint32_t rate,int bits,int threads)
+{
+    uint8_t* header;
+    int i;
+    flacfile_t* f;
+
+    if(channels < 1 || channels > FLAC_MAX_CHANNELS || (bits != 16 && bits != 24))
+        return NULL;
+    f = calloc(1,sizeof(*f));
+    if(!f)
+        return NULL;
+
+    f->channels = channels;
+    f->rate = rate;
+    f->bps = bits;
+    f->threads = threads ? threads : FLAC_THREADS;
+    // worst case is a verbatim frame, side channel has an extra bit
+    f->frame_max = 32 + (FLAC_BLOCK*(bits+1)/8 + 2)*channels;
+
+    f->batch = malloc(FLAC_BATCH*FLAC_BLOCK*channels*sizeof(int32_t));
+    header = malloc(FLAC_HEADER_SIZE);
+    if(!f->batch || !header)
+        goto fail;
+    for(i=0;i<FLAC_BATCH;i++)
+        if(!(f->out[i] = malloc(f->frame_max)))
+            goto fail;
+    f->file = fopen(filename,"wb");
+    if(!f->file)
+        goto fail;
+
+    // reserve space for the metadata
+    flac_metadata(f,header);
+    if(fwrite(header,1,FLAC_HEADER_SIZE,f->file) != FLAC_HEADER_SIZE)
+        goto fail;
+    free(header);
+    return f;
+
+fail:
+    if(f->file)
+        fclose(f->file);
+    for(i=0;i<FLAC_BATCH;i++)
+        free(f->out[i]);
+    free(header);
+    free(f->batch);
+    free(f);
+    return NULL;
+}
+
+void flac_tag(flacfile_t* f,const char* key,const char* value)
+{
+    int i, len = strlen(key);
+    for(i=0;i<f->tag_count;i++)
+        if(!strncasecmp(f->tag[i],key,len) && f->tag[i][len] == '=')
+            break;
+    if(i == FLAC_TAG_MAX)
+        return;
+    if(i == f->tag_count)
+        f->tag_count++;
+    snprintf(f->tag[i],sizeof(f->tag[i]),"%s=%s",key,value);
+}
+
+int flac_write(flacfile_t* f,const int32_t* samples,int frames)
+{
+    while(frames)
+    {
+        int n = FLAC_BATCH*FLAC_BLOCK - f->batch_frames;
+        if(n > frames)
+            n = frames;
+        memcpy(f->batch + f->batch_frames*f->channels,samples,n*f->channels*sizeof(int32_t));
+        f->batch_frames += n;
+        samples += n*f->channels;
+        frames -= n;
+        if(f->batch_frames == FLAC_BATCH*FLAC_BLOCK)
+            flac_flush(f);
+    }
+    return f->error ? -1 : 0;
+}
+
+int flac_close(flacfile_t* f)
+{
+    uint8_t* header;
+    int i, error;
+
+    flac_flush(f);
+    header = malloc(FLAC_HEADER_SIZE);
+    if(header)
+    {
+        flac_metadata(f,header);
+        fseek(f->file,0,SEEK_SET);
+        if(fwrite(header,1,FLAC_HEADER_SIZE,f->file) != FLAC_HEADER_SIZE)
+            f->error = 1;
+        free(header);
+    }
+    else
+        f->error = 1;
+    if(fclose(f->file))
+        f->error = 1;
+
+    error = f->error;
+    for(i=0;i<FLAC_BATCH;i++)
+        free(f->out[i]);
+    free(f->seek);
+    free(f->batch);
+    free(f);
+    return error ? -1 : 0;
+}
@@ -0,0 +1,27 @@
+/*
+    FLAC encoding
+
+    Frames are encoded in batches, spread over several threads. Metadata
+    (stream info, seek table and tags) is written when the file is closed,
+    into space reserved at the start of the file.
+*/
+#ifndef FLAC_H_INCLUDED
+#define FLAC_H_INCLUDED
+
+#include <stdint.h>
+
+typedef struct flacfile_t flacfile_t;
+
+// bits = 16 or 24. channels = 1 to 8. threads = encoding threads, 0 = default.
+// Returns NULL if the file can't be opened.
+flacfile_t* flac_open(const char* filename,int channels,uint32_t rate,int bits,int threads);
+// Set a Vorbis comment, replacing any previous value. Can be called any
+// time before flac_close.
+void flac_tag(flacfile_t* flac,const char* key,const char* value);
+// Write interleaved samples. Returns -1 on write error.
+int flac_write(flacfile_t* flac,const int32_t* samples,int frames);
+// Encode the remaining samples and write the metadata, then free flac.
+// Returns -1 if there was a write error.
+int flac_close(flacfile_t* flac);
+
+#endif // FLAC_H_INCLUDED
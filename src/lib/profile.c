@@ -0,0 +1,156 @@
+/*
+    Sound driver profiler
+*/
+#include "profile.h"
+
+#ifdef QP_PROFILE
+
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define PROFILE_MAX 512 // counters per group
+
+typedef struct {
+    uint64_t calls;
+    uint64_t time;
+} profile_counter_t;
+
+typedef struct {
+    const char* name;
+    int count;
+    const char* const* labels; // or NULL to use the format
+    const char* format; // printed with the index
+    int split; // print index/64 and index%64 instead
+} profile_group_t;
+
+static const char* const profile_q_stages[PROFILE_Q_STAGES] = {
+    "Q_WaveLinkUpdate",
+    "Q_VoiceEnvUpdate",
+    "Q_VoicePitchEnvUpdate",
+    "Q_VoicePortaUpdate",
+    "Q_VoiceLfoUpdate",
+    "Q_VoicePanUpdate",
+};
+
+static const char* const profile_s2x_stages[PROFILE_S2X_STAGES] = {
+    "S2X_PCMLinkUpdate",
+    "S2X_PCMUpdateReset",
+    "S2X_PCM envelope",
+    "S2X_PCMPanSlideUpdate",
+    "S2X_VoicePitchUpdate (PCM)",
+    "S2X_PCMPitchUpdate",
+    "S2X_PCM key on",
+    "S2X_FMUpdateGate",
+    "S2X_FMUpdateReset",
+    "S2X_FMUpdateLfo",
+    "S2X_FM pitch",
+    "S2X_WSGUpdate",
+};
+
+static const profile_group_t profile_group[PROFILE_GROUPS] = {
+    {"Quattro tracks",64,NULL,"track %d",0},
+    {"Quattro track commands",64,NULL,"cmd %02x",0},
+    {"Quattro voice updates",PROFILE_Q_STAGES,profile_q_stages,NULL,0},
+    {"System 2x tracks",64,NULL,"track %d",0},
+    {"System 2x track commands",PROFILE_MAX,NULL,"type %d cmd %02x",1},
+    {"System 2x voice updates",PROFILE_S2X_STAGES,profile_s2x_stages,NULL,0},
+};
+
+static profile_counter_t profile_counter[PROFILE_GROUPS][PROFILE_MAX];
+static int profile_used;
+
+#if !defined(__x86_64__) && !defined(__i386__)
+uint64_t profile_clock()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC,&ts);
+    return (uint64_t)ts.tv_sec*1000000000 + ts.tv_nsec;
+}
+#endif
+
+static void profile_exit()
+{
+    FILE* f = fopen("qp_profile.txt","w");
+    if(!f)
+        return;
+    profile_report(f);
+    fclose(f);
+}
+
+// The counters are shared by all players, the adds are atomic so that
+// players in several threads can be profiled together.
+void profile_add(int group,int index,uint64_t time)
+{
+    profile_counter_t* c;
+    if(index < 0 || index >= profile_group[group].count)
+        return;
+    if(!profile_used && !__atomic_exchange_n(&profile_used,1,__ATOMIC_RELAXED))
+        atexit(profile_exit);
+    c = &profile_counter[group][index];
+    __atomic_fetch_add(&c->calls,1,__ATOMIC_RELAXED);
+    __atomic_fetch_add(&c->time,time,__ATOMIC_RELAXED);
+}
+
+void profile_reset()
+{
+    memset(profile_counter,0,sizeof(profile_counter));
+}
+
+static const profile_counter_t* profile_sort_base;
+
+static int profile_compare(const void* a,const void* b)
+{
+    uint64_t ta = profile_sort_base[*(const int*)a].time;
+    uint64_t tb = profile_sort_base[*(const int*)b].time;
+    return ta < tb ? 1 : ta > tb ? -1 : 0;
+}
+
+void profile_report(FILE* f)
+{
+    int order[PROFILE_MAX];
+    char label[64];
+    int g,i,n;
+
+#if defined(__x86_64__) || defined(__i386__)
+    fprintf(f,"Sound driver profile (TSC cycles, inclusive)\n");
+#else
+    fprintf(f,"Sound driver profile (nanoseconds, inclusive)\n");
+#endif
+    for(g=0;g<PROFILE_GROUPS;g++)
+    {
+        const profile_group_t* pg = &profile_group[g];
+        const profile_counter_t* c = profile_counter[g];
+        uint64_t total = 0;
+
+        for(i=0,n=0;i<pg->count;i++)
+        {
+            if(!c[i].calls)
+                continue;
+            order[n++] = i;
+            total += c[i].time;
+        }
+        if(!n)
+            continue;
+        profile_sort_base = c;
+        qsort(order,n,sizeof(int),profile_compare);
+
+        fprintf(f,"\n%s\n",pg->name);
+        fprintf(f,"%-24s %12s %16s %12s %7s\n","","calls","time","per call","share");
+        for(i=0;i<n;i++)
+        {
+            const profile_counter_t* e = &c[order[i]];
+            if(pg->labels)
+                snprintf(label,sizeof(label),"%s",pg->labels[order[i]]);
+            else if(pg->split)
+                snprintf(label,sizeof(label),pg->format,order[i]/64,order[i]%64);
+            else
+                snprintf(label,sizeof(label),pg->format,order[i]);
+            fprintf(f,"%-24s %12llu %16llu %12.1f %6.1f%%\n",label,
+                    (unsigned long long)e->calls,(unsigned long long)e->time,
+                    (double)e->time/e->calls,total ? 100.0*e->time/total : 0.0);
+        }
+    }
+}
+
+#endif // QP_PROFILE
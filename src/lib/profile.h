@@ -0,0 +1,83 @@
+/*
+    Sound driver profiler
+
+    Counts calls and time spent per track, per track command opcode and per
+    voice update stage. The counters are global, so they add up over all
+    songs played until the program exits, when the report is written to
+    qp_profile.txt.
+
+    Build with -DQP_PROFILE to enable (PROFILE=1 in the Makefile), otherwise
+    the macros do nothing. Time is in TSC cycles on x86, otherwise in
+    nanoseconds. Times are inclusive, a track update includes its commands.
+*/
+#ifndef PROFILE_H_INCLUDED
+#define PROFILE_H_INCLUDED
+
+#include <stdio.h>
+#include <stdint.h>
+
+enum {
+    PROFILE_Q_TRACK = 0,    // per track
+    PROFILE_Q_TRACK_CMD,    // per opcode
+    PROFILE_Q_VOICE,        // per PROFILE_Q_* stage
+    PROFILE_S2X_TRACK,      // per track
+    PROFILE_S2X_TRACK_CMD,  // per driver type and opcode
+    PROFILE_S2X_VOICE,      // per PROFILE_S2X_* stage
+    PROFILE_GROUPS
+};
+
+// Quattro voice update stages
+enum {
+    PROFILE_Q_LINK = 0,
+    PROFILE_Q_ENV,
+    PROFILE_Q_PITCH_ENV,
+    PROFILE_Q_PORTA,
+    PROFILE_Q_LFO,
+    PROFILE_Q_PAN,
+    PROFILE_Q_STAGES
+};
+
+// System 2x voice update stages
+enum {
+    PROFILE_S2X_PCM_LINK = 0,
+    PROFILE_S2X_PCM_RESET,
+    PROFILE_S2X_PCM_ENV,
+    PROFILE_S2X_PCM_PAN_SLIDE,
+    PROFILE_S2X_PCM_PITCH,
+    PROFILE_S2X_PCM_PITCH_WRITE,
+    PROFILE_S2X_PCM_KEYON,
+    PROFILE_S2X_FM_GATE,
+    PROFILE_S2X_FM_RESET,
+    PROFILE_S2X_FM_LFO,
+    PROFILE_S2X_FM_PITCH,
+    PROFILE_S2X_WSG,
+    PROFILE_S2X_STAGES
+};
+
+#ifdef QP_PROFILE
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define profile_clock() __rdtsc()
+#else
+uint64_t profile_clock();
+#endif
+
+void profile_add(int group,int index,uint64_t time);
+void profile_reset();
+void profile_report(FILE* f);
+
+// Profile a statement.
+#define PROFILE(_group,_index,_stmt) do { \
+        uint64_t _pstart = profile_clock(); \
+        _stmt; \
+        profile_add(_group,_index,profile_clock()-_pstart); \
+    } while(0)
+
+#else
+
+#define PROFILE(_group,_index,_stmt) do { _stmt; } while(0)
+
+#endif // QP_PROFILE
+
+#endif // PROFILE_H_INCLUDED
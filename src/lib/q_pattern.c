@@ -71,31 +71,35 @@ static void q_generate(int TrackNo)
     static uint8_t repcount[Q_MAX_REPEAT_STACK], loopcount[Q_MAX_LOOP_STACK];
     static uint8_t transpose[Q_MAX_TRKCHN];
     int maxcommands = 50000;
+    uint32_t seq;
 
     P->len = 0;
     Q_Track* T = &Q->Track[TrackNo];
     if(~T->Flags & Q_TRACK_STATUS_BUSY)
         return;
 
-    // copy paramters
-    SDL_LockAudioDevice(Audio->dev);
-    memcpy(regs,Q->Register,sizeof(Q->Register));
-    memcpy(substack,T->SubStack,sizeof(T->SubStack));
-    memcpy(repstack,T->RepeatStack,sizeof(T->RepeatStack));
-    memcpy(loopstack,T->LoopStack,sizeof(T->LoopStack));
-    memcpy(repcount,T->RepeatCount,sizeof(T->RepeatCount));
-    memcpy(loopcount,T->LoopCount,sizeof(T->LoopCount));
-    subpos = T->SubStackPos;
-    reppos = T->RepeatStackPos;
-    looppos = T->LoopStackPos;
-    for(i=0;i<Q_MAX_TRKCHN;i++)
-        transpose[i] = T->Channel[i].Transpose;
-
-    setflags = Q->SetRegFlags;
-    lfsr = Q->LFSR1;
-    left = T->RestCount;
-    pos = T->Position;
-    SDL_UnlockAudioDevice(Audio->dev);
+    // copy paramters, again if a driver tick got in between
+    do
+    {
+        seq = DriverReadBegin();
+        memcpy(regs,Q->Register,sizeof(Q->Register));
+        memcpy(substack,T->SubStack,sizeof(T->SubStack));
+        memcpy(repstack,T->RepeatStack,sizeof(T->RepeatStack));
+        memcpy(loopstack,T->LoopStack,sizeof(T->LoopStack));
+        memcpy(repcount,T->RepeatCount,sizeof(T->RepeatCount));
+        memcpy(loopcount,T->LoopCount,sizeof(T->LoopCount));
+        subpos = T->SubStackPos;
+        reppos = T->RepeatStackPos;
+        looppos = T->LoopStackPos;
+        for(i=0;i<Q_MAX_TRKCHN;i++)
+            transpose[i] = T->Channel[i].Transpose;
+
+        setflags = Q->SetRegFlags;
+        lfsr = Q->LFSR1;
+        left = T->RestCount;
+        pos = T->Position;
+    }
+    while(DriverReadRetry(seq));
 
     // insert empty rows
     while(left--)
@@ -492,30 +496,34 @@ static void s2x_generate(int TrackNo)
     static uint8_t repcount[S2X_MAX_REPEAT_STACK], loopcount[S2X_MAX_LOOP_STACK];
     static uint8_t transpose[S2X_MAX_TRKCHN];
     int maxcommands = 50000;
+    uint32_t seq;
 
     P->len = 0;
     S2X_Track* T = &S->Track[TrackNo];
     if(~T->Flags & S2X_TRACK_STATUS_BUSY)
         return;
 
-    // copy paramters
-    SDL_LockAudioDevice(Audio->dev);
-    cjump = (S->CJump) ? 0x400 : T->Flags&0x400;
-    memcpy(substack,T->SubStack,sizeof(T->SubStack));
-    memcpy(repstack,T->RepeatStack,sizeof(T->RepeatStack));
-    memcpy(loopstack,T->LoopStack,sizeof(T->LoopStack));
-    memcpy(repcount,T->RepeatCount,sizeof(T->RepeatCount));
-    memcpy(loopcount,T->LoopCount,sizeof(T->LoopCount));
-    subpos = T->SubStackPos;
-    reppos = T->RepeatStackPos;
-    looppos = T->LoopStackPos;
-    for(i=0;i<S2X_MAX_TRKCHN;i++)
-        transpose[i] = T->Channel[i].Vars[S2X_CHN_TRS];
-
-    left = T->RestCount;
-    posbase = T->PositionBase;
-    pos = T->Position+posbase;
-    SDL_UnlockAudioDevice(Audio->dev);
+    // copy paramters, again if a driver tick got in between
+    do
+    {
+        seq = DriverReadBegin();
+        cjump = (S->CJump) ? 0x400 : T->Flags&0x400;
+        memcpy(substack,T->SubStack,sizeof(T->SubStack));
+        memcpy(repstack,T->RepeatStack,sizeof(T->RepeatStack));
+        memcpy(loopstack,T->LoopStack,sizeof(T->LoopStack));
+        memcpy(repcount,T->RepeatCount,sizeof(T->RepeatCount));
+        memcpy(loopcount,T->LoopCount,sizeof(T->LoopCount));
+        subpos = T->SubStackPos;
+        reppos = T->RepeatStackPos;
+        looppos = T->LoopStackPos;
+        for(i=0;i<S2X_MAX_TRKCHN;i++)
+            transpose[i] = T->Channel[i].Vars[S2X_CHN_TRS];
+
+        left = T->RestCount;
+        posbase = T->PositionBase;
+        pos = T->Position+posbase;
+    }
+    while(DriverReadRetry(seq));
 
     // insert empty rows
     while(left--)
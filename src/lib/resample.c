@@ -0,0 +1,187 @@
+/*
+    Sample rate conversion
+*/
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+
+#include "resample.h"
+
+#define RESAMPLE_TAPS 16 // filter half length at 1:1, in input frames
+#define RESAMPLE_PHASES 256 // filter table resolution, interpolated
+#define RESAMPLE_CUTOFF 0.92 // of the output nyquist frequency
+#define RESAMPLE_BLOCK 4096 // input frames per pass
+
+struct resample_t {
+    int channels;
+    double step; // input frames per output frame
+    int taps; // filter half length
+    float* filter; // RESAMPLE_PHASES+1 rows of 2*taps coefficients
+
+    // input history. pos is the position of the next output frame
+    float* buf;
+    int count;
+    int size;
+    double pos;
+
+    uint64_t in_frames;
+    uint64_t out_frames;
+};
+
+static double resample_sinc(double x)
+{
+    if(fabs(x) < 1e-9)
+        return 1.0;
+    return sin(M_PI*x)/(M_PI*x);
+}
+
+// Blackman window
+static double resample_window(double x)
+{
+    if(fabs(x) >= 1.0)
+        return 0.0;
+    return 0.42 + 0.5*cos(M_PI*x) + 0.08*cos(2*M_PI*x);
+}
+
+resample_t* resample_open(int channels,double inrate,double outrate)
+{
+    double ratio = outrate < inrate ? outrate/inrate : 1.0;
+    double cutoff = ratio*RESAMPLE_CUTOFF;
+    int p,k,len;
+
+    resample_t* r = calloc(1,sizeof(*r));
+    if(!r)
+        return NULL;
+    r->channels = channels;
+    r->step = inrate/outrate;
+    r->taps = ceil(RESAMPLE_TAPS/ratio);
+    len = 2*r->taps;
+    r->size = RESAMPLE_BLOCK + len;
+    r->filter = malloc((RESAMPLE_PHASES+1)*len*sizeof(float));
+    r->buf = calloc(r->size*channels,sizeof(float));
+    if(!r->filter || !r->buf)
+    {
+        resample_close(r);
+        return NULL;
+    }
+
+    // each row is normalized so that the DC gain is exactly 1
+    for(p=0;p<=RESAMPLE_PHASES;p++)
+    {
+        float* f = r->filter+p*len;
+        double frac = (double)p/RESAMPLE_PHASES;
+        double sum = 0;
+        for(k=0;k<len;k++)
+        {
+            double x = k - r->taps + 1 - frac;
+            f[k] = cutoff*resample_sinc(cutoff*x)*resample_window(x/r->taps);
+            sum += f[k];
+        }
+        for(k=0;k<len;k++)
+            f[k] /= sum;
+    }
+
+    // the first output is centered on the first input frame
+    r->count = r->taps-1;
+    r->pos = r->taps-1;
+    return r;
+}
+
+int resample_max(resample_t* r,int frames)
+{
+    return (frames+r->taps)/r->step + 2;
+}
+
+// Output frames until the filter needs more input, then discard old input.
+static int resample_output(resample_t* r,float* out)
+{
+    int len = 2*r->taps;
+    int ch = r->channels;
+    int n = 0;
+    int i,c,k,d;
+
+    while((i = (int)r->pos) + r->taps < r->count)
+    {
+        double phase = (r->pos-i)*RESAMPLE_PHASES;
+        int pi = (int)phase;
+        float pf = phase-pi;
+        const float* f0 = r->filter+pi*len;
+        const float* f1 = f0+len;
+        const float* src = r->buf+(i-r->taps+1)*ch;
+        for(c=0;c<ch;c++)
+        {
+            float s0 = 0, s1 = 0;
+            for(k=0;k<len;k++)
+            {
+                s0 += src[k*ch+c]*f0[k];
+                s1 += src[k*ch+c]*f1[k];
+            }
+            out[c] = s0 + (s1-s0)*pf;
+        }
+        out += ch;
+        n++;
+        r->pos += r->step;
+    }
+
+    d = (int)r->pos - r->taps + 1;
+    if(d > r->count)
+        d = r->count;
+    if(d > 0)
+    {
+        memmove(r->buf,r->buf+d*ch,(r->count-d)*ch*sizeof(float));
+        r->count -= d;
+        r->pos -= d;
+    }
+    return n;
+}
+
+static int resample_input(resample_t* r,const float* in,int frames,float* out)
+{
+    int n = 0;
+    while(frames > 0)
+    {
+        int len = r->size - r->count;
+        if(len > frames)
+            len = frames;
+        if(in)
+        {
+            memcpy(r->buf+r->count*r->channels,in,len*r->channels*sizeof(float));
+            in += len*r->channels;
+        }
+        else
+            memset(r->buf+r->count*r->channels,0,len*r->channels*sizeof(float));
+        r->count += len;
+        frames -= len;
+        n += resample_output(r,out+n*r->channels);
+    }
+    return n;
+}
+
+int resample_run(resample_t* r,const float* in,int frames,float* out)
+{
+    int n = resample_input(r,in,frames,out);
+    r->in_frames += frames;
+    r->out_frames += n;
+    return n;
+}
+
+int resample_flush(resample_t* r,float* out)
+{
+    // pad with silence, but only output frames that are within the input
+    uint64_t total = ceil(r->in_frames/r->step);
+    int n = resample_input(r,NULL,r->taps,out);
+    if(r->out_frames + n > total)
+        n = total > r->out_frames ? total - r->out_frames : 0;
+    r->out_frames += n;
+    return n;
+}
+
+void resample_close(resample_t* r)
+{
+    if(!r)
+        return;
+    free(r->filter);
+    free(r->buf);
+    free(r);
+}
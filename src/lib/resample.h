@@ -0,0 +1,24 @@
+/*
+    Sample rate conversion
+
+    Windowed sinc resampler for arbitrary rate ratios. The filter cutoff is
+    lowered when downsampling to avoid aliasing.
+*/
+#ifndef RESAMPLE_H_INCLUDED
+#define RESAMPLE_H_INCLUDED
+
+typedef struct resample_t resample_t;
+
+// Returns NULL if out of memory.
+resample_t* resample_open(int channels,double inrate,double outrate);
+// Maximum number of frames returned by resample_run for an input size.
+int resample_max(resample_t* r,int frames);
+// Resample interleaved samples. out must have space for resample_max(frames)
+// frames. Returns the number of frames written to out.
+int resample_run(resample_t* r,const float* in,int frames,float* out);
+// Output the frames remaining in the filter at the end of the input. out
+// must have space for resample_max(0) frames.
+int resample_flush(resample_t* r,float* out);
+void resample_close(resample_t* r);
+
+#endif // RESAMPLE_H_INCLUDED
@@ -0,0 +1,54 @@
+/*
+    Silence detection library
+
+    Measures peak and RMS level of the chip output over short windows. The
+    sound driver decides whether voices are still pending (ie. a note that has
+    been keyed on but not yet ramped up), since the output alone can't tell.
+*/
+#include <math.h>
+
+#include "silence.h"
+
+void QP_SilenceDetectInit(QP_SilenceDetect *sd,double rate)
+{
+    sd->Threshold = SILENCE_DEFAULT_THRESHOLD;
+    sd->Window = rate*SILENCE_DEFAULT_WINDOW;
+    if(sd->Window < 1)
+        sd->Window = 1;
+    sd->Position = 0;
+    QP_SilenceDetectReset(sd);
+}
+
+// Reset the silence detection state. Position counter is not reset.
+void QP_SilenceDetectReset(QP_SilenceDetect *sd)
+{
+    sd->WindowPos = 0;
+    sd->Count = 0;
+    sd->Peak = 0;
+    sd->Power = 0;
+    sd->SilentSince = -1;
+}
+
+void QP_SilenceDetectEnd(QP_SilenceDetect *sd,int pending)
+{
+    double rms = 0;
+    if(sd->Count)
+        rms = sqrt(sd->Power/sd->Count);
+
+    if(pending || rms >= sd->Threshold || sd->Peak >= sd->Threshold*SILENCE_PEAK_RATIO)
+        sd->SilentSince = -1;
+    else if(sd->SilentSince < 0)
+        sd->SilentSince = sd->Position - sd->WindowPos;
+
+    sd->WindowPos = 0;
+    sd->Count = 0;
+    sd->Peak = 0;
+    sd->Power = 0;
+}
+
+int64_t QP_SilenceDetectGetLength(QP_SilenceDetect *sd)
+{
+    if(sd->SilentSince < 0)
+        return 0;
+    return sd->Position - sd->SilentSince;
+}
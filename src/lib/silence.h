@@ -0,0 +1,66 @@
+/*
+    Silence detection library
+*/
+#ifndef SILENCE_H_INCLUDED
+#define SILENCE_H_INCLUDED
+
+#include <stdint.h>
+
+// Default RMS threshold. Output is normalized so that 1.0 = chip full scale,
+// this is roughly -96 dB before the game gain is applied.
+#define SILENCE_DEFAULT_THRESHOLD (1.0/65536)
+// A window is not silent if any sample peaks above threshold*SILENCE_PEAK_RATIO.
+#define SILENCE_PEAK_RATIO 4.0
+// Default window length, in seconds
+#define SILENCE_DEFAULT_WINDOW 0.02
+
+typedef struct QP_SilenceDetect QP_SilenceDetect;
+
+struct QP_SilenceDetect
+{
+    double Threshold;
+    uint32_t Window;        // window length in samples
+
+    uint32_t WindowPos;     // samples in current window
+    uint32_t Count;         // values in current window (samples*channels)
+    double Peak;            // peak level in current window
+    double Power;           // sum of squares in current window
+
+    int64_t Position;       // current sample position
+    int64_t SilentSince;    // sample position where silence began, or -1
+};
+
+// initialize silence detection. rate is the sample rate of the chip output.
+void QP_SilenceDetectInit(QP_SilenceDetect *sd,double rate);
+void QP_SilenceDetectReset(QP_SilenceDetect *sd);
+
+// Call at the end of each window (when QP_SilenceDetectUpdate returns nonzero)
+// pending should be set if any voice is about to become audible (ie. volume
+// ramping up or envelope in attack phase), this keeps the window from being
+// considered silent.
+void QP_SilenceDetectEnd(QP_SilenceDetect *sd,int pending);
+
+// Returns the amount of silent samples, or 0 if the output is audible.
+int64_t QP_SilenceDetectGetLength(QP_SilenceDetect *sd);
+
+// Feed one sample frame, multiplied with scale. Returns nonzero at the end of
+// a window, QP_SilenceDetectEnd should be called when this happens.
+static inline int QP_SilenceDetectUpdate(QP_SilenceDetect *sd,const double *out,int cnt,double scale)
+{
+    int i;
+    double s;
+    for(i=0;i<cnt;i++)
+    {
+        s = out[i]*scale;
+        sd->Power += s*s;
+        if(s<0)
+            s=-s;
+        if(s > sd->Peak)
+            sd->Peak = s;
+    }
+    sd->Count += cnt;
+    sd->Position++;
+    return (++sd->WindowPos >= sd->Window);
+}
+
+#endif // SILENCE_H_INCLUDED
@@ -0,0 +1,215 @@
+/*
+    Thread helpers
+*/
+#include <stdlib.h>
+#ifndef WIN32
+#include <time.h>
+#endif
+
+#include "thread.h"
+#include "trace.h"
+
+#define THREAD_MAX 16
+
+typedef struct {
+    void (*func)(void*,int);
+    void* arg;
+    int count;
+    int next;
+} thread_for_t;
+
+void thread_mutex_init(thread_mutex_t* m)
+{
+#ifdef WIN32
+    InitializeCriticalSection(m);
+#else
+    pthread_mutex_init(m,NULL);
+#endif
+}
+
+void thread_mutex_destroy(thread_mutex_t* m)
+{
+#ifdef WIN32
+    DeleteCriticalSection(m);
+#else
+    pthread_mutex_destroy(m);
+#endif
+}
+
+void thread_mutex_lock(thread_mutex_t* m)
+{
+#ifdef WIN32
+    EnterCriticalSection(m);
+#else
+    pthread_mutex_lock(m);
+#endif
+}
+
+void thread_mutex_unlock(thread_mutex_t* m)
+{
+#ifdef WIN32
+    LeaveCriticalSection(m);
+#else
+    pthread_mutex_unlock(m);
+#endif
+}
+
+void thread_cond_init(thread_cond_t* c)
+{
+#ifdef WIN32
+    InitializeConditionVariable(c);
+#else
+    pthread_cond_init(c,NULL);
+#endif
+}
+
+void thread_cond_destroy(thread_cond_t* c)
+{
+#ifdef WIN32
+    (void)c;
+#else
+    pthread_cond_destroy(c);
+#endif
+}
+
+void thread_cond_wait(thread_cond_t* c,thread_mutex_t* m)
+{
+#ifdef WIN32
+    SleepConditionVariableCS(c,m,INFINITE);
+#else
+    pthread_cond_wait(c,m);
+#endif
+}
+
+void thread_cond_broadcast(thread_cond_t* c)
+{
+#ifdef WIN32
+    WakeAllConditionVariable(c);
+#else
+    pthread_cond_broadcast(c);
+#endif
+}
+
+typedef struct {
+    void (*func)(void*);
+    void* arg;
+} thread_start_t;
+
+#ifdef WIN32
+static DWORD WINAPI thread_start(LPVOID arg)
+#else
+static void* thread_start(void* arg)
+#endif
+{
+    thread_start_t s = *(thread_start_t*)arg;
+    free(arg);
+    s.func(s.arg);
+    TRACE_THREAD_EXIT();
+    return 0;
+}
+
+int thread_create(thread_t* t,void (*func)(void* arg),void* arg)
+{
+    thread_start_t* s = malloc(sizeof(*s));
+    if(!s)
+        return -1;
+    s->func = func;
+    s->arg = arg;
+#ifdef WIN32
+    if((*t = CreateThread(NULL,0,thread_start,s,0,NULL)))
+        return 0;
+#else
+    if(!pthread_create(t,NULL,thread_start,s))
+        return 0;
+#endif
+    free(s);
+    return -1;
+}
+
+void thread_join(thread_t* t)
+{
+#ifdef WIN32
+    WaitForSingleObject(*t,INFINITE);
+    CloseHandle(*t);
+#else
+    pthread_join(*t,NULL);
+#endif
+}
+
+void thread_sleep(int ms)
+{
+#ifdef WIN32
+    Sleep(ms);
+#else
+    struct timespec ts = {ms/1000,(ms%1000)*1000000L};
+    nanosleep(&ts,NULL);
+#endif
+}
+
+// workers take the next index until all are done
+static void thread_for_run(thread_for_t* t)
+{
+    int i;
+    while((i = __atomic_fetch_add(&t->next,1,__ATOMIC_RELAXED)) < t->count)
+    {
+        TRACE_BEGIN_ARG("job","index",i);
+        t->func(t->arg,i);
+        TRACE_END("job");
+    }
+}
+
+#ifdef WIN32
+static DWORD WINAPI thread_for_worker(LPVOID arg)
+{
+    thread_for_run(arg);
+    TRACE_THREAD_EXIT();
+    return 0;
+}
+#else
+static void* thread_for_worker(void* arg)
+{
+    thread_for_run(arg);
+    TRACE_THREAD_EXIT();
+    return NULL;
+}
+#endif
+
+void thread_for(int count,int threads,void (*func)(void* arg,int index),void* arg)
+{
+    thread_for_t t = {func,arg,count,0};
+#ifdef WIN32
+    HANDLE th[THREAD_MAX];
+#else
+    pthread_t th[THREAD_MAX];
+#endif
+    int i, started = 0;
+
+    if(threads > count)
+        threads = count;
+    if(threads > THREAD_MAX)
+        threads = THREAD_MAX;
+
+    for(i=1;i<threads;i++)
+    {
+#ifdef WIN32
+        if(!(th[started] = CreateThread(NULL,0,thread_for_worker,&t,0,NULL)))
+            break;
+#else
+        if(pthread_create(&th[started],NULL,thread_for_worker,&t))
+            break;
+#endif
+        started++;
+    }
+
+    thread_for_run(&t);
+
+    for(i=0;i<started;i++)
+    {
+#ifdef WIN32
+        WaitForSingleObject(th[i],INFINITE);
+        CloseHandle(th[i]);
+#else
+        pthread_join(th[i],NULL);
+#endif
+    }
+}
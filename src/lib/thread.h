@@ -0,0 +1,43 @@
+/*
+    Thread helpers
+
+    Small wrappers around pthreads / Win32 threads, used to run independent
+    jobs (e.g. rom file reads) in parallel.
+*/
+#ifndef THREAD_H_INCLUDED
+#define THREAD_H_INCLUDED
+
+#ifdef WIN32
+#include <windows.h>
+typedef CRITICAL_SECTION thread_mutex_t;
+typedef CONDITION_VARIABLE thread_cond_t;
+typedef HANDLE thread_t;
+#else
+#include <pthread.h>
+typedef pthread_mutex_t thread_mutex_t;
+typedef pthread_cond_t thread_cond_t;
+typedef pthread_t thread_t;
+#endif
+
+void thread_mutex_init(thread_mutex_t* m);
+void thread_mutex_destroy(thread_mutex_t* m);
+void thread_mutex_lock(thread_mutex_t* m);
+void thread_mutex_unlock(thread_mutex_t* m);
+
+// Condition variables. thread_cond_wait unlocks m while waiting.
+void thread_cond_init(thread_cond_t* c);
+void thread_cond_destroy(thread_cond_t* c);
+void thread_cond_wait(thread_cond_t* c,thread_mutex_t* m);
+void thread_cond_broadcast(thread_cond_t* c);
+
+// Start a thread running func(arg). Returns 0 on success.
+int thread_create(thread_t* t,void (*func)(void* arg),void* arg);
+void thread_join(thread_t* t);
+void thread_sleep(int ms);
+
+// Call func(arg,i) for i = 0 to count-1, using up to threads threads
+// (including the calling thread). Returns when all calls are done. If
+// threads can't be created, the remaining calls are made by the caller.
+void thread_for(int count,int threads,void (*func)(void* arg,int index),void* arg);
+
+#endif // THREAD_H_INCLUDED
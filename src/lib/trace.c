@@ -0,0 +1,235 @@
+/*
+    Timeline tracing
+*/
+#include "trace.h"
+
+#ifdef QP_TRACE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#ifdef WIN32
+#include <windows.h>
+#else
+#include <time.h>
+#endif
+
+#define TRACE_THREADS 64
+#define TRACE_EVENTS (1<<16) // per thread, must be a power of two
+
+typedef struct {
+    uint64_t time; // nanoseconds
+    const char* name;
+    const char* arg;
+    int32_t value;
+    uint16_t tid;
+    char phase;
+} trace_event_t;
+
+// Only the owner thread writes events. head is published after the event
+// is written, so the events below it can be read from another thread as long
+// as they have not been overwritten since.
+typedef struct {
+    int used;
+    uint16_t tid;
+    const char* name;
+    uint64_t head;
+    trace_event_t event[TRACE_EVENTS];
+} trace_ring_t;
+
+static trace_ring_t* trace_ring[TRACE_THREADS];
+static int trace_ring_used[TRACE_THREADS];
+static uint16_t trace_next_tid;
+static uint64_t trace_base; // time of the first event, 0 = not set
+
+static __thread trace_ring_t* trace_local;
+static __thread int trace_full;
+
+static uint64_t trace_now()
+{
+#ifdef WIN32
+    LARGE_INTEGER c,f;
+    QueryPerformanceCounter(&c);
+    QueryPerformanceFrequency(&f);
+    return (uint64_t)((double)c.QuadPart*1e9/f.QuadPart);
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC,&ts);
+    return (uint64_t)ts.tv_sec*1000000000 + ts.tv_nsec;
+#endif
+}
+
+// Claim a free ring. Rings are kept after the thread exits, so the events
+// stay until they are overwritten by the next thread using it.
+static trace_ring_t* trace_claim()
+{
+    int i;
+    for(i=0;i<TRACE_THREADS;i++)
+    {
+        int expected = 0;
+        trace_ring_t* r;
+        if(!__atomic_compare_exchange_n(&trace_ring_used[i],&expected,1,0,__ATOMIC_ACQ_REL,__ATOMIC_RELAXED))
+            continue;
+        r = trace_ring[i];
+        if(!r)
+        {
+            r = calloc(1,sizeof(*r));
+            if(!r)
+            {
+                __atomic_store_n(&trace_ring_used[i],0,__ATOMIC_RELEASE);
+                return NULL;
+            }
+            __atomic_store_n(&trace_ring[i],r,__ATOMIC_RELEASE);
+        }
+        if(!__atomic_load_n(&trace_base,__ATOMIC_ACQUIRE))
+        {
+            uint64_t zero = 0;
+            __atomic_compare_exchange_n(&trace_base,&zero,trace_now(),0,__ATOMIC_ACQ_REL,__ATOMIC_RELAXED);
+        }
+        r->tid = __atomic_add_fetch(&trace_next_tid,1,__ATOMIC_RELAXED);
+        __atomic_store_n(&r->name,NULL,__ATOMIC_RELEASE);
+        __atomic_store_n(&r->used,1,__ATOMIC_RELEASE);
+        return r;
+    }
+    return NULL;
+}
+
+static trace_ring_t* trace_get()
+{
+    if(!trace_local && !trace_full)
+    {
+        trace_local = trace_claim();
+        trace_full = !trace_local;
+    }
+    return trace_local;
+}
+
+void trace_event(char phase,const char* name,const char* arg,int32_t value)
+{
+    trace_ring_t* r = trace_get();
+    trace_event_t* e;
+    uint64_t head;
+    if(!r)
+        return;
+    head = r->head;
+    e = &r->event[head & (TRACE_EVENTS-1)];
+    e->time = trace_now();
+    e->name = name;
+    e->arg = arg;
+    e->value = value;
+    e->tid = r->tid;
+    e->phase = phase;
+    __atomic_store_n(&r->head,head+1,__ATOMIC_RELEASE);
+}
+
+void trace_thread_name(const char* name)
+{
+    trace_ring_t* r = trace_get();
+    if(r && r->name != name)
+        __atomic_store_n(&r->name,name,__ATOMIC_RELEASE);
+}
+
+void trace_thread_exit()
+{
+    int i;
+    if(!trace_local)
+        return;
+    for(i=0;i<TRACE_THREADS;i++)
+    {
+        if(trace_ring[i] == trace_local)
+        {
+            __atomic_store_n(&trace_local->used,0,__ATOMIC_RELEASE);
+            __atomic_store_n(&trace_ring_used[i],0,__ATOMIC_RELEASE);
+        }
+    }
+    trace_local = NULL;
+}
+
+// Copy the events that are still valid. Returns the event count.
+static int trace_copy(trace_ring_t* r,trace_event_t* out)
+{
+    uint64_t head = __atomic_load_n(&r->head,__ATOMIC_ACQUIRE);
+    uint64_t start = head > TRACE_EVENTS ? head-TRACE_EVENTS : 0;
+    uint64_t i,end;
+    for(i=start;i<head;i++)
+        out[i-start] = r->event[i & (TRACE_EVENTS-1)];
+
+    // events may have been overwritten while copying
+    end = __atomic_load_n(&r->head,__ATOMIC_ACQUIRE);
+    if(end+1 > start+TRACE_EVENTS)
+    {
+        uint64_t skip = end+1-TRACE_EVENTS-start;
+        if(skip > head-start)
+            skip = head-start;
+        memmove(out,out+skip,(head-start-skip)*sizeof(trace_event_t));
+        start += skip;
+    }
+    return head-start;
+}
+
+int trace_write(const char* filename)
+{
+    trace_event_t* ev;
+    uint64_t base = __atomic_load_n(&trace_base,__ATOMIC_ACQUIRE);
+    int i,j,count,error,first = 1;
+    FILE* f = fopen(filename,"w");
+    if(!f)
+        return -1;
+    ev = malloc(TRACE_EVENTS*sizeof(trace_event_t));
+    if(!ev)
+    {
+        fclose(f);
+        return -1;
+    }
+
+    fprintf(f,"{\"traceEvents\":[\n");
+    for(i=0;i<TRACE_THREADS;i++)
+    {
+        trace_ring_t* r = __atomic_load_n(&trace_ring[i],__ATOMIC_ACQUIRE);
+        const char* name = r ? __atomic_load_n(&r->name,__ATOMIC_ACQUIRE) : NULL;
+        if(name && __atomic_load_n(&r->used,__ATOMIC_ACQUIRE))
+        {
+            fprintf(f,"%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,\"args\":{\"name\":\"%s\"}}",
+                    first ? "" : ",\n",r->tid,name);
+            first = 0;
+        }
+    }
+    for(i=0;i<TRACE_THREADS;i++)
+    {
+        trace_ring_t* r = __atomic_load_n(&trace_ring[i],__ATOMIC_ACQUIRE);
+        trace_event_t* e = ev;
+        int depth = 0;
+        int tid = -1;
+        count = r ? trace_copy(r,ev) : 0;
+        for(j=0;j<count;j++,e++)
+        {
+            // the start of a span may have been overwritten
+            if(e->tid != tid)
+                depth = 0, tid = e->tid;
+            if(e->phase == 'B')
+                depth++;
+            else if(e->phase == 'E' && !depth--)
+            {
+                depth = 0;
+                continue;
+            }
+
+            fprintf(f,"%s{\"name\":\"%s\",\"ph\":\"%c\",\"ts\":%.3f,\"pid\":1,\"tid\":%d",
+                    first ? "" : ",\n",e->name,e->phase,(int64_t)(e->time-base)/1000.0,e->tid);
+            if(e->phase == 'i')
+                fprintf(f,",\"s\":\"t\"");
+            if(e->arg)
+                fprintf(f,",\"args\":{\"%s\":%d}",e->arg,e->value);
+            fprintf(f,"}");
+            first = 0;
+        }
+    }
+    fprintf(f,"\n],\"displayTimeUnit\":\"ms\"}\n");
+    error = ferror(f);
+    if(fclose(f))
+        error = 1;
+    free(ev);
+    return error ? -1 : 0;
+}
+
+#endif // QP_TRACE
@@ -0,0 +1,48 @@
+/*
+    Timeline tracing
+
+    Records begin/end events into a ring buffer per thread, and writes them
+    as Chrome trace event JSON (can be opened in chrome://tracing or
+    ui.perfetto.dev). The rings keep the most recent events, so a trace
+    written after a dropout shows what happened before it.
+
+    Build with -DQP_TRACE to enable (TRACE=1 in the Makefile), otherwise the
+    macros do nothing. Event names must be string literals.
+*/
+#ifndef TRACE_H_INCLUDED
+#define TRACE_H_INCLUDED
+
+#include <stdint.h>
+
+#ifdef QP_TRACE
+
+void trace_event(char phase,const char* name,const char* arg,int32_t value);
+void trace_thread_name(const char* name);
+// Release the calling thread's ring for use by new threads.
+void trace_thread_exit();
+// Returns 0 if successful.
+int trace_write(const char* filename);
+
+#define TRACE_BEGIN(_name)                  trace_event('B',_name,NULL,0)
+#define TRACE_BEGIN_ARG(_name,_arg,_value)  trace_event('B',_name,_arg,_value)
+#define TRACE_END(_name)                    trace_event('E',_name,NULL,0)
+#define TRACE_INSTANT(_name,_arg,_value)    trace_event('i',_name,_arg,_value)
+#define TRACE_COUNTER(_name,_value)         trace_event('C',_name,"value",_value)
+#define TRACE_THREAD_NAME(_name)            trace_thread_name(_name)
+#define TRACE_THREAD_EXIT()                 trace_thread_exit()
+#define TRACE_WRITE(_filename)              trace_write(_filename)
+
+#else
+
+#define TRACE_BEGIN(_name)
+#define TRACE_BEGIN_ARG(_name,_arg,_value)  ((void)(_value))
+#define TRACE_END(_name)
+#define TRACE_INSTANT(_name,_arg,_value)    ((void)(_value))
+#define TRACE_COUNTER(_name,_value)         ((void)(_value))
+#define TRACE_THREAD_NAME(_name)
+#define TRACE_THREAD_EXIT()
+#define TRACE_WRITE(_filename)              0
+
+#endif // QP_TRACE
+
+#endif // TRACE_H_INCLUDED
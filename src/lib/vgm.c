@@ -15,22 +15,14 @@
 // has to be larger than ~20MB
 #define VGM_BUFFER 50000000
 
-    uint32_t buffer_size;
-    uint32_t delayq;
-    uint32_t samplecnt;
-    uint32_t loop_set;
-    uint8_t* vgmdata;
-    uint8_t* data;
-    char* filename;
-
 // Increments destination pointer
-void my_memcpy(uint8_t** dest, void* src, int size)
+static void my_memcpy(uint8_t** dest, void* src, int size)
 {
     memcpy(*dest,src,size);
     *dest += size;
 }
 
-void add_datablockcmd(uint8_t** dest, uint8_t dtype, uint32_t size, uint32_t romsize, uint32_t offset)
+static void add_datablockcmd(uint8_t** dest, uint8_t dtype, uint32_t size, uint32_t romsize, uint32_t offset)
 {
     **dest = 0x67;*dest+=1;
     **dest = 0x66;*dest+=1;
@@ -41,9 +33,9 @@ void add_datablockcmd(uint8_t** dest, uint8_t dtype, uint32_t size, uint32_t rom
     my_memcpy(dest,&offset,4);
 }
 
-void add_delay(uint8_t** dest, int delay)
+static void add_delay(vgmfile_t* vgm, uint8_t** dest, int delay)
 {
-    samplecnt += delay;
+    vgm->samplecnt += delay;
 
     int commandcount = floor(delay/65535);
     uint16_t finalcommand = delay%65535;
@@ -68,17 +60,24 @@ void add_delay(uint8_t** dest, int delay)
     }
 }
 
-void vgm_open(char* fname)
+int vgm_open(vgmfile_t* vgm, char* fname)
 {
-    filename = (char*)malloc(strlen(fname)+10);
-    strcpy(filename,fname);
-    delayq=0;
-    loop_set=0;
+    vgm->filename = (char*)malloc(strlen(fname)+10);
+    strcpy(vgm->filename,fname);
+    vgm->delayq=0;
+    vgm->samplecnt=0;
+    vgm->loop_set=0;
 
     // create initial buffer
-    vgmdata=(uint8_t*)malloc(VGM_BUFFER);
-    data = vgmdata;
-    buffer_size = VGM_BUFFER;
+    vgm->vgmdata=(uint8_t*)malloc(VGM_BUFFER);
+    if(!vgm->vgmdata)
+    {
+        free(vgm->filename);
+        vgm->filename = NULL;
+        return -1;
+    }
+    uint8_t* data = vgm->vgmdata;
+    vgm->buffer_size = VGM_BUFFER;
     memset(data, 0, VGM_BUFFER);
 
     // vgm magic
@@ -90,54 +89,57 @@ void vgm_open(char* fname)
     *data++ = 0x01;
 
     //data offset
-    *(uint32_t*)(vgmdata+0x34)=0x100-0x34;
+    *(uint32_t*)(vgm->vgmdata+0x34)=0x100-0x34;
 
-    data=vgmdata+0x100;
+    vgm->data=vgm->vgmdata+0x100;
+    return 0;
 }
 
-void vgm_poke32(int32_t offset, uint32_t d)
+void vgm_poke32(vgmfile_t* vgm, int32_t offset, uint32_t d)
 {
-    *(uint32_t*)(vgmdata+offset)= d;
+    *(uint32_t*)(vgm->vgmdata+offset)= d;
 }
 
-void vgm_poke8(int32_t offset, uint8_t d)
+void vgm_poke8(vgmfile_t* vgm, int32_t offset, uint8_t d)
 {
-    *(uint8_t*)(vgmdata+offset)= d;
+    *(uint8_t*)(vgm->vgmdata+offset)= d;
 }
 
 // notice: start offset was replaced with ROM mask.
-void vgm_datablock(uint8_t dbtype, uint32_t dbsize, uint8_t* datablock, uint32_t maxsize, uint32_t mask, int32_t flags)
+void vgm_datablock(vgmfile_t* vgm, uint8_t dbtype, uint32_t dbsize, uint8_t* datablock, uint32_t maxsize, uint32_t mask, int32_t flags)
 {
-    add_datablockcmd(&data, dbtype, dbsize|flags, maxsize, 0);
+    add_datablockcmd(&vgm->data, dbtype, dbsize|flags, maxsize, 0);
 
     int i;
     for(i=0;i<dbsize;i++)
-        *data++ = datablock[i & mask];
+        *vgm->data++ = datablock[i & mask];
 
     //my_memcpy(&data, datablock, dbsize);
 }
 
-void vgm_setloop()
+void vgm_setloop(vgmfile_t* vgm)
 {
     // add delays
-    if(delayq/10 > 1)
+    if(vgm->delayq/10 > 1)
     {
-        add_delay(&data,delayq/10);
-        delayq=delayq%10;
+        add_delay(vgm,&vgm->data,vgm->delayq/10);
+        vgm->delayq=vgm->delayq%10;
     }
 
-    loop_set = samplecnt;
-    *(uint32_t*)(vgmdata+0x1c)= data-vgmdata-0x1c;
+    vgm->loop_set = vgm->samplecnt;
+    *(uint32_t*)(vgm->vgmdata+0x1c)= vgm->data-vgm->vgmdata-0x1c;
 }
 
-void vgm_write(uint8_t command, uint8_t port, uint16_t reg, uint16_t value)
+void vgm_write(vgmfile_t* vgm, uint8_t command, uint8_t port, uint16_t reg, uint16_t value)
 {
-    if(delayq/10 > 1)
+    if(vgm->delayq/10 > 1)
     {
-        add_delay(&data,delayq/10);
-        delayq=delayq%10;
+        add_delay(vgm,&vgm->data,vgm->delayq/10);
+        vgm->delayq=vgm->delayq%10;
     }
 
+    uint8_t* data = vgm->data;
+
 // todo: need to handle command types if using other chips
     *data++ = command;
 
@@ -161,39 +163,40 @@ void vgm_write(uint8_t command, uint8_t port, uint16_t reg, uint16_t value)
     }
 
     // resize buffer if needed
-    if(buffer_size-(data-vgmdata) < 1000000)
+    if(vgm->buffer_size-(data-vgm->vgmdata) < 1000000)
     {
         uint8_t* temp;
-        temp = realloc(vgmdata,buffer_size*2);
+        temp = realloc(vgm->vgmdata,vgm->buffer_size*2);
         if(temp)
         {
-            buffer_size *= 2;
-            data = temp+(data-vgmdata);
-            vgmdata = temp;
+            vgm->buffer_size *= 2;
+            data = temp+(data-vgm->vgmdata);
+            vgm->vgmdata = temp;
         }
     }
+    vgm->data = data;
 }
 
 // delay is in VGM samples*10.
-void vgm_delay(uint32_t delay)
+void vgm_delay(vgmfile_t* vgm, uint32_t delay)
 {
-    delayq+=delay;
+    vgm->delayq+=delay;
 }
 
 // https://github.com/cppformat/cppformat/pull/130/files
-void gd3_write_string(char* s)
+static void gd3_write_string(uint8_t** dest, char* s)
 {
     size_t l;
     #if defined(_WIN32) && defined(__MINGW32__) && !defined(__NO_ISOCEXT)
-        l = _snwprintf((wchar_t*)data,256,L"%S", s);
+        l = _snwprintf((wchar_t*)*dest,256,L"%S", s);
     #else
-        l = swprintf((wchar_t*)data,256,L"%s", s);
+        l = swprintf((wchar_t*)*dest,256,L"%s", s);
     #endif // defined
 
-    data += (l+1)*2;
+    *dest += (l+1)*2;
 }
 
-void vgm_write_tag(char* gamename,int songid)
+void vgm_write_tag(vgmfile_t* vgm, char* gamename,int songid)
 {
     time_t t;
     struct tm * tm;
@@ -207,49 +210,54 @@ void vgm_write_tag(char* gamename,int songid)
         sprintf(tracknotes,"Song ID: %03x\n",songid&0x7ff);
     strcpy(tracknotes+strlen(tracknotes),"Generated using QuattroPlay by ctr (Built "__DATE__" "__TIME__")");
 
+    uint8_t** data = &vgm->data;
+
     // Tag offset
-    *(uint32_t*)(vgmdata+0x14)= data-vgmdata-0x14;
-
-    memcpy(data, "Gd3 \x00\x01\x00\x00" , 8);
-    uint8_t* len_s = data+8;
-    data+=12;
-
-    gd3_write_string(""); // Track name
-    gd3_write_string(""); // Track name (native)
-    gd3_write_string(gamename); // Game name
-    gd3_write_string(""); // Game name (native)
-    gd3_write_string("Arcade Machine"); // System name
-    gd3_write_string(""); // System name (native)
-    gd3_write_string(""); // Author name
-    gd3_write_string(""); // Author name (native)
-    gd3_write_string(ts); // Time
-    gd3_write_string(""); // Pack author
-    gd3_write_string(tracknotes); // Notes
-
-    *(uint32_t*)(len_s) = data-len_s-4;        // length
+    *(uint32_t*)(vgm->vgmdata+0x14)= *data-vgm->vgmdata-0x14;
+
+    memcpy(*data, "Gd3 \x00\x01\x00\x00" , 8);
+    uint8_t* len_s = *data+8;
+    *data+=12;
+
+    gd3_write_string(data,""); // Track name
+    gd3_write_string(data,""); // Track name (native)
+    gd3_write_string(data,gamename); // Game name
+    gd3_write_string(data,""); // Game name (native)
+    gd3_write_string(data,"Arcade Machine"); // System name
+    gd3_write_string(data,""); // System name (native)
+    gd3_write_string(data,""); // Author name
+    gd3_write_string(data,""); // Author name (native)
+    gd3_write_string(data,ts); // Time
+    gd3_write_string(data,""); // Pack author
+    gd3_write_string(data,tracknotes); // Notes
+
+    *(uint32_t*)(len_s) = *data-len_s-4;       // length
 }
 
-void vgm_stop()
+void vgm_stop(vgmfile_t* vgm)
 {
-    if(delayq/10 > 1)
+    if(vgm->delayq/10 > 1)
     {
-        add_delay(&data,delayq/10);
-        delayq=0;
+        add_delay(vgm,&vgm->data,vgm->delayq/10);
+        vgm->delayq=0;
     }
-    *data++ = 0x66;
+    *vgm->data++ = 0x66;
 
     // Sample count/loop sample count
-    *(uint32_t*)(vgmdata+0x18)= samplecnt;
-    if(loop_set)
-        *(uint32_t*)(vgmdata+0x20)= samplecnt-loop_set;
+    *(uint32_t*)(vgm->vgmdata+0x18)= vgm->samplecnt;
+    if(vgm->loop_set)
+        *(uint32_t*)(vgm->vgmdata+0x20)= vgm->samplecnt-vgm->loop_set;
 }
 
-void vgm_close()
+void vgm_close(vgmfile_t* vgm)
 {
     // EoF offset
-    *(uint32_t*)(vgmdata+0x04)= data-vgmdata-4;
+    *(uint32_t*)(vgm->vgmdata+0x04)= vgm->data-vgm->vgmdata-4;
 
-    write_file(filename, vgmdata, data-vgmdata);
+    write_file(vgm->filename, vgm->vgmdata, vgm->data-vgm->vgmdata);
 
-    free(vgmdata);
+    free(vgm->vgmdata);
+    free(vgm->filename);
+    vgm->vgmdata = NULL;
+    vgm->filename = NULL;
 }
@@ -3,18 +3,31 @@
 
 #include <stdint.h>
 
+typedef struct {
+
+    char* filename;
+
+    uint8_t* vgmdata;
+    uint8_t* data;
+    uint32_t buffer_size;
+
+    uint32_t delayq;
+    uint32_t samplecnt;
+    uint32_t loop_set;
+
+} vgmfile_t;
+
 // samplerom, samplelen, rom_offset
 //void vgm_open(char* fname, uint8_t* datablock, uint32_t dbsize, uint32_t startoffset);
-void vgm_open(char* fname);
-void vgm_write(uint8_t command, uint8_t port, uint16_t reg, uint16_t value);
-void vgm_delay(uint32_t delay);
-void vgm_setloop();
-void vgm_loop();
-void vgm_stop();
-void vgm_write_tag(char* gamename,int songid);
-void vgm_close();
-void vgm_poke32(int32_t offset, uint32_t d);
-void vgm_poke8(int32_t offset, uint8_t d);
-void vgm_datablock(uint8_t dbtype, uint32_t dbsize, uint8_t* datablock, uint32_t maxsize, uint32_t mask, int32_t flags);
+int vgm_open(vgmfile_t* vgm, char* fname);
+void vgm_write(vgmfile_t* vgm, uint8_t command, uint8_t port, uint16_t reg, uint16_t value);
+void vgm_delay(vgmfile_t* vgm, uint32_t delay);
+void vgm_setloop(vgmfile_t* vgm);
+void vgm_stop(vgmfile_t* vgm);
+void vgm_write_tag(vgmfile_t* vgm, char* gamename,int songid);
+void vgm_close(vgmfile_t* vgm);
+void vgm_poke32(vgmfile_t* vgm, int32_t offset, uint32_t d);
+void vgm_poke8(vgmfile_t* vgm, int32_t offset, uint8_t d);
+void vgm_datablock(vgmfile_t* vgm, uint8_t dbtype, uint32_t dbsize, uint8_t* datablock, uint32_t maxsize, uint32_t mask, int32_t flags);
 
 #endif // VGM_H_INCLUDED
@@ -0,0 +1,448 @@
+/*
+    WAV writing
+*/
+#ifdef __linux__
+#define _GNU_SOURCE
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "wav.h"
+#include "flac.h"
+#include "resample.h"
+#include "thread.h"
+
+#define WAV_RING_SECONDS 4 // ring buffer length
+#define WAV_BLOCK 262144 // bytes per write, file offsets are aligned to this
+#define WAV_PREALLOC (64<<20) // bytes to preallocate at a time
+#define WAV_POLL 10 // writer thread sleep in ms
+#define WAV_HEADER_MAX 96
+#define WAV_CHUNK 4096 // frames per resampler pass
+
+struct wavfile_t {
+    FILE* file;
+    flacfile_t* flac; // FLAC formats write here instead
+    resample_t* resample; // if the input rate is different
+    float* chunk; // resampler input and output
+    thread_t thread;
+
+    int channels;
+    uint32_t rate;
+    int format;
+    int bytes; // bytes per sample in the block buffer
+    int bits; // output bits per sample
+
+    // ring buffer. head is written by wav_write, tail by the writer thread
+    float* ring;
+    uint32_t mask;
+    uint32_t head;
+    uint32_t tail;
+    int quit;
+
+    uint64_t dropped;
+
+    // writer thread state
+    uint8_t* block;
+    int block_pos;
+    int block_size; // first block is shortened by the header size
+    uint32_t header_size;
+    uint64_t data_size;
+    uint64_t allocated;
+    uint32_t random;
+    int error;
+};
+
+static uint8_t* put32(uint8_t* d,uint32_t v)
+{
+    d[0]=v; d[1]=v>>8; d[2]=v>>16; d[3]=v>>24;
+    return d+4;
+}
+
+static uint8_t* put16(uint8_t* d,uint16_t v)
+{
+    d[0]=v; d[1]=v>>8;
+    return d+2;
+}
+
+// chunk id and size
+static uint8_t* putid(uint8_t* d,const char* id,uint32_t size)
+{
+    memcpy(d,id,4);
+    return put32(d+4,size);
+}
+
+static uint8_t* put64(uint8_t* d,uint64_t v)
+{
+    d = put32(d,v);
+    return put32(d,v>>32);
+}
+
+// Builds the header. Space for a ds64 chunk is reserved by a JUNK chunk,
+// which is replaced if the file becomes too large for RIFF.
+static uint32_t wav_header(wavfile_t* w,uint8_t* d)
+{
+    uint8_t* p = d;
+    uint32_t fmt_size = w->format == WAV_FLOAT ? 18 : 16;
+    uint32_t size = 12 + 36 + 8 + fmt_size + (w->format == WAV_FLOAT ? 12 : 0) + 8;
+    uint64_t riff_size = size - 8 + ((w->data_size+1)&~1ULL);
+    uint64_t frames = w->data_size / (w->bytes*w->channels);
+    int rf64 = riff_size > 0xffffffff;
+
+    p = putid(p,rf64 ? "RF64" : "RIFF",rf64 ? 0xffffffff : riff_size);
+    memcpy(p,"WAVE",4); p+=4;
+
+    p = putid(p,rf64 ? "ds64" : "JUNK",28);
+    p = put64(p,rf64 ? riff_size : 0);
+    p = put64(p,rf64 ? w->data_size : 0);
+    p = put64(p,rf64 ? frames : 0);
+    p = put32(p,0); // table length
+
+    p = putid(p,"fmt ",fmt_size);
+    p = put16(p,w->format == WAV_FLOAT ? 3 : 1);
+    p = put16(p,w->channels);
+    p = put32(p,w->rate);
+    p = put32(p,w->rate*w->channels*w->bytes); // bytes per second
+    p = put16(p,w->channels*w->bytes); // bytes per frame
+    p = put16(p,w->bytes*8); // bits per sample
+    if(w->format == WAV_FLOAT)
+    {
+        p = put16(p,0); // extension size
+        p = putid(p,"fact",4);
+        p = put32(p,rf64 ? 0xffffffff : frames);
+    }
+
+    p = putid(p,"data",rf64 ? 0xffffffff : w->data_size);
+    return p-d;
+}
+
+static void wav_flush(wavfile_t* w)
+{
+    if(!w->block_pos)
+        return;
+    if(w->flac)
+    {
+        if(flac_write(w->flac,(int32_t*)w->block,w->block_pos/(4*w->channels)))
+            w->error = 1;
+        w->block_pos = 0;
+        return;
+    }
+#ifdef __linux__
+    // reserve space ahead, so the file isn't fragmented. not all
+    // filesystems support this, the result is ignored.
+    uint64_t end = w->header_size + w->data_size + w->block_pos;
+    if(end > w->allocated)
+    {
+        fallocate(fileno(w->file),FALLOC_FL_KEEP_SIZE,w->allocated,WAV_PREALLOC);
+        w->allocated += WAV_PREALLOC;
+    }
+#endif
+    if(fwrite(w->block,1,w->block_pos,w->file) != (size_t)w->block_pos)
+        w->error = 1;
+    w->data_size += w->block_pos;
+    w->block_pos = 0;
+    w->block_size = WAV_BLOCK;
+}
+
+// TPDF dither, sum of two uniform random values (+/- 1 LSB)
+static double wav_dither(wavfile_t* w)
+{
+    uint32_t r = w->random;
+    r ^= r<<13; r ^= r>>17; r ^= r<<5;
+    w->random = r;
+    return ((int)(r&0xffff) - (int)(r>>16)) / 65536.0;
+}
+
+// Convert to integer with TPDF dither
+static int32_t wav_quantize(wavfile_t* w,float s,int bits)
+{
+    int32_t max = (1<<(bits-1))-1;
+    int32_t v = s*(double)max + wav_dither(w) + max + 1.5;
+    v = v < 0 ? 0 : v > 2*max+1 ? 2*max+1 : v;
+    return v - max - 1;
+}
+
+static void wav_convert(wavfile_t* w,float s)
+{
+    uint8_t d[4];
+    int32_t v;
+    int i;
+
+    // float samples keep the headroom, the others are clipped
+    if(w->format != WAV_FLOAT)
+        s = s < -1.0f ? -1.0f : s > 1.0f ? 1.0f : s;
+    switch(w->format)
+    {
+    default:
+        memcpy(d,&s,4);
+        break;
+    case WAV_PCM16:
+    case WAV_PCM24:
+        put32(d,wav_quantize(w,s,w->bits));
+        break;
+    case WAV_FLAC16:
+    case WAV_FLAC24:
+        v = wav_quantize(w,s,w->bits);
+        memcpy(d,&v,4);
+        break;
+    }
+
+    // samples may be split between blocks
+    for(i=0;i<w->bytes;i++)
+    {
+        w->block[w->block_pos++] = d[i];
+        if(w->block_pos == w->block_size)
+            wav_flush(w);
+    }
+}
+
+// Resample samples from the ring buffer. Returns the new tail.
+static uint32_t wav_resample(wavfile_t* w,uint32_t tail,uint32_t head)
+{
+    float* out = w->chunk+WAV_CHUNK*w->channels;
+    uint32_t count = head - tail;
+    uint32_t i;
+    int n;
+
+    if(count > WAV_CHUNK*w->channels)
+        count = WAV_CHUNK*w->channels;
+    for(i=0;i<count;i++)
+        w->chunk[i] = w->ring[tail++ & w->mask];
+    n = resample_run(w->resample,w->chunk,count/w->channels,out);
+    for(i=0;i<n*w->channels;i++)
+        wav_convert(w,out[i]);
+    return tail;
+}
+
+static void wav_thread(void* arg)
+{
+    wavfile_t* w = arg;
+    uint32_t head, tail = w->tail;
+    uint32_t i;
+    int n;
+
+    for(;;)
+    {
+        int quit = __atomic_load_n(&w->quit,__ATOMIC_ACQUIRE);
+        head = __atomic_load_n(&w->head,__ATOMIC_ACQUIRE);
+        if(head == tail)
+        {
+            if(quit)
+                break;
+            thread_sleep(WAV_POLL);
+            continue;
+        }
+        while(tail != head)
+        {
+            if(w->resample)
+                tail = wav_resample(w,tail,head);
+            else
+                wav_convert(w,w->ring[tail++ & w->mask]);
+        }
+        __atomic_store_n(&w->tail,tail,__ATOMIC_RELEASE);
+    }
+    if(w->resample)
+    {
+        n = resample_flush(w->resample,w->chunk);
+        for(i=0;i<n*w->channels;i++)
+            wav_convert(w,w->chunk[i]);
+    }
+    wav_flush(w);
+}
+
+wavfile_t* wav_open(const char* filename,int channels,uint32_t rate,int format)
+{
+    return wav_open_resample(filename,channels,rate,format,rate);
+}
+
+wavfile_t* wav_open_resample(const char* filename,int channels,uint32_t rate,int format,double inrate)
+{
+    uint8_t header[WAV_HEADER_MAX];
+    uint32_t size = 1;
+    wavfile_t* w = calloc(1,sizeof(*w));
+    if(!w)
+        return NULL;
+
+    w->channels = channels;
+    w->rate = rate;
+    w->format = format;
+    w->bits = format == WAV_PCM16 || format == WAV_FLAC16 ? 16 : format == WAV_FLOAT ? 32 : 24;
+    w->bytes = format == WAV_PCM16 ? 2 : format == WAV_PCM24 ? 3 : 4;
+    w->random = 0x12345678;
+
+    while(size < (inrate > rate ? inrate : rate)*channels*WAV_RING_SECONDS)
+        size <<= 1;
+    w->mask = size-1;
+    w->ring = malloc(size*sizeof(float));
+    w->block = malloc(WAV_BLOCK);
+    if(!w->ring || !w->block)
+        goto fail;
+
+    if(inrate != rate)
+    {
+        w->resample = resample_open(channels,inrate,rate);
+        if(!w->resample)
+            goto fail;
+        // input chunk followed by the output
+        w->chunk = malloc((WAV_CHUNK + resample_max(w->resample,WAV_CHUNK))*channels*sizeof(float));
+        if(!w->chunk)
+            goto fail;
+    }
+
+    if(format == WAV_FLAC16 || format == WAV_FLAC24)
+    {
+        // the block buffer holds whole frames of integer samples
+        w->flac = flac_open(filename,channels,rate,w->bits,0);
+        w->block_size = WAV_BLOCK - WAV_BLOCK % (4*channels);
+        if(!w->flac || thread_create(&w->thread,wav_thread,w))
+            goto fail;
+        return w;
+    }
+
+    w->file = fopen(filename,"wb");
+    if(!w->file)
+        goto fail;
+
+    // blocks are written directly
+    setvbuf(w->file,NULL,_IONBF,0);
+    w->header_size = wav_header(w,header);
+    w->block_size = WAV_BLOCK - w->header_size;
+    if(fwrite(header,1,w->header_size,w->file) != w->header_size)
+        goto fail;
+    if(thread_create(&w->thread,wav_thread,w))
+        goto fail;
+    return w;
+
+fail:
+    if(w->file)
+        fclose(w->file);
+    if(w->flac)
+        flac_close(w->flac);
+    resample_close(w->resample);
+    free(w->chunk);
+    free(w->block);
+    free(w->ring);
+    free(w);
+    return NULL;
+}
+
+// Returns the number of frames queued.
+static int wav_queue(wavfile_t* w,const float* samples,int frames)
+{
+    uint32_t head = w->head;
+    uint32_t tail = __atomic_load_n(&w->tail,__ATOMIC_ACQUIRE);
+    uint32_t avail = w->mask + 1 - (head - tail);
+    uint32_t count = frames * w->channels;
+    uint32_t pos, len;
+
+    if(count > avail)
+        count = avail - avail % w->channels;
+
+    pos = head & w->mask;
+    len = count;
+    if(pos + len > w->mask + 1)
+        len = w->mask + 1 - pos;
+    memcpy(w->ring+pos,samples,len*sizeof(float));
+    memcpy(w->ring,samples+len,(count-len)*sizeof(float));
+    __atomic_store_n(&w->head,head+count,__ATOMIC_RELEASE);
+    return count / w->channels;
+}
+
+int wav_write(wavfile_t* w,const float* samples,int frames)
+{
+    frames -= wav_queue(w,samples,frames);
+    w->dropped += frames;
+    return frames;
+}
+
+void wav_write_wait(wavfile_t* w,const float* samples,int frames)
+{
+    for(;;)
+    {
+        int n = wav_queue(w,samples,frames);
+        samples += n*w->channels;
+        frames -= n;
+        if(!frames)
+            break;
+        thread_sleep(1);
+    }
+}
+
+void wav_tag(wavfile_t* w,const char* key,const char* value)
+{
+    if(w->flac)
+        flac_tag(w->flac,key,value);
+}
+
+uint64_t wav_dropped(wavfile_t* w)
+{
+    return w->dropped;
+}
+
+int wav_close(wavfile_t* w)
+{
+    uint8_t header[WAV_HEADER_MAX];
+    size_t size;
+    int error;
+    if(!w)
+        return 0;
+
+    __atomic_store_n(&w->quit,1,__ATOMIC_RELEASE);
+    thread_join(&w->thread);
+
+    resample_close(w->resample);
+    free(w->chunk);
+    if(w->flac)
+    {
+        error = flac_close(w->flac) || w->error;
+        free(w->block);
+        free(w->ring);
+        free(w);
+        return error ? -1 : 0;
+    }
+
+    // the data chunk is padded to an even size
+    if(w->data_size & 1)
+        fputc(0,w->file);
+#ifdef __linux__
+    // release the unused preallocated space
+    fflush(w->file);
+    if(ftruncate(fileno(w->file),w->header_size + ((w->data_size+1)&~1ULL)))
+        w->error = 1;
+#endif
+    fseek(w->file,0,SEEK_SET);
+    size = wav_header(w,header);
+    if(fwrite(header,1,size,w->file) != size || ferror(w->file))
+        w->error = 1;
+    if(fclose(w->file))
+        w->error = 1;
+    error = w->error;
+
+    free(w->block);
+    free(w->ring);
+    free(w);
+    return error ? -1 : 0;
+}
+
+int wav_format(const char* name)
+{
+    if(!strcmp(name,"float") || !strcmp(name,"32"))
+        return WAV_FLOAT;
+    if(!strcmp(name,"16"))
+        return WAV_PCM16;
+    if(!strcmp(name,"24"))
+        return WAV_PCM24;
+    if(!strcmp(name,"flac16") || !strcmp(name,"flac"))
+        return WAV_FLAC16;
+    if(!strcmp(name,"flac24"))
+        return WAV_FLAC24;
+    return -1;
+}
+
+const char* wav_extension(int format)
+{
+    return format == WAV_FLAC16 || format == WAV_FLAC24 ? "flac" : "wav";
+}
@@ -0,0 +1,49 @@
+/*
+    WAV writing
+
+    Samples are queued in a ring buffer and written to the file by a
+    separate thread, so that the audio callback never waits for the disk.
+    Files larger than 4GB are written as RF64. The writer can also encode
+    FLAC instead (see flac.h), and resample the input.
+*/
+#ifndef WAV_H_INCLUDED
+#define WAV_H_INCLUDED
+
+#include <stdint.h>
+
+enum {
+    WAV_FLOAT = 0, // 32-bit float
+    WAV_PCM16, // 16-bit integer, dithered
+    WAV_PCM24, // 24-bit integer, dithered
+    WAV_FLAC16, // 16-bit FLAC, dithered
+    WAV_FLAC24, // 24-bit FLAC, dithered
+};
+
+typedef struct wavfile_t wavfile_t;
+
+// Returns NULL if the file can't be opened.
+wavfile_t* wav_open(const char* filename,int channels,uint32_t rate,int format);
+// Same as wav_open, but the samples given to wav_write are at inrate, and
+// are resampled to rate by the writer thread.
+wavfile_t* wav_open_resample(const char* filename,int channels,uint32_t rate,int format,double inrate);
+// Queue interleaved samples, does not block. Should only be called from one
+// thread. Returns the number of frames that didn't fit in the buffer.
+int wav_write(wavfile_t* wav,const float* samples,int frames);
+// Same as wav_write, but waits for space instead of dropping frames. Used
+// when rendering faster than real time.
+void wav_write_wait(wavfile_t* wav,const float* samples,int frames);
+// Set a tag (FLAC only, ignored for WAV). Written when the file is closed.
+void wav_tag(wavfile_t* wav,const char* key,const char* value);
+// Frames dropped because the writer thread couldn't keep up.
+uint64_t wav_dropped(wavfile_t* wav);
+// Write the remaining samples and the header, then free wav. Returns -1 if
+// the file could not be written completely (disk full, etc.)
+int wav_close(wavfile_t* wav);
+
+// Parse a format name ("float", "16", "24", "flac16", "flac24").
+// Returns -1 if unknown.
+int wav_format(const char* name);
+// File extension for a format, without the dot.
+const char* wav_extension(int format);
+
+#endif // WAV_H_INCLUDED
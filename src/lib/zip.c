@@ -0,0 +1,613 @@
+/*
+    Zip file reader
+
+    Only what is needed to read ROM sets: no zip64, encryption or
+    multi-disk archives. Deflate streams are decoded with a small built-in
+    inflate, output goes directly to the destination buffer.
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <ctype.h>
+#include <errno.h>
+
+#include "fileio.h"
+#include "zip.h"
+
+#define ZIP_EOCD_SIG    0x06054b50
+#define ZIP_CDIR_SIG    0x02014b50
+#define ZIP_LOCAL_SIG   0x04034b50
+
+#define INF_MAXBITS     15
+#define INF_FASTBITS    9
+#define INF_WINDOW      32768
+#define INF_INBUF       16384
+
+static uint16_t get16(const uint8_t* p)
+{
+    return p[0]|(p[1]<<8);
+}
+
+static uint32_t get32(const uint8_t* p)
+{
+    return p[0]|(p[1]<<8)|(p[2]<<16)|((uint32_t)p[3]<<24);
+}
+
+static int zip_error(const char* msg)
+{
+    snprintf(fileio_error,sizeof(fileio_error),"%s",msg);
+    return -1;
+}
+
+int zip_open(zipfile_t* z, const char* filename)
+{
+    uint8_t* buf;
+    uint8_t* p;
+    long filesize, tailsize;
+    uint32_t cd_offset, cd_size;
+    int i, n;
+
+    memset(z,0,sizeof(*z));
+    z->file = fopen(filename,"rb");
+    if(!z->file)
+    {
+        strcpy(fileio_error,strerror(errno));
+        return -1;
+    }
+
+    // find end of central directory record (22 bytes + up to 64k comment)
+    fseek(z->file,0,SEEK_END);
+    filesize = ftell(z->file);
+    tailsize = filesize < 22+65535 ? filesize : 22+65535;
+    buf = malloc(tailsize);
+    if(!buf)
+        goto fail_mem;
+    fseek(z->file,filesize-tailsize,SEEK_SET);
+    if(fread(buf,1,tailsize,z->file) != tailsize)
+    {
+        free(buf);
+        zip_error("Read error");
+        goto fail;
+    }
+    for(i=tailsize-22;i>=0;i--)
+    {
+        if(get32(buf+i) == ZIP_EOCD_SIG)
+            break;
+    }
+    if(i<0)
+    {
+        free(buf);
+        zip_error("Not a zip file");
+        goto fail;
+    }
+    n = get16(buf+i+10);
+    cd_size = get32(buf+i+12);
+    cd_offset = get32(buf+i+16);
+    free(buf);
+
+    if(cd_offset == 0xffffffff || n == 0xffff)
+    {
+        zip_error("Zip64 is not supported");
+        goto fail;
+    }
+    if((long)cd_offset+cd_size > filesize)
+    {
+        zip_error("Bad zip directory");
+        goto fail;
+    }
+
+    // read central directory
+    buf = malloc(cd_size+1);
+    z->entry = calloc(n+1,sizeof(zip_entry_t));
+    if(!buf || !z->entry)
+    {
+        free(buf);
+        goto fail_mem;
+    }
+    fseek(z->file,cd_offset,SEEK_SET);
+    if(fread(buf,1,cd_size,z->file) != cd_size)
+    {
+        free(buf);
+        zip_error("Read error");
+        goto fail;
+    }
+    p = buf;
+    for(i=0;i<n;i++)
+    {
+        zip_entry_t* e = &z->entry[z->count];
+        int namelen;
+        if(p+46 > buf+cd_size || get32(p) != ZIP_CDIR_SIG)
+            break;
+        namelen = get16(p+28);
+        if(p+46+namelen > buf+cd_size)
+            break;
+        e->method = get16(p+10);
+        e->crc = get32(p+16);
+        e->csize = get32(p+20);
+        e->size = get32(p+24);
+        e->offset = get32(p+42);
+        if(namelen > (int)sizeof(e->name)-1)
+            namelen = sizeof(e->name)-1;
+        memcpy(e->name,p+46,namelen);
+        e->name[namelen] = 0;
+        z->count++;
+        p += 46+get16(p+28)+get16(p+30)+get16(p+32);
+    }
+    free(buf);
+    return 0;
+
+fail_mem:
+    zip_error("Out of memory");
+fail:
+    zip_close(z);
+    return -1;
+}
+
+void zip_close(zipfile_t* z)
+{
+    if(z->file)
+        fclose(z->file);
+    free(z->entry);
+    z->file = NULL;
+    z->entry = NULL;
+    z->count = 0;
+}
+
+zip_entry_t* zip_find(zipfile_t* z, const char* name)
+{
+    int i;
+    const char *a, *b;
+    for(i=0;i<z->count;i++)
+    {
+        a = z->entry[i].name;
+        b = name;
+        while(*a && tolower((uint8_t)*a) == tolower((uint8_t)*b))
+            a++, b++;
+        if(!*a && !*b)
+            return &z->entry[i];
+    }
+    return NULL;
+}
+
+// decoder state
+typedef struct {
+    uint16_t fast[1<<INF_FASTBITS]; // (length<<9)|symbol, 0 = use slow path
+    uint16_t count[INF_MAXBITS+1];
+    uint16_t symbol[288];
+} inf_huff_t;
+
+typedef struct {
+    // input
+    FILE* file;
+    uint32_t remain;
+    uint8_t* in;
+    int inpos, inlen;
+    int pad;
+    uint64_t bitbuf;
+    int bitcnt;
+
+    // output
+    uint8_t* window;
+    uint32_t pos;       // total bytes decoded
+    uint32_t start;     // first byte to write
+    uint32_t length;    // bytes to write
+    uint8_t* dest;
+    int byteswap;
+    int stride;
+    uint32_t crc;
+
+    inf_huff_t lencode;
+    inf_huff_t distcode;
+} inf_state_t;
+
+static uint32_t crc_table[256];
+static volatile int crc_ready = 0;
+
+static void crc_init()
+{
+    uint32_t c;
+    int i,j;
+    if(__atomic_load_n(&crc_ready,__ATOMIC_ACQUIRE))
+        return;
+    for(i=0;i<256;i++)
+    {
+        c = i;
+        for(j=0;j<8;j++)
+            c = c&1 ? 0xedb88320^(c>>1) : c>>1;
+        crc_table[i] = c;
+    }
+    // all threads compute the same table, so a race is harmless
+    __atomic_store_n(&crc_ready,1,__ATOMIC_RELEASE);
+}
+
+static void inf_refill(inf_state_t* s)
+{
+    while(s->bitcnt <= 56)
+    {
+        if(s->inpos == s->inlen)
+        {
+            int n = s->remain < INF_INBUF ? s->remain : INF_INBUF;
+            if(n)
+                n = fread(s->in,1,n,s->file);
+            s->remain -= n;
+            s->inpos = 0;
+            s->inlen = n;
+            if(!n)
+            {
+                // past the end of input. pad with zeros, see inf_overrun.
+                s->pad++;
+                s->bitcnt += 8;
+                continue;
+            }
+        }
+        s->bitbuf |= (uint64_t)s->in[s->inpos++] << s->bitcnt;
+        s->bitcnt += 8;
+    }
+}
+
+// nonzero if padding bits have been used
+static inline int inf_overrun(inf_state_t* s)
+{
+    return s->bitcnt < s->pad*8;
+}
+
+static inline uint32_t inf_bits(inf_state_t* s,int n)
+{
+    uint32_t v;
+    if(s->bitcnt < n)
+        inf_refill(s);
+    v = s->bitbuf & ((1u<<n)-1);
+    s->bitbuf >>= n;
+    s->bitcnt -= n;
+    return v;
+}
+
+// Output one byte. Bytes outside the requested range are only kept in
+// the window.
+static inline void inf_put(inf_state_t* s,uint8_t b)
+{
+    uint32_t k;
+    s->window[s->pos & (INF_WINDOW-1)] = b;
+    s->crc = crc_table[(s->crc^b)&0xff]^(s->crc>>8);
+    k = s->pos - s->start;
+    if(k < s->length)
+    {
+        if(s->byteswap && (k^1) < s->length)
+            k ^= 1;
+        s->dest[k*s->stride] = b;
+    }
+    s->pos++;
+}
+
+static int inf_build(inf_huff_t* h,const uint8_t* length,int n)
+{
+    uint16_t offs[INF_MAXBITS+1];
+    int sym, len, left, code, i;
+
+    memset(h->count,0,sizeof(h->count));
+    memset(h->fast,0,sizeof(h->fast));
+    for(sym=0;sym<n;sym++)
+        h->count[length[sym]]++;
+    if(h->count[0] == n)
+        return 0;
+
+    // check for an over-subscribed set of lengths
+    left = 1;
+    for(len=1;len<=INF_MAXBITS;len++)
+    {
+        left <<= 1;
+        left -= h->count[len];
+        if(left < 0)
+            return -1;
+    }
+
+    offs[1] = 0;
+    for(len=1;len<INF_MAXBITS;len++)
+        offs[len+1] = offs[len]+h->count[len];
+    for(sym=0;sym<n;sym++)
+        if(length[sym])
+            h->symbol[offs[length[sym]]++] = sym;
+
+    // lookup table for short codes, indexed by bit-reversed code
+    code = 0;
+    i = 0;
+    for(len=1;len<=INF_FASTBITS;len++)
+    {
+        int c;
+        for(c=0;c<h->count[len];c++,code++,i++)
+        {
+            int rev = 0, b, j;
+            for(b=0;b<len;b++)
+                rev |= ((code>>b)&1) << (len-1-b);
+            for(j=rev;j<(1<<INF_FASTBITS);j+=1<<len)
+                h->fast[j] = (len<<9)|h->symbol[i];
+        }
+        code <<= 1;
+    }
+    return 0;
+}
+
+static int inf_decode(inf_state_t* s,const inf_huff_t* h)
+{
+    int code, first, count, index, len;
+    uint16_t e;
+
+    if(s->bitcnt < INF_MAXBITS)
+        inf_refill(s);
+    e = h->fast[s->bitbuf & ((1<<INF_FASTBITS)-1)];
+    if(e)
+    {
+        s->bitbuf >>= e>>9;
+        s->bitcnt -= e>>9;
+        return e & 0x1ff;
+    }
+
+    code = first = index = 0;
+    for(len=1;len<=INF_MAXBITS;len++)
+    {
+        code |= (s->bitbuf >> (len-1)) & 1;
+        count = h->count[len];
+        if(code - count < first)
+        {
+            s->bitbuf >>= len;
+            s->bitcnt -= len;
+            return h->symbol[index+(code-first)];
+        }
+        index += count;
+        first += count;
+        first <<= 1;
+        code <<= 1;
+    }
+    return -1;
+}
+
+static const uint16_t len_base[29] = {
+    3,4,5,6,7,8,9,10,11,13,15,17,19,23,27,31,35,43,51,59,67,83,99,115,131,163,195,227,258 };
+static const uint8_t len_extra[29] = {
+    0,0,0,0,0,0,0,0,1,1,1,1,2,2,2,2,3,3,3,3,4,4,4,4,5,5,5,5,0 };
+static const uint16_t dist_base[30] = {
+    1,2,3,4,5,7,9,13,17,25,33,49,65,97,129,193,257,385,513,769,1025,1537,2049,3073,4097,6145,8193,12289,16385,24577 };
+static const uint8_t dist_extra[30] = {
+    0,0,0,0,1,1,2,2,3,3,4,4,5,5,6,6,7,7,8,8,9,9,10,10,11,11,12,12,13,13 };
+
+static int inf_codes(inf_state_t* s,uint32_t end)
+{
+    int sym, len;
+    uint32_t dist;
+
+    while(s->pos < end)
+    {
+        sym = inf_decode(s,&s->lencode);
+        if(sym < 0)
+            return -1;
+        if(sym < 256)
+            inf_put(s,sym);
+        else if(sym == 256)
+            return 0;
+        else
+        {
+            sym -= 257;
+            if(sym >= 29)
+                return -1;
+            len = len_base[sym] + inf_bits(s,len_extra[sym]);
+            sym = inf_decode(s,&s->distcode);
+            if(sym < 0 || sym >= 30)
+                return -1;
+            dist = dist_base[sym] + inf_bits(s,dist_extra[sym]);
+            if(dist > s->pos)
+                return -1;
+            while(len--)
+                inf_put(s,s->window[(s->pos-dist) & (INF_WINDOW-1)]);
+        }
+    }
+    return 1; // reached end of requested data
+}
+
+static int inf_stored(inf_state_t* s,uint32_t end)
+{
+    uint32_t len;
+
+    // go to byte boundary
+    inf_bits(s,s->bitcnt & 7);
+    len = inf_bits(s,16);
+    if(inf_bits(s,16) != (~len & 0xffff))
+        return -1;
+    while(len--)
+    {
+        if(s->pos >= end)
+            return 1;
+        inf_put(s,inf_bits(s,8));
+    }
+    return 0;
+}
+
+static int inf_fixed(inf_state_t* s)
+{
+    uint8_t length[288];
+    int i;
+    for(i=0;i<144;i++)
+        length[i] = 8;
+    for(;i<256;i++)
+        length[i] = 9;
+    for(;i<280;i++)
+        length[i] = 7;
+    for(;i<288;i++)
+        length[i] = 8;
+    inf_build(&s->lencode,length,288);
+    for(i=0;i<30;i++)
+        length[i] = 5;
+    inf_build(&s->distcode,length,30);
+    return 0;
+}
+
+static int inf_dynamic(inf_state_t* s)
+{
+    static const uint8_t order[19] = {16,17,18,0,8,7,9,6,10,5,11,4,12,3,13,2,14,1,15};
+    uint8_t length[320];
+    int nlen, ndist, ncode, i, sym, len, rep;
+
+    nlen = inf_bits(s,5)+257;
+    ndist = inf_bits(s,5)+1;
+    ncode = inf_bits(s,4)+4;
+    if(nlen > 286 || ndist > 30)
+        return -1;
+
+    memset(length,0,sizeof(length));
+    for(i=0;i<ncode;i++)
+        length[order[i]] = inf_bits(s,3);
+    if(inf_build(&s->lencode,length,19))
+        return -1;
+
+    i = 0;
+    while(i < nlen+ndist)
+    {
+        sym = inf_decode(s,&s->lencode);
+        if(sym < 0)
+            return -1;
+        if(sym < 16)
+        {
+            length[i++] = sym;
+            continue;
+        }
+        len = 0;
+        if(sym == 16)
+        {
+            if(!i)
+                return -1;
+            len = length[i-1];
+            rep = 3+inf_bits(s,2);
+        }
+        else if(sym == 17)
+            rep = 3+inf_bits(s,3);
+        else
+            rep = 11+inf_bits(s,7);
+        if(i+rep > nlen+ndist)
+            return -1;
+        while(rep--)
+            length[i++] = len;
+    }
+    if(!length[256])
+        return -1;
+
+    if(inf_build(&s->lencode,length,nlen) || inf_build(&s->distcode,length+nlen,ndist))
+        return -1;
+    return 0;
+}
+
+// Decode until end is reached or the stream ends.
+static int inflate_run(inf_state_t* s,uint32_t end)
+{
+    int last, type, ret;
+    do
+    {
+        last = inf_bits(s,1);
+        type = inf_bits(s,2);
+        if(type == 0)
+            ret = inf_stored(s,end);
+        else if(type == 1)
+            ret = inf_fixed(s) ? -1 : inf_codes(s,end);
+        else if(type == 2)
+            ret = inf_dynamic(s) ? -1 : inf_codes(s,end);
+        else
+            ret = -1;
+        if(ret)
+            return ret;
+        if(inf_overrun(s))
+            return -1;
+    }
+    while(!last);
+    return 0;
+}
+
+int zip_read(zipfile_t* z, zip_entry_t* e, uint8_t* dataptr, uint32_t load_size, uint32_t load_offset, int byteswap, int stride, uint32_t* fsize)
+{
+    inf_state_t* s;
+    uint8_t header[30];
+    uint32_t filesize = e->size;
+    uint32_t end;
+    int ret;
+
+    // filesize limit (for sanity checks)
+    if(fsize && *fsize != 0 && filesize > *fsize)
+        filesize = *fsize;
+
+    if(load_offset >= filesize)
+    {
+        sprintf(fileio_error,"Read offset (%d) exceeds file size (%d)\n",load_offset,filesize);
+        fputs(fileio_error,stderr);
+        return -1;
+    }
+
+    if(load_size == 0)
+        load_size = filesize;
+
+    if(load_size+load_offset > filesize)
+    {
+        sprintf(fileio_error,"Warning: Read length (%d) exceeds file size (%d)\n",load_size+load_offset,filesize);
+        fputs(fileio_error,stderr);
+        load_size = filesize - load_offset;
+    }
+
+    if(e->method != 0 && e->method != 8)
+        return zip_error("Unsupported compression method");
+
+    fseek(z->file,e->offset,SEEK_SET);
+    if(fread(header,1,30,z->file) != 30 || get32(header) != ZIP_LOCAL_SIG)
+        return zip_error("Bad local header");
+    fseek(z->file,e->offset+30+get16(header+26)+get16(header+28),SEEK_SET);
+
+    crc_init();
+    s = malloc(sizeof(*s));
+    if(!s)
+        return zip_error("Out of memory");
+    memset(s,0,sizeof(*s));
+    s->in = malloc(INF_INBUF);
+    s->window = malloc(INF_WINDOW);
+    if(!s->in || !s->window)
+    {
+        ret = zip_error("Out of memory");
+        goto done;
+    }
+    s->file = z->file;
+    s->remain = e->csize;
+    s->start = load_offset;
+    s->length = load_size;
+    s->dest = dataptr;
+    s->byteswap = byteswap;
+    s->stride = stride;
+    s->crc = 0xffffffff;
+    end = load_offset+load_size;
+
+    if(e->method == 0)
+    {
+        // stored. no point in decoding before the requested data
+        fseek(z->file,load_offset,SEEK_CUR);
+        s->remain = load_size;
+        s->pos = load_offset;
+        while(s->pos < end)
+            inf_put(s,inf_bits(s,8));
+        ret = inf_overrun(s) ? zip_error("Unexpected end of file") : 0;
+    }
+    else
+    {
+        ret = inflate_run(s,end);
+        if(ret < 0 || inf_overrun(s))
+            ret = zip_error("Bad compressed data");
+        else if(s->pos < end)
+            ret = zip_error("Unexpected end of file");
+        else if(ret == 0 && s->pos == e->size && (s->crc^0xffffffff) != e->crc)
+            ret = zip_error("CRC error");
+        else
+            ret = 0;
+    }
+
+    if(!ret && fsize)
+        *fsize = load_size;
+
+done:
+    free(s->in);
+    free(s->window);
+    free(s);
+    return ret;
+}
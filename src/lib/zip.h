@@ -0,0 +1,41 @@
+/*
+    Zip file reader
+
+    Reads stored and deflated files from zip archives (e.g. MAME ROM sets)
+    without extracting them first.
+*/
+#ifndef ZIP_H_INCLUDED
+#define ZIP_H_INCLUDED
+
+#include <stdio.h>
+#include <stdint.h>
+
+typedef struct {
+    char name[256];
+    uint16_t method;
+    uint32_t crc;
+    uint32_t csize;     // compressed size
+    uint32_t size;
+    uint32_t offset;    // local header offset
+} zip_entry_t;
+
+typedef struct {
+    FILE* file;
+    int count;
+    zip_entry_t* entry;
+} zipfile_t;
+
+// Open and read the central directory. Returns -1 on error, the message is
+// in fileio_error.
+int zip_open(zipfile_t* z, const char* filename);
+void zip_close(zipfile_t* z);
+
+// Find a file (case insensitive). Returns NULL if not found.
+zip_entry_t* zip_find(zipfile_t* z, const char* name);
+
+// Read part of a file, with the same parameters as read_file. Byte n of the
+// output is written to dataptr[n*stride], so interleaved roms can be loaded
+// directly. Decompression stops after the last requested byte.
+int zip_read(zipfile_t* z, zip_entry_t* e, uint8_t* dataptr, uint32_t load_size, uint32_t load_offset, int byteswap, int stride, uint32_t* fsize);
+
+#endif // ZIP_H_INCLUDED
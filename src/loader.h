@@ -3,8 +3,22 @@
 
 #include <stdint.h>
 
+#include "lib/vgm.h"
+
 #define GAME_CONFIG_MAX 256
 
+// sound data and wave rom buffer sizes
+#define GAME_DATA_MAX 0x800000
+#define GAME_WAVE_MAX 0x1000000
+
+// size of driver specific info saved in the game cache
+#define GAME_DRIVER_INFO_MAX 1024
+
+// playlist waits for this many seconds of silence before advancing
+#define GAME_SILENCE_TIME 0.1
+// or this many seconds after the song has stopped
+#define GAME_SILENCE_TIMEOUT 5
+
 typedef struct {
     int cnt;
     uint16_t reg[32];
@@ -42,12 +56,21 @@ typedef struct {
 
     //Q_State *QDrv;
 
+    // game cache (see gamecache.h)
+    char CachePath[256]; // empty = disabled
+    int Cached; // Data and WaveData are mapped from the cache
+    void *CacheSave; // sources for a new cache file
+    uint64_t DriverInfo[GAME_DRIVER_INFO_MAX/8];
+    int DriverInfoSize;
+
     // audio configuration
     char AudioDevice[256];
     int AudioBuffer;
+    int LowLatency; // use a QPAUDIO_LOW_LATENCY_BUFFER buffer
 
     // Global configuration
     int WavLog;
+    int WavFormat; // WAV_FLOAT, WAV_PCM16 or WAV_PCM24
     int VgmLog;
     int AutoPlay;
     int PortaFix;
@@ -77,13 +100,18 @@ typedef struct {
     int QueueSong;
     int QueueAction;
     int ActionTimer;
+
+    vgmfile_t Vgm;
 } QP_Game;
 
-int LoadGame(QP_Game *Game);
-int UnloadGame(QP_Game *Game);
+struct QP_DriverInterface;
 
-int  InitGame(QP_Game *Game);
-void DeInitGame(QP_Game *Game);
+// Load game ini and sound data, and create the sound driver.
+// Does not use any globals, error messages are written to msg.
+int QP_GameLoad(QP_Game *G,struct QP_DriverInterface *di,const char* inipath,const char* datapath,const char* wavepath,char* msg,int msglen);
+void QP_GameUnload(QP_Game *G,struct QP_DriverInterface *di);
+// Playlist title of a song (0x800 set = slot 8), or NULL if not found.
+const char* QP_GameSongTitle(QP_Game *G,int songid);
 
 void GameDoAction(QP_Game *G,unsigned int actionid);
 void GameDoUpdate(QP_Game *G);
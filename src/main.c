@@ -10,6 +10,8 @@
 #include "lib/vgm.h"
 #include "lib/audit.h"
 #include "lib/ini.h"
+#include "lib/wav.h"
+#include "lib/trace.h"
 
 #include "ui/ui.h"
 
@@ -22,6 +24,9 @@ inipath  = ini\n\
 datapath = roms\n\
 ; Path to directory containing sample ROMs (subdirectory for each game)\n\
 wavepath = roms\n\
+; Path to game cache directory. Loaded games are saved here, so that they\n\
+; load faster the next time. Leave commented to disable.\n\
+; cachepath = cache\n\
 ; Default gain. This is multiplied with a game-specific setting.\n\
 gain     = 32.0\n\
 ; Default game name. Used if the game name is not supplied through command\n\
@@ -41,6 +46,14 @@ portafix = 0\n\
 ; Audio buffer size (default = 2048)\n\
 ; Set it to a higher value if you encounter audio issues.\n\
 audiobuffer = 2048\n\
+; Low latency mode, uses a small audio buffer so that song requests are heard\n\
+; sooner. Overrides audiobuffer. May cause dropouts on slower systems.\n\
+lowlatency = 0\n\
+; Memory for recently played games, in MB. These are kept loaded so that\n\
+; switching between games is faster.\n\
+gamememory = 256\n\
+; WAV log format: float, 16, 24, flac16 or flac24 (integer formats are dithered)\n\
+wavformat = float\n\
 ; Audio device name (https://wiki.libsdl.org/SDL_GetAudioDeviceName)\n\
 ; Leave this intact for now\n\
 ; audiodevice =\n";
@@ -49,6 +62,10 @@ int main(int argc, char *argv[])
 {
     int loop = 0;
     int val = 0;
+    int idx = -1;
+    size_t memory = 256;
+    char name[256];
+    QP_Game *config;
     SDL_Init(SDL_INIT_AUDIO|SDL_INIT_VIDEO|SDL_INIT_TIMER);
 
     Audio = (QP_Audio*)malloc(sizeof(QP_Audio));
@@ -60,11 +77,16 @@ int main(int argc, char *argv[])
     Audit = (QP_Audit*)malloc(sizeof(QP_Audit));
     memset(Audit,0,sizeof(QP_Audit));
 
+    GameManager = (QP_GameManager*)malloc(sizeof(QP_GameManager));
+
     DriverInterface=0;
 
-    if(!Audio || !Game)
+    if(!Audio || !Game || !Audit || !GameManager)
         return -1;
 
+    // Game points to the active game later, this is the global configuration.
+    config = Game;
+
     Game->AutoPlay = -1;
 
     Game->MuteRear=0;
@@ -101,6 +123,8 @@ int main(int argc, char *argv[])
                     strcpy(QP_WavePath,initest.value);
                 else if(!strcmp(initest.key,"datapath"))
                     strcpy(QP_DataPath,initest.value);
+                else if(!strcmp(initest.key,"cachepath"))
+                    strcpy(Game->CachePath,initest.value);
                 else if(!strcmp(initest.key,"gamename"))
                     strcpy(Game->Name,initest.value);
                 else if(!strcmp(initest.key,"gain"))
@@ -113,6 +137,12 @@ int main(int argc, char *argv[])
                     strcpy(Game->AudioDevice,initest.value);
                 else if(!strcmp(initest.key,"audiobuffer"))
                     Game->AudioBuffer = atoi(initest.value);
+                else if(!strcmp(initest.key,"lowlatency"))
+                    Game->LowLatency = atoi(initest.value);
+                else if(!strcmp(initest.key,"gamememory"))
+                    memory = atoi(initest.value);
+                else if(!strcmp(initest.key,"wavformat") && wav_format(initest.value) >= 0)
+                    Game->WavFormat = wav_format(initest.value);
             }
         }
         ini_close(&initest);
@@ -168,11 +198,15 @@ int main(int argc, char *argv[])
         return -1;
     }
 
+    QP_GameManagerInit(GameManager,config,memory<<20);
+
+    strcpy(name,config->Name);
     while(1)
     {
         if(val == -1)
         {
-            strcpy(Game->Name,QP_DragDropPath);
+            strcpy(name,QP_DragDropPath);
+            idx = -1;
         }
         else if(loop)
         {
@@ -180,35 +214,48 @@ int main(int argc, char *argv[])
             if(!val)
                 break;
             if(val == -1)
-                strcpy(Game->Name,QP_DragDropPath);
+            {
+                strcpy(name,QP_DragDropPath);
+                idx = -1;
+            }
             else
-                strcpy(Game->Name,Audit->Entry[--val].Name);
+            {
+                idx = val-1;
+                strcpy(name,Audit->Entry[idx].Name);
+            }
         }
-        val = (LoadGame(Game) || InitGame(Game));
+        val = (QP_GameManagerActivate(GameManager,name) != 0);
         if(!val)
         {
             QP_AudioSetPause(Audio,0);
             Audio->state.UpdateRequest = QPAUDIO_CHIP_PLAY|QPAUDIO_DRV_PLAY;
 
-            val = ui_main(loop ? SCR_PLAYLIST : SCR_MAIN);
-
-            QP_AudioClose(Audio);
+            // the next game in the list is likely to be played next
+            if(loop && idx >= 0 && idx+1 < Audit->Count)
+                QP_GameManagerPreload(GameManager,Audit->Entry[idx+1].Name);
 
-            // Audio must be closed or locked before calling this
-            DeInitGame(Game);
+            // The game keeps playing in the select screen, until another
+            // game is activated.
+            val = ui_main(loop ? SCR_PLAYLIST : SCR_MAIN);
         }
-        UnloadGame(Game);
 
         if(val != -1 && !loop)
             break;
     }
 
+    // Audio is closed here
+    QP_GameManagerDeinit(GameManager);
+
+    if(TRACE_WRITE("qp_trace.json"))
+        printf("Could not write qp_trace.json\n");
+
     ui_deinit();
     SDL_Quit();
 
+    free(GameManager);
     free(Audit);
     free(Audio);
-    free(Game);
+    free(config);
 
     return 0;
 }
@@ -0,0 +1,600 @@
+/*
+    Player library
+
+    Wraps the game loader and sound driver interface in a context object
+    instead of the globals used by the SDL frontend.
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "quattroplay.h"
+
+#include "driver.h"
+#include "loader.h"
+#include "gamecache.h"
+#include "render.h"
+#include "lib/wav.h"
+
+struct QP_Player {
+    QP_Game Game;
+    struct QP_DriverInterface Driver;
+    int Loaded;
+
+    char DataPath[256];
+    char WavePath[256];
+    char CachePath[256];
+    char Error[1024];
+
+    int SampleRate;
+    float Gain;
+    uint64_t ContentHash; // data and wave images, 0 = not computed yet
+
+    QP_Render Render;
+
+    wavfile_t* File;
+    int FileChannels;
+
+    // stems, see QP_PlayerSetStemMode
+    int StemCount;
+    float* Stems;
+    float* StemPair;
+    wavfile_t** StemFile;
+    int StemFileCount;
+
+    // extra outputs at other rates, fed from the chip output
+    wavfile_t* Sink[QP_MAX_SINKS];
+    int SinkChannels[QP_MAX_SINKS];
+    float SinkBuffer[RENDER_BUFFER*4];
+};
+
+QP_Player* QP_PlayerCreate(const char* datapath,const char* wavepath)
+{
+    QP_Player* p = (QP_Player*)malloc(sizeof(QP_Player));
+    if(!p)
+        return NULL;
+    memset(p,0,sizeof(QP_Player));
+
+    snprintf(p->DataPath,sizeof(p->DataPath),"%s",datapath ? datapath : ".");
+    snprintf(p->WavePath,sizeof(p->WavePath),"%s",wavepath ? wavepath : ".");
+    p->Gain = 1.0;
+    return p;
+}
+
+void QP_PlayerDestroy(QP_Player* p)
+{
+    if(!p)
+        return;
+    QP_PlayerClose(p);
+    free(p);
+}
+
+int QP_PlayerOpen(QP_Player* p,const char* inifile,int samplerate)
+{
+    QP_Game *G = &p->Game;
+    struct QP_DriverInterface *di = &p->Driver;
+
+    QP_PlayerClose(p);
+    memset(G,0,sizeof(QP_Game));
+    p->Error[0] = 0;
+
+    // defaults, same as the frontend.
+    G->AutoPlay = -1;
+    G->BaseGain = 32.0;
+    G->Gain = 1.0;
+    snprintf(G->Name,sizeof(G->Name),"%s",inifile);
+    strcpy(G->CachePath,p->CachePath);
+
+    if(QP_GameLoad(G,di,".",p->DataPath,p->WavePath,p->Error,sizeof(p->Error)))
+    {
+        QP_GameUnload(G,di);
+        return -1;
+    }
+    if(di->IInit(di->Driver,G))
+    {
+        snprintf(p->Error,sizeof(p->Error),"Failed to initialize driver");
+        QP_GameUnload(G,di);
+        return -1;
+    }
+    di->IReset(di->Driver,G,1);
+    // the rear output is dropped when MuteRear is set, so it must also be
+    // left out of the stems
+    if(di->ISetQuality)
+        di->ISetQuality(di->Driver,G->MuteRear ? QUALITY_NO_REAR : 0);
+    QP_GameCacheSave(G);
+
+    p->Loaded = 1;
+    p->ContentHash = 0;
+    p->SampleRate = samplerate ? samplerate : (int)di->IChipRate(di->Driver);
+    QP_RenderInit(&p->Render);
+    QP_RenderSetDriver(&p->Render,di,p->SampleRate);
+    return 0;
+}
+
+void QP_PlayerClose(QP_Player* p)
+{
+    int i;
+    QP_PlayerFileClose(p);
+    QP_PlayerSetStemMode(p,-1);
+    for(i=0;i<QP_MAX_SINKS;i++)
+        QP_PlayerSinkClose(p,i);
+    if(!p->Loaded)
+        return;
+    p->Driver.IDeinit(p->Driver.Driver);
+    QP_GameUnload(&p->Game,&p->Driver);
+    p->Loaded = 0;
+}
+
+void QP_PlayerSetCachePath(QP_Player* p,const char* cachepath)
+{
+    snprintf(p->CachePath,sizeof(p->CachePath),"%s",cachepath ? cachepath : "");
+}
+
+const char* QP_PlayerGetError(QP_Player* p)
+{
+    return p->Error;
+}
+
+const char* QP_PlayerGetTitle(QP_Player* p)
+{
+    return p->Game.Title;
+}
+
+int QP_PlayerGetSampleRate(QP_Player* p)
+{
+    return p->SampleRate;
+}
+
+void QP_PlayerSetGain(QP_Player* p,float gain)
+{
+    p->Gain = gain;
+}
+
+int QP_PlayerGetSlotCount(QP_Player* p)
+{
+    if(!p->Loaded)
+        return 0;
+    return p->Driver.IRequestSlotCnt(p->Driver.Driver);
+}
+
+int QP_PlayerGetSongCount(QP_Player* p,int slot)
+{
+    if(!p->Loaded)
+        return 0;
+    return p->Driver.ISongCnt(p->Driver.Driver,slot);
+}
+
+void QP_PlayerRequestSong(QP_Player* p,int slot,int id)
+{
+    if(!p->Loaded)
+        return;
+    p->Driver.IResetLoopCnt(p->Driver.Driver);
+    p->Driver.ISongRequest(p->Driver.Driver,slot,id);
+    char songid[16];
+    const char* title = QP_GameSongTitle(&p->Game,(slot == 8 ? 0x800 : 0) | id);
+    snprintf(songid,sizeof(songid),"0x%03x",id);
+    QP_PlayerFileTag(p,"SONGID",songid);
+    if(title)
+        QP_PlayerFileTag(p,"TITLE",title);
+}
+
+void QP_PlayerTriggerSong(QP_Player* p,int slot,int id)
+{
+    if(!p->Loaded)
+        return;
+    QP_PlayerRequestSong(p,slot,id);
+    QP_RenderTriggerTick(&p->Render);
+}
+
+void QP_PlayerStopSong(QP_Player* p,int slot)
+{
+    if(!p->Loaded)
+        return;
+    p->Driver.ISongStop(p->Driver.Driver,slot);
+}
+
+void QP_PlayerFadeOutSong(QP_Player* p,int slot)
+{
+    if(!p->Loaded)
+        return;
+    p->Driver.ISongFade(p->Driver.Driver,slot);
+}
+
+int QP_PlayerGetSongStatus(QP_Player* p,int slot)
+{
+    if(!p->Loaded)
+        return 0;
+    return p->Driver.ISongStatus(p->Driver.Driver,slot);
+}
+
+double QP_PlayerGetPlayingTime(QP_Player* p,int slot)
+{
+    if(!p->Loaded)
+        return 0;
+    return p->Driver.ISongTime(p->Driver.Driver,slot);
+}
+
+int QP_PlayerGetLoopCount(QP_Player* p,int slot)
+{
+    if(!p->Loaded)
+        return 0;
+    return p->Driver.IGetLoopCnt(p->Driver.Driver,slot);
+}
+
+// Same update logic as QP_AudioCallback
+int QP_PlayerRender(QP_Player* p,float* out,int frames,int channels)
+{
+    return QP_PlayerRenderStems(p,out,frames,channels,NULL);
+}
+
+// Write one batch of stems to the stem files.
+static void player_write_stems(QP_Player* p,const float* stems,int frames)
+{
+    int i,k;
+    if(p->StemFileCount == 1)
+    {
+        wav_write_wait(p->StemFile[0],stems,frames);
+        return;
+    }
+    for(i=0;i<p->StemFileCount;i++)
+    {
+        for(k=0;k<frames;k++)
+        {
+            p->StemPair[k*2] = stems[(k*p->StemCount+i)*2];
+            p->StemPair[k*2+1] = stems[(k*p->StemCount+i)*2+1];
+        }
+        wav_write_wait(p->StemFile[i],p->StemPair,frames);
+    }
+}
+
+int QP_PlayerRenderStems(QP_Player* p,float* out,int frames,int channels,float* stems)
+{
+    float chip[RENDER_BATCH*4];
+    float* ChipOut;
+    float* StemOut;
+    float gain;
+    int i,k,n;
+
+    if(!p->Loaded || (channels != 1 && channels != 2 && channels != 4))
+        return 0;
+
+    gain = p->Game.BaseGain*p->Game.Gain*p->Gain;
+    if(channels != 4)
+        gain /= 2;
+
+    for(i=0;i<frames;i+=n)
+    {
+        StemOut = p->StemCount ? p->Stems : NULL;
+        n = QP_RenderRunStems(&p->Render,chip,StemOut,frames-i,QP_RENDER_TICK|QP_RENDER_CHIP,p->Game.MuteRear ? 2 : 4);
+        if(StemOut)
+        {
+            // same gain as the stereo output, so the stems add up to it
+            float sgain = p->Game.BaseGain*p->Game.Gain*p->Gain/2;
+            for(k=0;k<n*2*p->StemCount;k++)
+                StemOut[k] *= sgain;
+            if(stems)
+            {
+                memcpy(stems,StemOut,n*2*p->StemCount*sizeof(float));
+                stems += n*2*p->StemCount;
+            }
+            if(p->StemFileCount)
+                player_write_stems(p,StemOut,n);
+        }
+        for(k=0;k<n;k++)
+        {
+            ChipOut = chip+k*4;
+            if(channels==1)
+                *out = gain*(ChipOut[0]+ChipOut[1]+ChipOut[2]+ChipOut[3]);
+            else if(channels==2)
+            {
+                out[0] = gain*(ChipOut[0]+ChipOut[2]);
+                out[1] = gain*(ChipOut[1]+ChipOut[3]);
+            }
+            else
+            {
+                out[0] = gain*ChipOut[0];
+                out[1] = gain*ChipOut[1];
+                out[2] = gain*ChipOut[2];
+                out[3] = gain*ChipOut[3];
+            }
+            out += channels;
+        }
+    }
+    if(p->File && channels == p->FileChannels)
+        wav_write_wait(p->File,out-frames*channels,frames);
+    return frames;
+}
+
+int QP_PlayerFileOpen(QP_Player* p,const char* filename,int format,int channels)
+{
+    QP_PlayerFileClose(p);
+    if(!p->Loaded)
+        return -1;
+    p->File = wav_open(filename,channels,p->SampleRate,format);
+    if(!p->File)
+    {
+        snprintf(p->Error,sizeof(p->Error),"Failed to open %s",filename);
+        return -1;
+    }
+    p->FileChannels = channels;
+    wav_tag(p->File,"ALBUM",p->Game.Title);
+    return 0;
+}
+
+void QP_PlayerFileTag(QP_Player* p,const char* key,const char* value)
+{
+    int i;
+    if(p->File)
+        wav_tag(p->File,key,value);
+    for(i=0;i<QP_MAX_SINKS;i++)
+    {
+        if(p->Sink[i])
+            wav_tag(p->Sink[i],key,value);
+    }
+}
+
+int QP_PlayerFileClose(QP_Player* p)
+{
+    int error;
+    if(!p->File)
+        return 0;
+    error = wav_close(p->File);
+    p->File = NULL;
+    if(error)
+        snprintf(p->Error,sizeof(p->Error),"Failed to write the output file");
+    return error;
+}
+
+// Render chip callback, converts the chip output to the channel layout of
+// each sink. The sink writer threads do the resampling.
+static void player_sink_out(void* data,const float* chip,int frames,int channels)
+{
+    QP_Player* p = data;
+    float gain = p->Game.BaseGain*p->Game.Gain*p->Gain;
+    float* out;
+    int i,k;
+
+    for(i=0;i<QP_MAX_SINKS;i++)
+    {
+        if(!p->Sink[i])
+            continue;
+        out = p->SinkBuffer;
+        for(k=0;k<frames;k++)
+        {
+            const float* c = chip+k*channels;
+            float rl = channels == 4 ? c[2] : 0;
+            float rr = channels == 4 ? c[3] : 0;
+            switch(p->SinkChannels[i])
+            {
+            case 1:
+                *out++ = gain/2*(c[0]+c[1]+rl+rr);
+                break;
+            case 2:
+                *out++ = gain/2*(c[0]+rl);
+                *out++ = gain/2*(c[1]+rr);
+                break;
+            default:
+                *out++ = gain*c[0];
+                *out++ = gain*c[1];
+                *out++ = gain*rl;
+                *out++ = gain*rr;
+                break;
+            }
+        }
+        wav_write_wait(p->Sink[i],p->SinkBuffer,frames);
+    }
+}
+
+int QP_PlayerSinkOpen(QP_Player* p,const char* filename,int format,int samplerate,int channels)
+{
+    double rate;
+    int i;
+
+    if(!p->Loaded || (channels != 1 && channels != 2 && channels != 4))
+        return -1;
+    for(i=0;i<QP_MAX_SINKS;i++)
+    {
+        if(!p->Sink[i])
+            break;
+    }
+    if(i == QP_MAX_SINKS)
+    {
+        snprintf(p->Error,sizeof(p->Error),"Too many outputs");
+        return -1;
+    }
+
+    rate = p->Driver.IChipRate(p->Driver.Driver);
+    if(!samplerate)
+        samplerate = (int)rate;
+    // no resampling if only the fraction is different
+    if((int)rate == samplerate)
+        rate = samplerate;
+    p->Sink[i] = wav_open_resample(filename,channels,samplerate,format,rate);
+    if(!p->Sink[i])
+    {
+        snprintf(p->Error,sizeof(p->Error),"Failed to open %s",filename);
+        return -1;
+    }
+    p->SinkChannels[i] = channels;
+    wav_tag(p->Sink[i],"ALBUM",p->Game.Title);
+    p->Render.ChipCallback = player_sink_out;
+    p->Render.ChipData = p;
+    return i;
+}
+
+int QP_PlayerSinkClose(QP_Player* p,int sink)
+{
+    int i,error;
+    if(sink < 0 || sink >= QP_MAX_SINKS || !p->Sink[sink])
+        return 0;
+    error = wav_close(p->Sink[sink]);
+    p->Sink[sink] = NULL;
+    if(error)
+        snprintf(p->Error,sizeof(p->Error),"Failed to write output %d",sink);
+    for(i=0;i<QP_MAX_SINKS;i++)
+    {
+        if(p->Sink[i])
+            return error;
+    }
+    p->Render.ChipCallback = NULL;
+    return error;
+}
+
+int QP_PlayerSetStemMode(QP_Player* p,int mode)
+{
+    QP_PlayerStemFileClose(p);
+    free(p->Stems);
+    free(p->StemPair);
+    p->Stems = NULL;
+    p->StemPair = NULL;
+    p->StemCount = 0;
+    if(!p->Loaded)
+        return 0;
+
+    p->StemCount = QP_RenderSetStems(&p->Render,mode);
+    if(p->StemCount)
+    {
+        p->Stems = malloc(RENDER_BATCH*2*p->StemCount*sizeof(float));
+        p->StemPair = malloc(RENDER_BATCH*2*sizeof(float));
+        if(!p->Stems || !p->StemPair)
+            return QP_PlayerSetStemMode(p,-1);
+    }
+    return p->StemCount;
+}
+
+int QP_PlayerStemFileOpen(QP_Player* p,const char* basename,int format,int single)
+{
+    static const char* prefix[] = {"voice","track","chip"};
+    const char* name = prefix[p->Render.StemMode];
+    char filename[512];
+    int i;
+
+    QP_PlayerStemFileClose(p);
+    if(!p->StemCount)
+    {
+        snprintf(p->Error,sizeof(p->Error),"Stems are not enabled");
+        return -1;
+    }
+
+    p->StemFileCount = single ? 1 : p->StemCount;
+    p->StemFile = calloc(p->StemFileCount,sizeof(wavfile_t*));
+    if(!p->StemFile)
+    {
+        p->StemFileCount = 0;
+        return -1;
+    }
+    for(i=0;i<p->StemFileCount;i++)
+    {
+        if(single)
+            snprintf(filename,sizeof(filename),"%s_%s.%s",basename,name,wav_extension(format));
+        else
+            snprintf(filename,sizeof(filename),"%s_%s%02d.%s",basename,name,i,wav_extension(format));
+        p->StemFile[i] = wav_open(filename,single ? 2*p->StemCount : 2,p->SampleRate,format);
+        if(!p->StemFile[i])
+        {
+            snprintf(p->Error,sizeof(p->Error),"Failed to open %s",filename);
+            QP_PlayerStemFileClose(p);
+            return -1;
+        }
+        wav_tag(p->StemFile[i],"ALBUM",p->Game.Title);
+    }
+    return 0;
+}
+
+int QP_PlayerStemFileClose(QP_Player* p)
+{
+    int i,error = 0;
+    if(!p->StemFile)
+        return 0;
+    for(i=0;i<p->StemFileCount;i++)
+    {
+        if(wav_close(p->StemFile[i]))
+            error = -1;
+    }
+    free(p->StemFile);
+    p->StemFile = NULL;
+    p->StemFileCount = 0;
+    if(error)
+        snprintf(p->Error,sizeof(p->Error),"Failed to write the stem files");
+    return error;
+}
+
+// FNV-1a, 8 bytes at a time
+static uint64_t player_hash(uint64_t hash,const void* data,size_t size)
+{
+    const uint8_t* d = data;
+    uint64_t w;
+    for(;size >= 8;size -= 8,d += 8)
+    {
+        memcpy(&w,d,8);
+        hash = (hash ^ w) * 0x100000001b3ULL;
+    }
+    for(;size;size--)
+        hash = (hash ^ *d++) * 0x100000001b3ULL;
+    return hash;
+}
+
+uint64_t QP_PlayerGetRenderKey(QP_Player* p,int songid,const void* options,int size)
+{
+    QP_Game* G = &p->Game;
+    int32_t v[8];
+    uint64_t hash;
+
+    if(!p->Loaded)
+        return 0;
+    // processed images, after byteswapping, interleaving and patches
+    if(!p->ContentHash)
+    {
+        p->ContentHash = player_hash(0xcbf29ce484222325ULL,G->Data,G->DataSize);
+        p->ContentHash = player_hash(p->ContentHash,G->WaveData,(size_t)G->WaveMask+1);
+    }
+
+    v[0] = QP_RENDER_KEY_VERSION;
+    v[1] = songid;
+    v[2] = G->PortaFix;
+    v[3] = G->BootSong;
+    v[4] = G->ChipFreq;
+    v[5] = G->MuteRear;
+    v[6] = p->SampleRate;
+    v[7] = 0;
+    hash = player_hash(p->ContentHash,v,sizeof(v));
+    hash = player_hash(hash,G->Type,strlen(G->Type));
+    hash = player_hash(hash,G->Action,sizeof(G->Action));
+    hash = player_hash(hash,G->Config,G->ConfigCount*sizeof(QP_GameConfig));
+    hash = player_hash(hash,&G->BaseGain,sizeof(G->BaseGain));
+    hash = player_hash(hash,&G->Gain,sizeof(G->Gain));
+    hash = player_hash(hash,&p->Gain,sizeof(p->Gain));
+    return player_hash(hash,options,size);
+}
+
+int QP_PlayerGetVoiceCount(QP_Player* p)
+{
+    if(!p->Loaded || !p->Driver.IGetVoiceCount)
+        return 0;
+    return p->Driver.IGetVoiceCount(p->Driver.Driver);
+}
+
+int QP_PlayerGetVoiceInfo(QP_Player* p,int voice,QP_PlayerVoiceInfo* vi)
+{
+    struct QP_DriverVoiceInfo dv;
+    int ret;
+
+    if(!p->Loaded || !p->Driver.IGetVoiceInfo)
+        return -1;
+
+    memset(&dv,0,sizeof(dv));
+    ret = p->Driver.IGetVoiceInfo(p->Driver.Driver,voice,&dv);
+
+    vi->Status = dv.Status;
+    vi->Track = dv.Track;
+    vi->Channel = dv.Channel;
+    vi->VoiceType = dv.VoiceType;
+    vi->Preset = dv.Preset;
+    vi->Key = dv.Key;
+    vi->Pitch = dv.Pitch;
+    vi->Volume = dv.Volume;
+    vi->VolumeMod = dv.VolumeMod;
+    vi->PanType = dv.PanType;
+    vi->Pan = dv.Pan;
+    return ret;
+}
@@ -15,6 +15,7 @@
 #include "driver.h"
 #include "audio.h"
 #include "loader.h"
+#include "gamemgr.h"
 #include "lib/audit.h"
 
     char QP_IniPath[128];
@@ -27,6 +28,8 @@
     QP_Game  *Game;
     QP_Audit *Audit;
 
+    QP_GameManager *GameManager;
+
     struct QP_DriverInterface *DriverInterface;
 
 #endif // QP_H_INCLUDED
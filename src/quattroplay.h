@@ -0,0 +1,148 @@
+/*
+    QuattroPlay player library
+
+    Each QP_Player is an independent instance with its own sound data, sound
+    driver and chip emulation. Instances do not share any state, so several
+    of them can be used from different threads. A single instance must not be
+    accessed from more than one thread at a time.
+
+    This header does not depend on the rest of the QuattroPlay source tree.
+*/
+#ifndef QUATTROPLAY_H_INCLUDED
+#define QUATTROPLAY_H_INCLUDED
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct QP_Player QP_Player;
+
+// Same values as SONG_STATUS_* in driver.h
+enum {
+    QP_SONG_STOPPING = 0x10000,
+    QP_SONG_PLAYING = 0x8000,
+    QP_SONG_STARTING = 0x4000,
+    QP_SONG_FADEOUT = 0x2000,
+};
+
+// Output file formats, same values as WAV_* in lib/wav.h
+enum {
+    QP_FILE_WAV_FLOAT = 0,
+    QP_FILE_WAV_16,
+    QP_FILE_WAV_24,
+    QP_FILE_FLAC_16,
+    QP_FILE_FLAC_24,
+};
+
+// Stem grouping for QP_PlayerSetStemMode
+enum {
+    QP_STEM_VOICE = 0, // each sound chip voice
+    QP_STEM_TRACK, // by the track that last used the voice, the last stem has unused voices
+    QP_STEM_CHIP, // by sound chip
+};
+
+typedef struct {
+    int Status; // bit 0 = active, bit 1 = playing
+    int Track;
+    int Channel;
+    int VoiceType;
+    int Preset;
+    int Key;
+    int Pitch;
+    int Volume;
+    int VolumeMod;
+    int PanType;
+    int Pan;
+} QP_PlayerVoiceInfo;
+
+// Create a player. datapath and wavepath are the default directories for
+// sound data and wave roms, the ini file directory is also searched.
+QP_Player* QP_PlayerCreate(const char* datapath,const char* wavepath);
+void QP_PlayerDestroy(QP_Player* p);
+
+// Load a game from an ini file. samplerate is the output rate for
+// QP_PlayerRender, 0 = use the sound chip rate.
+// Returns 0 if successful, otherwise see QP_PlayerGetError.
+int QP_PlayerOpen(QP_Player* p,const char* inifile,int samplerate);
+void QP_PlayerClose(QP_Player* p);
+// Directory for the game cache, which makes loading a game again much
+// faster. NULL or empty (default) = disabled.
+void QP_PlayerSetCachePath(QP_Player* p,const char* cachepath);
+const char* QP_PlayerGetError(QP_Player* p);
+
+const char* QP_PlayerGetTitle(QP_Player* p);
+int QP_PlayerGetSampleRate(QP_Player* p);
+void QP_PlayerSetGain(QP_Player* p,float gain);
+
+int QP_PlayerGetSlotCount(QP_Player* p);
+int QP_PlayerGetSongCount(QP_Player* p,int slot);
+void QP_PlayerRequestSong(QP_Player* p,int slot,int id);
+// Like QP_PlayerRequestSong, but runs a driver tick at the next rendered
+// frame instead of waiting for the next scheduled tick. To start a song at
+// an exact frame, render up to that frame first.
+void QP_PlayerTriggerSong(QP_Player* p,int slot,int id);
+void QP_PlayerStopSong(QP_Player* p,int slot);
+void QP_PlayerFadeOutSong(QP_Player* p,int slot);
+int QP_PlayerGetSongStatus(QP_Player* p,int slot);
+double QP_PlayerGetPlayingTime(QP_Player* p,int slot);
+int QP_PlayerGetLoopCount(QP_Player* p,int slot);
+
+// Render interleaved float samples. channels can be 1, 2 or 4 (front L/R,
+// rear L/R). Returns the number of frames rendered.
+int QP_PlayerRender(QP_Player* p,float* out,int frames,int channels);
+
+// Also write the output of QP_PlayerRender to a file. The file is written
+// on a separate thread, QP_PlayerRender waits for it if it falls behind.
+// channels must match the channels given to QP_PlayerRender.
+// The game title, and the ID and playlist title of the last requested
+// song are written as tags (FLAC only). Returns 0 if successful.
+int QP_PlayerFileOpen(QP_Player* p,const char* filename,int format,int channels);
+// Set a tag, replacing the default ones if the key is the same.
+void QP_PlayerFileTag(QP_Player* p,const char* key,const char* value);
+// Returns -1 if the file could not be written completely.
+int QP_PlayerFileClose(QP_Player* p);
+
+// Maximum number of QP_PlayerSinkOpen outputs
+#define QP_MAX_SINKS 8
+
+// Write the output to a file at a different sample rate, without rendering
+// the song again. The chip output is resampled to samplerate (0 = sound
+// chip rate) on the file's writer thread. channels can be 1, 2 or 4,
+// independent of QP_PlayerRender. Several sinks can be open at a time,
+// tags are set with QP_PlayerFileTag. Returns a sink number, or -1.
+int QP_PlayerSinkOpen(QP_Player* p,const char* filename,int format,int samplerate,int channels);
+// Returns -1 if the file could not be written completely.
+int QP_PlayerSinkClose(QP_Player* p,int sink);
+
+// Render stems (QP_STEM_ mode) at the same time as the normal output, -1 to
+// disable. Returns the number of stems, 0 if not supported.
+int QP_PlayerSetStemMode(QP_Player* p,int mode);
+// Same as QP_PlayerRender, and also writes a left/right pair for each stem
+// to stems (unless NULL). The stems add up to the 2 channel output.
+int QP_PlayerRenderStems(QP_Player* p,float* out,int frames,int channels,float* stems);
+// Write the stems to basename_voice00.wav, basename_voice01.wav, ... or
+// with single set, to one file with a channel pair for each stem (FLAC is
+// limited to 8 channels). Returns 0 if successful.
+int QP_PlayerStemFileOpen(QP_Player* p,const char* basename,int format,int single);
+// Returns -1 if any of the files could not be written completely.
+int QP_PlayerStemFileClose(QP_Player* p);
+
+// Changed when rendering changes, so that old cached renders aren't used.
+#define QP_RENDER_KEY_VERSION 1
+
+// Hash of everything that affects the rendered output of a song: the
+// processed sound data and wave roms, game configuration, sample rate and
+// gain, and the caller's own output options. Used as the key for cached
+// renders. songid has 0x800 set for slot 8.
+uint64_t QP_PlayerGetRenderKey(QP_Player* p,int songid,const void* options,int size);
+
+int QP_PlayerGetVoiceCount(QP_Player* p);
+int QP_PlayerGetVoiceInfo(QP_Player* p,int voice,QP_PlayerVoiceInfo* vi);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // QUATTROPLAY_H_INCLUDED
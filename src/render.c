@@ -0,0 +1,205 @@
+/*
+    Block renderer
+*/
+#include <stdlib.h>
+#include <string.h>
+
+#include "render.h"
+#include "lib/trace.h"
+
+void QP_RenderInit(QP_Render *r)
+{
+    memset(r,0,sizeof(QP_Render));
+}
+
+void QP_RenderSetDriver(QP_Render *r,struct QP_DriverInterface *di,double rate)
+{
+    r->Driver = di;
+    r->ChipDelta = di->IChipRate(di->Driver)/rate;
+    r->DriverDelta = di->ITickRate(di->Driver)/rate;
+}
+
+void QP_RenderChip(struct QP_DriverInterface *di,float *out,int frames,int channels)
+{
+    if(di->IRender)
+    {
+        di->IRender(di->Driver,out,frames,channels);
+        return;
+    }
+    while(frames--)
+    {
+        di->IUpdateChip(di->Driver);
+        di->ISampleChip(di->Driver,out,channels);
+        out += channels;
+    }
+}
+
+void QP_RenderTriggerTick(QP_Render *r)
+{
+    r->TickNow = 1;
+}
+
+int QP_RenderSetStems(QP_Render *r,int mode)
+{
+    struct QP_DriverInterface *di = r->Driver;
+    int count = 0;
+
+    free(r->StemBuffer);
+    free(r->StemOut);
+    r->StemBuffer = NULL;
+    r->StemOut = NULL;
+    r->StemCount = 0;
+
+    if(mode >= 0 && di && di->IStemCount && di->IRenderStems)
+        count = di->IStemCount(di->Driver,mode);
+    if(count)
+    {
+        r->StemBuffer = malloc(RENDER_BUFFER*2*count*sizeof(float));
+        r->StemOut = calloc(2*count,sizeof(float));
+        if(!r->StemBuffer || !r->StemOut)
+            return QP_RenderSetStems(r,-1);
+        r->StemMode = mode;
+        r->StemCount = count;
+    }
+    return count;
+}
+
+static void render_chip_block(QP_Render *r,int frames,int chipchannels)
+{
+    struct QP_DriverInterface *di = r->Driver;
+    TRACE_BEGIN_ARG("chip update","frames",frames);
+    if(r->StemCount)
+        di->IRenderStems(di->Driver,r->Buffer,frames,chipchannels,r->StemBuffer,r->StemMode);
+    else
+        QP_RenderChip(di,r->Buffer,frames,chipchannels);
+    if(r->ChipCallback)
+        r->ChipCallback(r->ChipData,r->Buffer,frames,chipchannels);
+    TRACE_END("chip update");
+}
+
+// Resample chip output for n output samples.
+static void render_chip(QP_Render *r,float *out,float *stems,int n,int chipchannels)
+{
+    int index[RENDER_BATCH];
+    int j,k,k0,c,cnt;
+    double update;
+    float *src;
+
+    k=0;
+    while(k<n)
+    {
+        // count chip samples for each output sample until the buffer is full
+        k0=k;
+        cnt=0;
+        while(k<n)
+        {
+            c=0;
+            update = r->ChipUpdate+r->ChipDelta;
+            while(update > 1)
+            {
+                update-=1;
+                c++;
+            }
+            if(k>k0 && cnt+c > RENDER_BUFFER)
+                break;
+            r->ChipUpdate = update;
+            cnt+=c;
+            index[k++] = cnt;
+        }
+
+        // only happens if the chip rate is very high
+        while(cnt > RENDER_BUFFER)
+        {
+            render_chip_block(r,RENDER_BUFFER,chipchannels);
+            cnt -= RENDER_BUFFER;
+            index[k0] -= RENDER_BUFFER;
+        }
+        if(cnt)
+            render_chip_block(r,cnt,chipchannels);
+
+        for(;k0<k;k0++)
+        {
+            if(index[k0])
+            {
+                src = r->Buffer+(index[k0]-1)*chipchannels;
+                for(j=0;j<chipchannels;j++)
+                    r->ChipOut[j] = src[j];
+                if(r->StemCount)
+                    memcpy(r->StemOut,r->StemBuffer+(index[k0]-1)*2*r->StemCount,2*r->StemCount*sizeof(float));
+            }
+            for(j=0;j<chipchannels;j++)
+                out[j] = r->ChipOut[j];
+            for(;j<4;j++)
+                out[j] = 0;
+            out += 4;
+            if(stems)
+            {
+                memcpy(stems,r->StemOut,2*r->StemCount*sizeof(float));
+                stems += 2*r->StemCount;
+            }
+        }
+    }
+}
+
+// Same result as updating the driver and chip sample by sample, but chip
+// updates are done in blocks between driver ticks.
+int QP_RenderRun(QP_Render *r,float *out,int frames,int flags,int chipchannels)
+{
+    return QP_RenderRunStems(r,out,NULL,frames,flags,chipchannels);
+}
+
+int QP_RenderRunStems(QP_Render *r,float *out,float *stems,int frames,int flags,int chipchannels)
+{
+    struct QP_DriverInterface *di = r->Driver;
+    int n;
+    double update;
+
+    if(frames > RENDER_BATCH)
+        frames = RENDER_BATCH;
+    if(frames < 1)
+        return 0;
+
+    n = frames;
+    if(flags & QP_RENDER_TICK)
+    {
+        if(r->TickNow)
+            r->DriverUpdate = 1.0;
+        r->TickNow = 0;
+        r->DriverUpdate += r->DriverDelta;
+        while(r->DriverUpdate > 1)
+        {
+            if(r->PreTickCallback)
+                r->PreTickCallback(r->TickData);
+            TRACE_BEGIN("driver tick");
+            di->IUpdateTick(di->Driver);
+            TRACE_END("driver tick");
+            r->DriverUpdate-=1;
+            if(r->TickCallback)
+            {
+                TRACE_BEGIN("tick callback");
+                r->TickCallback(r->TickData);
+                TRACE_END("tick callback");
+            }
+        }
+
+        // find how many samples until the next tick
+        n = 1;
+        update = r->DriverUpdate;
+        while(n < frames && update+r->DriverDelta <= 1)
+        {
+            update += r->DriverDelta;
+            n++;
+        }
+        r->DriverUpdate = update;
+    }
+
+    if(flags & QP_RENDER_CHIP)
+        render_chip(r,out,r->StemCount ? stems : NULL,n,chipchannels);
+    else
+    {
+        memset(out,0,n*4*sizeof(float));
+        if(stems)
+            memset(stems,0,n*2*r->StemCount*sizeof(float));
+    }
+    return n;
+}
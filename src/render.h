@@ -0,0 +1,81 @@
+/*
+    Block renderer
+
+    Schedules driver ticks and sound chip updates for a block of output
+    samples, and resamples the chip output to the output rate.
+*/
+#ifndef RENDER_H_INCLUDED
+#define RENDER_H_INCLUDED
+
+#include "driver.h"
+
+// maximum output samples per QP_RenderRun call
+#define RENDER_BATCH 256
+// chip rate buffer size, in frames
+#define RENDER_BUFFER 1024
+
+enum {
+    QP_RENDER_TICK = 1, // update sound driver
+    QP_RENDER_CHIP = 2, // update sound chip
+};
+
+typedef struct QP_Render QP_Render;
+
+struct QP_Render
+{
+    struct QP_DriverInterface *Driver;
+
+    double ChipDelta;   // chip samples per output sample
+    double DriverDelta; // driver ticks per output sample
+    double ChipUpdate;
+    double DriverUpdate;
+    int TickNow; // see QP_RenderTriggerTick
+
+    float ChipOut[4];   // last chip output
+
+    // called before each driver tick
+    void (*PreTickCallback)(void *data);
+    // called after each driver tick
+    void (*TickCallback)(void *data);
+    void *TickData;
+    // called with each block of chip output, at the chip rate
+    void (*ChipCallback)(void *data,const float *out,int frames,int channels);
+    void *ChipData;
+
+    float Buffer[RENDER_BUFFER*4];
+
+    // stem output, see QP_RenderSetStems
+    int StemMode;
+    int StemCount;
+    float *StemBuffer; // at the chip rate
+    float *StemOut; // last chip output
+};
+
+void QP_RenderInit(QP_Render *r);
+// Set the driver and output sample rate. Can be called between blocks.
+void QP_RenderSetDriver(QP_Render *r,struct QP_DriverInterface *di,double rate);
+
+// Render up to frames samples to out, with 4 channels per frame. Stops
+// before the next driver tick, so the tick callback can change the output
+// gain. If chipchannels is 2, rear channels are set to 0.
+// Returns the number of frames rendered.
+int QP_RenderRun(QP_Render *r,float *out,int frames,int flags,int chipchannels);
+
+// Run the driver tick at the start of the next block, instead of waiting
+// for the current tick period to end. Used to act on song requests with
+// no delay. Following ticks are timed from this tick, so the tick rate is
+// not changed.
+void QP_RenderTriggerTick(QP_Render *r);
+
+// Also render stems (STEM_ modes in driver.h), -1 to disable and free the
+// stem buffers. Returns the number of stems, 0 if the driver doesn't
+// support the mode.
+int QP_RenderSetStems(QP_Render *r,int mode);
+// Same as QP_RenderRun, and also writes the stems (left/right pair for each
+// stem) to stems, unless it is NULL.
+int QP_RenderRunStems(QP_Render *r,float *out,float *stems,int frames,int flags,int chipchannels);
+
+// Render chip output at the chip rate, using IRender if the driver has it.
+void QP_RenderChip(struct QP_DriverInterface *di,float *out,int frames,int channels);
+
+#endif // RENDER_H_INCLUDED
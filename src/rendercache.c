@@ -0,0 +1,260 @@
+/*
+    Render cache
+*/
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <dirent.h>
+#include <utime.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#ifdef WIN32
+#include <io.h>
+#endif
+
+#include "rendercache.h"
+#include "lib/thread.h"
+
+#define RCACHE_EXT ".qpr"
+
+typedef struct {
+    uint64_t key;
+    uint64_t size;
+    uint64_t used; // last use, larger is more recent
+} rcache_entry_t;
+
+struct QP_RenderCache {
+    char path[256];
+    uint64_t max_size;
+    uint64_t size;
+    uint64_t clock;
+    uint32_t temp; // temporary file counter
+
+    rcache_entry_t* entry;
+    int count;
+    int alloc;
+
+    thread_mutex_t lock;
+};
+
+struct QP_RenderCacheWriter {
+    FILE* file;
+    uint64_t key;
+    uint64_t size;
+    uint64_t max_size;
+    int error;
+    char tempname[512];
+};
+
+static void rcache_filename(QP_RenderCache* rc,char* out,int size,uint64_t key)
+{
+    snprintf(out,size,"%s/%016llx" RCACHE_EXT,rc->path,(unsigned long long)key);
+}
+
+static rcache_entry_t* rcache_find(QP_RenderCache* rc,uint64_t key)
+{
+    int i;
+    for(i=0;i<rc->count;i++)
+    {
+        if(rc->entry[i].key == key)
+            return &rc->entry[i];
+    }
+    return NULL;
+}
+
+static rcache_entry_t* rcache_add(QP_RenderCache* rc,uint64_t key)
+{
+    rcache_entry_t* e = rcache_find(rc,key);
+    if(e)
+    {
+        rc->size -= e->size;
+        return e;
+    }
+    if(rc->count == rc->alloc)
+    {
+        int alloc = rc->alloc ? rc->alloc*2 : 64;
+        e = realloc(rc->entry,alloc*sizeof(rcache_entry_t));
+        if(!e)
+            return NULL;
+        rc->entry = e;
+        rc->alloc = alloc;
+    }
+    e = &rc->entry[rc->count++];
+    e->key = key;
+    return e;
+}
+
+// Times are in seconds, the low bits keep the order within a second.
+static void rcache_touch(QP_RenderCache* rc,rcache_entry_t* e)
+{
+    uint64_t now = (uint64_t)time(NULL)<<20;
+    rc->clock = now > rc->clock ? now : rc->clock+1;
+    e->used = rc->clock;
+}
+
+// Remove the least recently used files until the cache fits.
+static void rcache_evict(QP_RenderCache* rc)
+{
+    char filename[512];
+    while(rc->size > rc->max_size && rc->count)
+    {
+        int i,oldest = 0;
+        for(i=1;i<rc->count;i++)
+        {
+            if(rc->entry[i].used < rc->entry[oldest].used)
+                oldest = i;
+        }
+        rcache_filename(rc,filename,sizeof(filename),rc->entry[oldest].key);
+        remove(filename);
+        rc->size -= rc->entry[oldest].size;
+        rc->entry[oldest] = rc->entry[--rc->count];
+    }
+}
+
+QP_RenderCache* QP_RenderCacheOpen(const char* path,uint64_t maxsize)
+{
+    char filename[512];
+    struct dirent* d;
+    struct stat st;
+    DIR* dir;
+    QP_RenderCache* rc = calloc(1,sizeof(*rc));
+    if(!rc)
+        return NULL;
+    snprintf(rc->path,sizeof(rc->path),"%s",path);
+    rc->max_size = maxsize;
+    thread_mutex_init(&rc->lock);
+
+#ifdef WIN32
+    mkdir(path);
+#else
+    mkdir(path,0755);
+#endif
+
+    // the last use is the modification time of the file
+    dir = opendir(path);
+    while(dir && (d = readdir(dir)))
+    {
+        unsigned long long key;
+        char ext[8];
+        rcache_entry_t* e;
+        size_t len = strlen(d->d_name);
+        snprintf(filename,sizeof(filename),"%s/%s",path,d->d_name);
+        // left over from renders that were not finished
+        if(len > 4 && !strcmp(d->d_name+len-4,".tmp"))
+        {
+            remove(filename);
+            continue;
+        }
+        if(len != 16+strlen(RCACHE_EXT) ||
+           sscanf(d->d_name,"%16llx%7s",&key,ext) != 2 || strcmp(ext,RCACHE_EXT))
+            continue;
+        if(stat(filename,&st) || !(e = rcache_add(rc,key)))
+            continue;
+        e->size = st.st_size;
+        e->used = (uint64_t)st.st_mtime<<20;
+        rc->size += e->size;
+        if(e->used > rc->clock)
+            rc->clock = e->used;
+    }
+    if(dir)
+        closedir(dir);
+    rcache_evict(rc);
+    return rc;
+}
+
+void QP_RenderCacheClose(QP_RenderCache* rc)
+{
+    if(!rc)
+        return;
+    thread_mutex_destroy(&rc->lock);
+    free(rc->entry);
+    free(rc);
+}
+
+FILE* QP_RenderCacheGet(QP_RenderCache* rc,uint64_t key)
+{
+    char filename[512];
+    rcache_entry_t* e;
+    FILE* f = NULL;
+
+    thread_mutex_lock(&rc->lock);
+    e = rcache_find(rc,key);
+    if(e)
+    {
+        rcache_filename(rc,filename,sizeof(filename),key);
+        f = fopen(filename,"rb");
+        if(f)
+        {
+            // the file time keeps the order for the next time the cache is opened
+            rcache_touch(rc,e);
+            utime(filename,NULL);
+        }
+    }
+    thread_mutex_unlock(&rc->lock);
+    return f;
+}
+
+QP_RenderCacheWriter* QP_RenderCachePut(QP_RenderCache* rc,uint64_t key)
+{
+    QP_RenderCacheWriter* w = calloc(1,sizeof(*w));
+    if(!w)
+        return NULL;
+
+    thread_mutex_lock(&rc->lock);
+    snprintf(w->tempname,sizeof(w->tempname),"%s/%016llx.%u.tmp",rc->path,(unsigned long long)key,rc->temp++);
+    thread_mutex_unlock(&rc->lock);
+
+    w->key = key;
+    w->max_size = rc->max_size;
+    w->file = fopen(w->tempname,"wb");
+    if(!w->file)
+    {
+        free(w);
+        return NULL;
+    }
+    return w;
+}
+
+int QP_RenderCacheWrite(QP_RenderCacheWriter* w,const void* data,int size)
+{
+    // songs that loop forever would otherwise fill the disk
+    if(w->size + size > w->max_size)
+        w->error = 1;
+    if(w->error || fwrite(data,1,size,w->file) != (size_t)size)
+        w->error = 1;
+    w->size += size;
+    return w->error ? -1 : 0;
+}
+
+void QP_RenderCacheFinish(QP_RenderCache* rc,QP_RenderCacheWriter* w,int keep)
+{
+    char filename[512];
+    rcache_entry_t* e;
+
+    if(fclose(w->file) || w->error || !keep)
+    {
+        remove(w->tempname);
+        free(w);
+        return;
+    }
+
+    thread_mutex_lock(&rc->lock);
+    rcache_filename(rc,filename,sizeof(filename),w->key);
+#ifdef WIN32
+    remove(filename);
+#endif
+    if(rename(w->tempname,filename))
+        remove(w->tempname);
+    else if((e = rcache_add(rc,w->key)))
+    {
+        e->size = w->size;
+        rc->size += e->size;
+        rcache_touch(rc,e);
+        rcache_evict(rc);
+    }
+    thread_mutex_unlock(&rc->lock);
+    free(w);
+}
@@ -0,0 +1,36 @@
+/*
+    Render cache
+
+    Stores rendered songs as files named by a key that identifies the game
+    data and render settings (see QP_PlayerGetRenderKey). The total size is
+    limited, the least recently used files are removed first. Can be used
+    from several threads.
+*/
+#ifndef RENDERCACHE_H_INCLUDED
+#define RENDERCACHE_H_INCLUDED
+
+#include <stdio.h>
+#include <stdint.h>
+
+typedef struct QP_RenderCache QP_RenderCache;
+typedef struct QP_RenderCacheWriter QP_RenderCacheWriter;
+
+// Open a cache directory, which is created if needed. maxsize is in bytes.
+// Returns NULL if out of memory.
+QP_RenderCache* QP_RenderCacheOpen(const char* path,uint64_t maxsize);
+void QP_RenderCacheClose(QP_RenderCache* rc);
+
+// Open a cached render for reading, or NULL if there is none. The caller
+// closes the file.
+FILE* QP_RenderCacheGet(QP_RenderCache* rc,uint64_t key);
+
+// Start writing a new render. The data is only visible to
+// QP_RenderCacheGet after QP_RenderCacheFinish with keep set. Returns NULL
+// if the file can't be created.
+QP_RenderCacheWriter* QP_RenderCachePut(QP_RenderCache* rc,uint64_t key);
+// Returns -1 on write error or if the render is larger than the cache, the
+// render is then discarded when finished.
+int QP_RenderCacheWrite(QP_RenderCacheWriter* w,const void* data,int size);
+void QP_RenderCacheFinish(QP_RenderCache* rc,QP_RenderCacheWriter* w,int keep);
+
+#endif // RENDERCACHE_H_INCLUDED
@@ -1,8 +1,9 @@
+#include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
 #include <math.h>
 
-#include "../qp.h"
+#include "../driver.h"
 #include "../lib/vgm.h"
 
 #include "s2x.h"
@@ -22,10 +23,11 @@ int S2X_IInit(void* d,QP_Game *g)
 
     memset(&S->PCMChip,0,sizeof(C352));
     memset(&S->FMChip,0,sizeof(YM2151));
+    memset(&S->WSGChip,0,sizeof(C30));
 
     S->PCMClock = SYSTEMNA ? 50113000/2 : 49152000/2; // sound chip freq is master clock / 2
     C352_init(&S->PCMChip,S->PCMClock);
-    S->PCMChip.vgm_log = 0;
+    S->PCMChip.vgm = NULL;
     if(SYSTEMNA)
     {
         S->PCMChip.wave = g->Data;
@@ -38,6 +40,7 @@ int S2X_IInit(void* d,QP_Game *g)
         S->PCMChip.wave_mask = g->WaveMask;
     }
     S->Data = g->Data;
+    S->DataSize = g->DataSize;
 
     S->FMClock = 3579545;
     S->FMTicks = 0;
@@ -45,9 +48,12 @@ int S2X_IInit(void* d,QP_Game *g)
     YM2151_init(&S->FMChip,S->FMClock);
 
     S->SoundRate = S->PCMChip.rate;
+    C30_init(&S->WSGChip,S->PCMChip.rate);
     S->FMDelta = S->FMChip.rate / S->SoundRate;
     S->FMWriteRate = SYSTEM1 ? 1.0 : 2.5;
 
+    QP_SilenceDetectInit(&S->Silence,S->SoundRate);
+
     g->MuteRear = 1;
 
     return 0;
@@ -57,7 +63,7 @@ void S2X_IDeinit(void* d)
     S2X_State* S = d;
     S2X_Deinit(S);
 }
-void S2X_IVgmOpen(void* d)
+void S2X_IVgmOpen(void* d,vgmfile_t* vgm)
 {
     S2X_State* S = d;
 
@@ -67,17 +73,20 @@ void S2X_IVgmOpen(void* d)
         S2X_WSGLoadWave(S);
     }
 
-    vgm_datablock(0x92,0x1000000,S->PCMChip.wave,0x1000000,S->PCMChip.wave_mask,0);
-    S->PCMChip.vgm_log = 1;
+    vgm_datablock(vgm,0x92,0x1000000,S->PCMChip.wave,0x1000000,S->PCMChip.wave_mask,0);
+    S->PCMChip.vgm = vgm;
 }
-void S2X_IVgmClose(void* d)
+void S2X_IVgmClose(void* d,int muterear)
 {
     S2X_State* S = d;
-    S->PCMChip.vgm_log = 0;
-    vgm_poke32(0xdc,S->PCMClock | Audio->state.MuteRear<<31);
-    vgm_poke8(0xd6,288/4);
+    vgmfile_t* vgm = S->PCMChip.vgm;
+    if(!vgm)
+        return;
+    S->PCMChip.vgm = NULL;
+    vgm_poke32(vgm,0xdc,S->PCMClock | muterear<<31);
+    vgm_poke8(vgm,0xd6,288/4);
 
-    vgm_poke32(0x30,S->FMClock);
+    vgm_poke32(vgm,0x30,S->FMClock);
 }
 void S2X_IReset(void* d,QP_Game* g,int initial)
 {
@@ -92,6 +101,8 @@ void S2X_IReset(void* d,QP_Game* g,int initial)
         S2X_Init(S);
     else
         S2X_Reset(S);
+
+    QP_SilenceDetectReset(&S->Silence);
 }
 
 // ============================================================================
@@ -212,16 +223,18 @@ void S2X_IResetLoopCnt(void* d)
 
 int S2X_IDetectSilence(void* d)
 {
-    return 0;
-#if 0
-    int i, voicectr=0;
-    for(i=0;i<Q_MAX_VOICES;i++)
-        if(!d.quattro->Voice[i].Enabled)
-            voicectr++;
-    if(voicectr != Q_MAX_VOICES)
-        return 1;
-    return 0;
-#endif
+    S2X_State* S = d;
+    return (S->Silence.SilentSince >= 0);
+}
+int64_t S2X_ISilentSince(void* d)
+{
+    S2X_State* S = d;
+    return S->Silence.SilentSince;
+}
+int64_t S2X_IChipPosition(void* d)
+{
+    S2X_State* S = d;
+    return S->Silence.Position;
 }
 
 double S2X_ITickRate(void* d)
@@ -252,6 +265,15 @@ double S2X_IChipRate(void* d)
     S2X_State* S = d;
     return S->SoundRate;
 }
+// C352 output, plus the C30 for System 1
+static inline double S2X_PCMOut(S2X_State *S,int ch)
+{
+    double out = S->PCMChip.out[ch];
+    if(ch < 2 && SYSTEM1)
+        out += S->WSGChip.out[ch];
+    return out / (1<<28);
+}
+
 void S2X_IUpdateChip(void* d)
 {
     S2X_State *S = d;
@@ -270,6 +292,15 @@ void S2X_IUpdateChip(void* d)
     }
 
     C352_update(&S->PCMChip);
+    if(SYSTEM1)
+        C30_update(&S->WSGChip);
+
+    // rear channels are not used.
+    double out[2];
+    out[0] = S2X_PCMOut(S,0) + S->FMChip.out[0]/6;
+    out[1] = S2X_PCMOut(S,1) + S->FMChip.out[1]/6;
+    if(QP_SilenceDetectUpdate(&S->Silence,out,2,1.0))
+        QP_SilenceDetectEnd(&S->Silence,C352_ramp_pending(&S->PCMChip) || YM2151_attack_pending(&S->FMChip));
 }
 void S2X_ISampleChip(void* d,float* samples,int samplecnt)
 {
@@ -278,7 +309,7 @@ void S2X_ISampleChip(void* d,float* samples,int samplecnt)
     if(samplecnt > 4)
         samplecnt=4;
     for(i=0;i<samplecnt;i++)
-        samples[i] = S->PCMChip.out[i] / (1<<28);
+        samples[i] = S2X_PCMOut(S,i);
     if(samplecnt > 2)
         samplecnt=2;
     for(i=0;i<samplecnt;i++)
@@ -289,6 +320,112 @@ void S2X_ISampleChip(void* d,float* samples,int samplecnt)
         //samples[i] += (last+(S->FMTicks*(next-last)))/12; // for finallap
     }
 }
+void S2X_IRender(void* d,float* out,int frames,int channels)
+{
+    S2X_State* S = d;
+    int i;
+    if(channels > 4)
+        channels=4;
+    while(frames--)
+    {
+        S2X_IUpdateChip(S);
+        for(i=0;i<channels;i++)
+            out[i] = S2X_PCMOut(S,i);
+        for(i=0;i<channels && i<2;i++)
+        {
+            double last = S->FMChip.out[i+2];
+            double next = S->FMChip.out[i];
+            out[i] += (last+(S->FMTicks*(next-last)))/6;
+        }
+        out += channels;
+    }
+}
+
+int S2X_IStemCount(void* d,int mode)
+{
+    S2X_State* S = d;
+    switch(mode)
+    {
+    case STEM_VOICE:
+        return SYSTEM1 ? S2X_STEM_SOURCES : S2X_STEM_WSG;
+    case STEM_TRACK:
+        return S2X_MAX_TRACKS+1;
+    case STEM_CHIP:
+        return SYSTEM1 ? 3 : 2; // FM, PCM, WSG
+    default:
+        return 0;
+    }
+}
+void S2X_IRenderStems(void* d,float* out,int frames,int channels,float* stems,int mode)
+{
+    S2X_State* S = d;
+    float pcm[2*C352_VOICES], wsg[2*C30_VOICES];
+    int stem[S2X_STEM_SOURCES];
+    int count = S2X_IStemCount(d,mode);
+    int i;
+
+    // the driver doesn't run during the block, so the stems can be found now
+    for(i=0;i<S2X_MAX_VOICES_FM;i++)
+        if(S->FM[i].TrackNo)
+            S->StemTrack[S2X_STEM_FM+(S->FM[i].VoiceNo&7)] = S->FM[i].TrackNo;
+    for(i=0;i<S2X_MAX_VOICES_PCM;i++)
+    {
+        if(!S->PCM[i].TrackNo)
+            continue;
+        S->StemTrack[S2X_STEM_PCM+(S->PCM[i].VoiceNo&31)] = S->PCM[i].TrackNo;
+        if(S->PCM[i].ChannelLink >= 0)
+            S->StemTrack[S2X_STEM_PCM+((8+S->PCM[i].VoiceNo)&31)] = S->PCM[i].TrackNo;
+    }
+    for(i=0;i<S2X_MAX_VOICES_WSG;i++)
+        if(S->WSG[i].TrackNo)
+            S->StemTrack[S2X_STEM_WSG+(S->WSG[i].VoiceNo&7)] = S->WSG[i].TrackNo;
+    for(i=0;i<S2X_STEM_SOURCES;i++)
+    {
+        if(mode == STEM_VOICE)
+            stem[i] = i < count ? i : 0;
+        else if(mode == STEM_TRACK)
+            stem[i] = S->StemTrack[i] && S->StemTrack[i] < count ? S->StemTrack[i]-1 : count-1;
+        else
+            stem[i] = i < S2X_STEM_PCM ? 0 : i < S2X_STEM_WSG ? 1 : count-1;
+    }
+
+    S->FMChip.voice_out = S->StemFM;
+    S->PCMChip.voice_out = pcm;
+    S->WSGChip.voice_out = wsg;
+    if(channels > 4)
+        channels=4;
+    while(frames--)
+    {
+        S2X_IUpdateChip(S);
+        for(i=0;i<channels;i++)
+            out[i] = S2X_PCMOut(S,i);
+        for(i=0;i<channels && i<2;i++)
+        {
+            double last = S->FMChip.out[i+2];
+            double next = S->FMChip.out[i];
+            out[i] += (last+(S->FMTicks*(next-last)))/6;
+        }
+        out += channels;
+
+        memset(stems,0,2*count*sizeof(float));
+        for(i=0;i<16;i++)
+        {
+            // interpolated, same as the FM output
+            float last = S->StemFM[16+i];
+            float next = S->StemFM[i];
+            stems[2*stem[S2X_STEM_FM+i/2]+(i&1)] += (last+(S->FMTicks*(next-last)))/6;
+        }
+        for(i=0;i<2*C352_VOICES;i++)
+            stems[2*stem[S2X_STEM_PCM+i/2]+(i&1)] += pcm[i] / (1<<28);
+        if(SYSTEM1)
+            for(i=0;i<2*C30_VOICES;i++)
+                stems[2*stem[S2X_STEM_WSG+i/2]+(i&1)] += wsg[i] / (1<<28);
+        stems += 2*count;
+    }
+    S->FMChip.voice_out = NULL;
+    S->PCMChip.voice_out = NULL;
+    S->WSGChip.voice_out = NULL;
+}
 
 uint32_t S2X_IGetMute(void* d)
 {
@@ -313,6 +450,13 @@ void S2X_ISetSolo(void* d,uint32_t data)
     S2X_UpdateMuteMask(S);
 }
 
+void S2X_ISetQuality(void* d,int flags)
+{
+    S2X_State* S = d;
+    S->PCMChip.mute_rear = (flags & QUALITY_NO_REAR) != 0;
+    S->PCMChip.no_interpolation = (flags & QUALITY_NO_INTERPOLATION) != 0;
+}
+
 void S2X_IDebugAction(void* d,int id)
 {
     S2X_State* S = d;
@@ -552,18 +696,25 @@ struct QP_DriverInterface S2X_CreateInterface()
         .IResetLoopCnt = &S2X_IResetLoopCnt,
 
         .IDetectSilence = &S2X_IDetectSilence,
+        .ISilentSince = &S2X_ISilentSince,
+        .IChipPosition = &S2X_IChipPosition,
 
         .ITickRate = &S2X_ITickRate,
         .IUpdateTick = &S2X_IUpdateTick,
         .IChipRate = &S2X_IChipRate,
         .IUpdateChip = &S2X_IUpdateChip,
         .ISampleChip = &S2X_ISampleChip,
+        .IRender = &S2X_IRender,
+        .IStemCount = &S2X_IStemCount,
+        .IRenderStems = &S2X_IRenderStems,
 
         .IGetMute = &S2X_IGetMute,
         .ISetMute = &S2X_ISetMute,
         .IGetSolo = &S2X_IGetSolo,
         .ISetSolo = &S2X_ISetSolo,
 
+        .ISetQuality = &S2X_ISetQuality,
+
         .IDebugAction = &S2X_IDebugAction,
         .IGetVoiceCount = &S2X_IGetVoiceCount,
         .IGetVoiceInfo = &S2X_IGetVoiceInfo,
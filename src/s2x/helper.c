@@ -1,8 +1,9 @@
 #include <stdlib.h>
 #include <string.h>
 
-#include "../qp.h"
+#include "../driver.h"
 #include "../lib/vgm.h"
+#include "../lib/trace.h"
 
 #include "s2x.h"
 #include "helper.h"
@@ -37,6 +38,12 @@ void S2X_UpdateMuteMask(S2X_State *S)
         S->PCMChip.mute_mask = S->MuteMask;
         S->FMChip.mute_mask = S->MuteMask>>24;
     }
+    // WSG voices are played by the C30, the C352 voices are only for VGM logging.
+    if(S->ConfigFlags & S2X_CFG_SYSTEM1)
+    {
+        S->WSGChip.mute_mask = S->PCMChip.mute_mask & 0xff;
+        S->PCMChip.mute_mask |= 0xff;
+    }
 }
 
 void S2X_OPMWrite(S2X_State *S,int ch,int op,int reg,uint8_t data)
@@ -50,8 +57,8 @@ void S2X_OPMWrite(S2X_State *S,int ch,int op,int reg,uint8_t data)
     else if(reg == 0x08)
         data |= ch;
 
-    if(S->PCMChip.vgm_log)
-        vgm_write(0x54,0,fmreg,data);
+    if(S->PCMChip.vgm)
+        vgm_write(S->PCMChip.vgm,0x54,0,fmreg,data);
 
     S2X_FMWrite w = {fmreg,data};
 
@@ -62,6 +69,7 @@ void S2X_OPMWrite(S2X_State *S,int ch,int op,int reg,uint8_t data)
     if((S->FMQueueWrite&0x1ff) == (S->FMQueueRead&0x1ff))
     {
         Q_DEBUG("flushing queue (OPM is not keeping up!)\n");
+        TRACE_INSTANT("FM queue flush","writes",0x200);
         do S2X_OPMReadQueue(S);
         while ((S->FMQueueWrite&0x1ff) != (S->FMQueueRead&0x1ff));
     }
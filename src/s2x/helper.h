@@ -1,7 +1,7 @@
 #ifndef S2X_HELPER_H_INCLUDED
 #define S2X_HELPER_H_INCLUDED
 #include "../macro.h"
-#include "../qp.h"
+#include "../driver.h"
 
 uint32_t S2X_ReadPos(S2X_State *S,uint32_t d);
 uint8_t S2X_ReadByte(S2X_State *S,uint32_t d);
@@ -2,13 +2,15 @@
 #include <string.h>
 #include <stdint.h>
 
-#include "../qp.h"
+#include "../driver.h"
 
 #include "s2x.h"
 #include "helper.h"
 #include "track.h"
 #include "voice.h"
 #include "wsg.h"
+#include "../lib/trace.h"
+#include "../lib/profile.h"
 
 #define SYSTEMNA (S->DriverType == S2X_TYPE_NA)
 #define SYSTEM1 (S->ConfigFlags & S2X_CFG_SYSTEM1)
@@ -17,7 +19,7 @@ void S2X_Init(S2X_State *S)
 {
     QP_LoopDetect ld = {
         .TrackCnt = S2X_MAX_TRACKS,
-        .DataSize = Game->DataSize,
+        .DataSize = S->DataSize,
         .SongCnt = 0x400,
         .CheckValid = S2X_LoopDetectValid,
         .Driver = S
@@ -50,6 +52,7 @@ void S2X_Reset(S2X_State *S)
     int i;
 
     memset(S->PCMChip.v,0,sizeof(S->PCMChip.v));
+    memset(S->WSGChip.v,0,sizeof(S->WSGChip.v));
     memset(S->PCM,0,sizeof(S->PCM));
     memset(S->FM,0,sizeof(S->FM));
     memset(S->SE,0,sizeof(S->SE));
@@ -70,6 +73,10 @@ void S2X_Reset(S2X_State *S)
     memset(S->Track,0,sizeof(S->Track));
     memset(S->ActiveChannel,0,sizeof(S->ActiveChannel));
     memset(S->ChannelPriority,0,sizeof(S->ChannelPriority));
+    memset(S->VoiceTrackMask,0,sizeof(S->VoiceTrackMask));
+    memset(S->TrackVoiceMask,0,sizeof(S->TrackVoiceMask));
+    memset(S->VoiceTopTrack,-1,sizeof(S->VoiceTopTrack));
+    memset(S->StemTrack,0,sizeof(S->StemTrack));
 
     S->FrameCnt=0;
 
@@ -78,6 +85,7 @@ void S2X_Reset(S2X_State *S)
     S->CJump=0;
     S->MuteMask=0;
     S->SoloMask=0;
+    S2X_UpdateMuteMask(S);
 }
 
 void S2X_UpdateTick(S2X_State *S)
@@ -85,6 +93,7 @@ void S2X_UpdateTick(S2X_State *S)
     S->FrameCnt ++;
 
     int i;
+    int active = 0;
     for(i=0;i<S2X_MAX_TRACKS;i++)
     {
         if(S->SongRequest[i] & S2X_TRACK_STATUS_START)
@@ -94,10 +103,12 @@ void S2X_UpdateTick(S2X_State *S)
         else if(S->Track[i].Flags & S2X_TRACK_STATUS_BUSY)
         {
             S->Track[i].Flags = S->SongRequest[S->ParentSong[i]];
-            S2X_TrackUpdate(S,i);
+            PROFILE(PROFILE_S2X_TRACK,i,S2X_TrackUpdate(S,i));
             S2X_TrackCalcVolume(S,i);
+            active++;
         }
     }
+    TRACE_COUNTER("active tracks",active);
     for(i=0;i<S2X_MAX_VOICES;i++)
     {
         S2X_VoiceUpdate(S,i);
@@ -6,9 +6,11 @@
 
 #include <stdint.h>
 
+#include "../emu/c30.h"
 #include "../emu/c352.h"
 #include "../emu/ym2151.h"
 #include "../lib/loopdetect.h"
+#include "../lib/silence.h"
 
 #include "enum.h"
 #include "struct.h"
@@ -15,6 +15,12 @@
 
 #define S2X_MAX_VOICES_WSG 8
 
+// Stem sources: YM2151 channels, C352 voices, then C30 voices
+#define S2X_STEM_FM 0
+#define S2X_STEM_PCM 8
+#define S2X_STEM_WSG 40
+#define S2X_STEM_SOURCES 48
+
 #define S2X_MAX_BANK 15
 
 typedef struct S2X_Channel S2X_Channel;
@@ -273,9 +279,12 @@ struct S2X_State {
     YM2151 FMChip;
     uint32_t PCMClock;
     C352 PCMChip; // instead of C140
+    C30 WSGChip; // System 1 only
+    QP_SilenceDetect Silence;
 
     // ROM data
     uint8_t *Data;
+    uint32_t DataSize;
 
     // misc
     char *BankName[S2X_MAX_BANK];
@@ -331,6 +340,18 @@ struct S2X_State {
 
     // List of allocated voices for each track and the associated priority.
     S2X_ChannelPriority ChannelPriority[S2X_MAX_VOICES][S2X_MAX_TRACKS];
+    // Tracks with a nonzero priority on each voice, and the voices used by
+    // each track. Kept up to date by S2X_VoiceSetPriority.
+    uint16_t VoiceTrackMask[S2X_MAX_VOICES];
+    uint32_t TrackVoiceMask[S2X_MAX_TRACKS];
+    // Highest priority track on each voice, -1 if it needs to be searched.
+    int8_t VoiceTopTrack[S2X_MAX_VOICES];
+
+    // Last track (+1) that used each stem source. Kept after the voice is
+    // released so that release tails stay on the same stem.
+    uint8_t StemTrack[S2X_STEM_SOURCES];
+    // Channel output from the YM2151, current and previous
+    float StemFM[32];
 };
 
 
@@ -6,6 +6,7 @@
 #include "helper.h"
 #include "track.h"
 #include "voice.h"
+#include "../lib/profile.h"
 #include "wsg.h"
 
 #define SYSTEM1 (S->ConfigFlags & S2X_CFG_SYSTEM1)
@@ -223,7 +224,8 @@ void S2X_TrackUpdate(S2X_State* S,int TrackNo)
                 CmdIndex=Command&0x3f;
                 if(CmdIndex < S2X_MAX_TRKCMD)
                 {
-                    CmdTab[CmdIndex].cmd(S,TrackNo,T,Command,CmdTab[CmdIndex].param);
+                    PROFILE(PROFILE_S2X_TRACK_CMD,S->DriverType*64+CmdIndex,
+                            CmdTab[CmdIndex].cmd(S,TrackNo,T,Command,CmdTab[CmdIndex].param));
                 }
                 else
                 {
@@ -265,10 +267,12 @@ void S2X_TrackDisable(S2X_State *S,int TrackNo)
     S2X_Channel* c;
     int i;
     //uint16_t cflags;
-    for(i=0;i<S2X_MAX_VOICES;i++)
+    uint32_t mask = S->TrackVoiceMask[TrackNo];
+    while(mask)
     {
-        S->ChannelPriority[i][TrackNo].channel = 0;
-        S->ChannelPriority[i][TrackNo].priority = 0;
+        i = __builtin_ctz(mask);
+        mask &= mask-1;
+        S2X_VoiceSetPriority(S,i,TrackNo,0,0);
     }
     for(i=0;i<S2X_MAX_TRKCHN;i++)
     {
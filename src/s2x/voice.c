@@ -3,6 +3,7 @@
 #include "s2x.h"
 #include "helper.h"
 #include "voice.h"
+#include "../lib/profile.h"
 
 void S2X_VoiceSetChannel(S2X_State *S,int VoiceNo,int TrackNo,int ChannelNo)
 {
@@ -60,21 +61,42 @@ void S2X_VoiceClearChannel(S2X_State *S,int VoiceNo)
     }
 }
 
-uint16_t S2X_VoiceGetPriority(S2X_State *S,int VoiceNo,int* TrackNo,int* ChannelNo)
+// Find the highest priority track on the voice. On a tie, the lowest
+// track number wins. Returns -1 if no track has the voice.
+static int S2X_VoiceFindPriority(S2X_State *S,int VoiceNo)
 {
     int i;
-    int track = 0;
-    int channel=0;
+    int track=-1;
     int priority=0;
-    for(i=0;i<S2X_MAX_TRACKS;i++)
+    uint32_t mask = S->VoiceTrackMask[VoiceNo];
+    while(mask)
     {
+        i = __builtin_ctz(mask);
+        mask &= mask-1;
         if(S->ChannelPriority[VoiceNo][i].priority > priority)
         {
             track=i;
-            channel=S->ChannelPriority[VoiceNo][i].channel;
             priority=S->ChannelPriority[VoiceNo][i].priority;
         }
     }
+    return track;
+}
+
+uint16_t S2X_VoiceGetPriority(S2X_State *S,int VoiceNo,int* TrackNo,int* ChannelNo)
+{
+    int track = S->VoiceTopTrack[VoiceNo];
+    if(track < 0)
+        track = S->VoiceTopTrack[VoiceNo] = S2X_VoiceFindPriority(S,VoiceNo);
+
+    int channel=0;
+    int priority=0;
+    if(track < 0)
+        track=0;
+    else
+    {
+        channel=S->ChannelPriority[VoiceNo][track].channel;
+        priority=S->ChannelPriority[VoiceNo][track].priority;
+    }
 
     if(TrackNo != NULL)
         *TrackNo = track;
@@ -86,8 +108,38 @@ uint16_t S2X_VoiceGetPriority(S2X_State *S,int VoiceNo,int* TrackNo,int* Channel
 
 void S2X_VoiceSetPriority(S2X_State *S,int VoiceNo,int TrackNo,int ChannelNo,int Priority)
 {
-    S->ChannelPriority[VoiceNo][TrackNo].channel = ChannelNo;
-    S->ChannelPriority[VoiceNo][TrackNo].priority = Priority;
+    S2X_ChannelPriority *P = &S->ChannelPriority[VoiceNo][TrackNo];
+    int top = S->VoiceTopTrack[VoiceNo];
+    uint16_t old = P->priority;
+
+    P->channel = ChannelNo;
+    P->priority = Priority;
+
+    if(P->priority)
+    {
+        S->VoiceTrackMask[VoiceNo] |= 1U<<TrackNo;
+        S->TrackVoiceMask[TrackNo] |= 1U<<VoiceNo;
+    }
+    else
+    {
+        S->VoiceTrackMask[VoiceNo] &= ~(1U<<TrackNo);
+        S->TrackVoiceMask[TrackNo] &= ~(1U<<VoiceNo);
+    }
+
+    // update the highest priority track if it can be done without a search
+    if(top < 0)
+        return;
+    else if(top == TrackNo)
+    {
+        if(P->priority < old)
+            S->VoiceTopTrack[VoiceNo] = -1;
+    }
+    else
+    {
+        uint16_t top_priority = S->ChannelPriority[VoiceNo][top].priority;
+        if(P->priority > top_priority || (P->priority && P->priority == top_priority && TrackNo < top))
+            S->VoiceTopTrack[VoiceNo] = TrackNo;
+    }
 }
 
 int S2X_SetVoiceType(S2X_State *S,int VoiceNo,int VoiceType,int Count)
@@ -177,7 +229,8 @@ void S2X_VoiceUpdate(S2X_State *S,int VoiceNo)
     case S2X_VOICE_TYPE_PCM:
         return S2X_PCMUpdate(S,&S->PCM[index]);
     case S2X_VOICE_TYPE_WSG:
-        return S2X_WSGUpdate(S,&S->WSG[index]);
+        PROFILE(PROFILE_S2X_VOICE,PROFILE_S2X_WSG,S2X_WSGUpdate(S,&S->WSG[index]));
+        return;
     }
 
 }
@@ -5,6 +5,7 @@
 #include "tables.h"
 #include "track.h"
 #include "voice.h"
+#include "../lib/profile.h"
 
 #define OLD_VOL_MODE (S->ConfigFlags & S2X_CFG_FM_VOL)
 #define SYSTEM1 (S->ConfigFlags & S2X_CFG_SYSTEM1)
@@ -320,11 +321,12 @@ void S2X_FMUpdate(S2X_State *S,S2X_FMVoice *V)
     if(~V->Flag & 0x80)
         return;
     V->Pitch.Target = V->Key<<8;
-    S2X_FMUpdateGate(S,V);
-    S2X_FMUpdateReset(S,V);
-    S2X_FMUpdateLfo(S,V);
-    S2X_VoicePitchUpdate(S,&V->Pitch);
-    S2X_FMUpdatePitch(S,V);
+    PROFILE(PROFILE_S2X_VOICE,PROFILE_S2X_FM_GATE,S2X_FMUpdateGate(S,V));
+    PROFILE(PROFILE_S2X_VOICE,PROFILE_S2X_FM_RESET,S2X_FMUpdateReset(S,V));
+    PROFILE(PROFILE_S2X_VOICE,PROFILE_S2X_FM_LFO,S2X_FMUpdateLfo(S,V));
+    PROFILE(PROFILE_S2X_VOICE,PROFILE_S2X_FM_PITCH,
+        S2X_VoicePitchUpdate(S,&V->Pitch);
+        S2X_FMUpdatePitch(S,V));
 
     if(V->Flag&0x40 && V->Delay)
     {
@@ -5,6 +5,7 @@
 #include "tables.h"
 #include "track.h"
 #include "voice.h"
+#include "../lib/profile.h"
 
 #define ADSR_ENV (S->ConfigFlags & (S2X_CFG_PCM_ADSR|S2X_CFG_PCM_NEWADSR))
 #define NEW_ADSR (S->ConfigFlags & S2X_CFG_PCM_NEWADSR)
@@ -541,14 +542,14 @@ void S2X_PCMUpdate(S2X_State *S,S2X_PCMVoice *V)
     V->Pitch.Target = V->Key<<8;
     //V->Pitch.Portamento = V->Channel->Vars[S2X_CHN_PTA];
 
-    S2X_PCMLinkUpdate(S,V);
-    S2X_PCMUpdateReset(S,V);
+    PROFILE(PROFILE_S2X_VOICE,PROFILE_S2X_PCM_LINK,S2X_PCMLinkUpdate(S,V));
+    PROFILE(PROFILE_S2X_VOICE,PROFILE_S2X_PCM_RESET,S2X_PCMUpdateReset(S,V));
     if(ADSR_ENV)
-        S2X_PCMAdsrUpdate(S,V);
+        PROFILE(PROFILE_S2X_VOICE,PROFILE_S2X_PCM_ENV,S2X_PCMAdsrUpdate(S,V));
     else
-        S2X_PCMEnvelopeUpdate(S,V);
-    S2X_PCMPanSlideUpdate(S,V);
-    S2X_VoicePitchUpdate(S,&V->Pitch);
+        PROFILE(PROFILE_S2X_VOICE,PROFILE_S2X_PCM_ENV,S2X_PCMEnvelopeUpdate(S,V));
+    PROFILE(PROFILE_S2X_VOICE,PROFILE_S2X_PCM_PAN_SLIDE,S2X_PCMPanSlideUpdate(S,V));
+    PROFILE(PROFILE_S2X_VOICE,PROFILE_S2X_PCM_PITCH,S2X_VoicePitchUpdate(S,&V->Pitch));
 
     if(V->Flag & 0x40)
     {
@@ -557,17 +558,18 @@ void S2X_PCMUpdate(S2X_State *S,S2X_PCMVoice *V)
             V->Delay--;
             return;
         }
-        S2X_PCMWrite(S,V,C352_FLAGS,0);
-        S2X_PCMWaveUpdate(S,V);
-        S2X_PCMPitchUpdate(S,V);
-        S2X_PCMWrite(S,V,C352_WAVE_BANK,V->WaveBank);
-        S2X_PCMWrite(S,V,C352_FLAGS,V->ChipFlag|C352_FLG_KEYON);
+        PROFILE(PROFILE_S2X_VOICE,PROFILE_S2X_PCM_KEYON,
+            S2X_PCMWrite(S,V,C352_FLAGS,0);
+            S2X_PCMWaveUpdate(S,V);
+            S2X_PCMPitchUpdate(S,V);
+            S2X_PCMWrite(S,V,C352_WAVE_BANK,V->WaveBank);
+            S2X_PCMWrite(S,V,C352_FLAGS,V->ChipFlag|C352_FLG_KEYON));
         V->Length = V->Channel->Vars[S2X_CHN_GTM];
         V->Flag=((V->Flag&0xbf)|0x80);
     }
     else
     {
-        S2X_PCMPitchUpdate(S,V);
+        PROFILE(PROFILE_S2X_VOICE,PROFILE_S2X_PCM_PITCH_WRITE,S2X_PCMPitchUpdate(S,V));
     }
 }
 
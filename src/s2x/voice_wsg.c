@@ -19,6 +19,9 @@ void S2X_WSGClear(S2X_State *S,S2X_WSGVoice *V,int VoiceNo)
 
     V->VoiceNo=VoiceNo;
 
+    S->WSGChip.v[VoiceNo].vol[0]=0;
+    S->WSGChip.v[VoiceNo].vol[1]=0;
+
     S2X_C352_W(S,VoiceNo,C352_FLAGS,0);
     S2X_C352_W(S,V->VoiceNo,C352_VOL_FRONT,0);
     S2X_C352_W(S,V->VoiceNo,C352_VOL_REAR,0);
@@ -30,24 +33,15 @@ void S2X_WSGCommand(S2X_State *S,S2X_Channel *C,S2X_WSGVoice *V)
     V->Channel = C;
 }
 
-void S2X_WSGUpdate(S2X_State *S,S2X_WSGVoice *V)
+// The voice is played by the C30 emulator. The same voice is also set up
+// on the C352 (which is muted) when logging a VGM.
+static void S2X_WSGUpdateC352(S2X_State *S,S2X_WSGVoice *V,S2X_WSGChannel *W)
 {
-    if(!V->Channel || !V->Channel->WSG.Active)
-    {
-        if(S2X_C352_R(S,V->VoiceNo,C352_FLAGS))
-            S2X_C352_W(S,V->VoiceNo,C352_FLAGS,0);
-        return;
-    }
-
-    S2X_WSGChannel *W = &V->Channel->WSG;
-
-    V->Pitch = (W->Freq * 0x24) >> 7;
     if(V->Pitch > 0xffff)
         S2X_C352_W(S,V->VoiceNo,C352_FREQUENCY,V->Pitch/4);
     else
         S2X_C352_W(S,V->VoiceNo,C352_FREQUENCY,V->Pitch);
 
-    V->WaveNo = W->WaveNo>>4;
     if(V->WaveNo != V->LastWaveNo || (V->Pitch^V->LastPitch)&0xffff0000 )
     {
         S2X_C352_W(S,V->VoiceNo,C352_FLAGS,0);
@@ -69,10 +63,46 @@ void S2X_WSGUpdate(S2X_State *S,S2X_WSGVoice *V)
         V->LastWaveNo = V->WaveNo;
     }
 
-    V->LastPitch = V->Pitch;
-
     uint16_t vol = (W->Env[1].Val * 8)<<8;
     vol |= W->Env[0].Val * 8;
     S2X_C352_W(S,V->VoiceNo,C352_VOL_FRONT,vol);
 }
 
+void S2X_WSGUpdate(S2X_State *S,S2X_WSGVoice *V)
+{
+    C30_Voice *CV = &S->WSGChip.v[V->VoiceNo];
+
+    if(!V->Channel || !V->Channel->WSG.Active)
+    {
+        CV->vol[0] = CV->vol[1] = 0;
+        if(S2X_C352_R(S,V->VoiceNo,C352_FLAGS))
+            S2X_C352_W(S,V->VoiceNo,C352_FLAGS,0);
+        return;
+    }
+
+    S2X_WSGChannel *W = &V->Channel->WSG;
+
+    // C30 runs at the C352 rate, so the pitch needs no conversion
+    V->Pitch = (W->Freq * 0x24) >> 7;
+    V->WaveNo = W->WaveNo>>4;
+
+    CV->freq = V->Pitch;
+    CV->wave = V->WaveNo;
+    CV->noise = W->Noise != 0;
+    CV->vol[0] = W->Env[1].Val * 8;
+    CV->vol[1] = W->Env[0].Val * 8;
+
+    if(S->PCMChip.vgm)
+    {
+        S2X_WSGUpdateC352(S,V,W);
+    }
+    else if(S2X_C352_R(S,V->VoiceNo,C352_FLAGS))
+    {
+        // key on again when VGM logging starts
+        S2X_C352_W(S,V->VoiceNo,C352_FLAGS,0);
+        V->LastWaveNo = 0xff;
+    }
+
+    V->LastPitch = V->Pitch;
+}
+
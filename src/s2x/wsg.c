@@ -2,12 +2,13 @@
     C30 WSG sound driver
 
     Features:
-        Uses the C352, which allows for VGM logging
+        Voices are played by a native C30 emulator
+        C352 writes are still made when logging VGMs
         Music tracks work
         Sound effects sometimes work
     Limitations:
-        Uses a hack to handle notes above 85khz
-        Noise frequences above 85khz are not supported at all.
+        VGM logs use a hack to handle notes above 85khz
+        Noise frequences above 85khz are not supported in VGM logs.
 */
 
 #include <stdlib.h>
@@ -71,6 +72,9 @@ void S2X_WSGLoadWave(S2X_State *S)
     S->PCMChip.wave = S->WSGWaveData;
     S->PCMChip.wave_mask = sizeof(S->WSGWaveData)-1;
 
+    S->WSGChip.wave = (int8_t*)S->WSGWaveData;
+    S->WSGChip.wave_count = 16;
+
 #ifdef WSG_DBG
     for(i=0;i<512;i++)
         Q_DEBUG("%02x%s",S->WSGWaveData[i],((i+1)&15) ? " " : "\n");
@@ -245,8 +249,7 @@ void S2X_WSGChannelStart(S2X_State *S,int TrackNo,S2X_Channel *C,int ChannelNo,u
 
 void S2X_WSGChannelStop(S2X_State *S,int TrackNo,S2X_Channel *C,int ChannelNo)
 {
-    S->ChannelPriority[C->VoiceNo][TrackNo].channel = 0;
-    S->ChannelPriority[C->VoiceNo][TrackNo].priority = 0;
+    S2X_VoiceSetPriority(S,C->VoiceNo,TrackNo,0,0);
 
     C->WSG.Active = 0;
     if(C->Enabled)
@@ -0,0 +1,782 @@
+/*
+    Streaming server
+
+    Listens on a local TCP port or a Unix socket and streams songs rendered
+    with the player library. Clients asking for the same stream (game, song
+    and output options) share one player. Players are run by a fixed number
+    of worker threads, and each stream is rendered ahead only as far as its
+    slowest client allows.
+
+    Request, one line:
+        PLAY <game> <song id> [format] [rate] [channels] [loops]
+    format is wav (16-bit, the default), s16 or f32 (raw, little endian).
+    rate 0 = sound chip rate. The song fades out after loops (default 2,
+    0 = play until the song stops).
+    Response:
+        OK <rate> <channels> <format>, followed by the audio data, or
+        ERR <message>
+    A client that joins a stream that is already playing starts at the
+    current position.
+
+    Finished streams can be saved in a render cache (see rendercache.h),
+    which is then read instead of rendering the song again.
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <ctype.h>
+#include <time.h>
+#include <errno.h>
+#include <signal.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include "quattroplay.h"
+#include "rendercache.h"
+#include "lib/ini.h"
+#include "lib/thread.h"
+
+#define SERVER_RING (1<<20) // encoded bytes buffered per stream
+#define SERVER_CHUNK 2048 // frames rendered at a time
+#define SERVER_MAX_CLIENTS 256
+#define SERVER_TIMEOUT 30 // seconds a client can hold back a stream
+#define SERVER_START_TIME 10 // seconds to wait for a song to start
+
+enum {
+    FORMAT_WAV = 0,
+    FORMAT_S16,
+    FORMAT_F32,
+};
+static const char* format_names[] = {"wav","s16","f32"};
+
+enum {
+    STREAM_LOAD = 0, // waiting for a worker to load the game
+    STREAM_PLAY,
+    STREAM_END, // clients are sent the remaining data
+    STREAM_FAIL,
+};
+
+enum {
+    CLIENT_REQUEST = 0, // reading the request line
+    CLIENT_WAIT, // waiting for the stream to load
+    CLIENT_STREAM,
+    CLIENT_CLOSE, // sending an error, then closing
+};
+
+typedef struct stream_t stream_t;
+struct stream_t {
+    stream_t* next;
+
+    // request
+    char game[64];
+    int song;
+    int format;
+    int rate; // 0 = chip rate
+    int channels;
+    int loops;
+
+    // worker state, only used by the worker that set busy
+    QP_Player* player;
+    int slot;
+    int started;
+    int fading;
+    uint64_t frames;
+    float* render;
+    uint8_t* encoded;
+    FILE* cache_in; // cached render, used instead of the player
+    QP_RenderCacheWriter* cache_out;
+
+    int state;
+    int busy;
+    int clients;
+    int out_rate; // set when loaded
+    int bytes; // per frame
+    uint8_t* ring;
+    uint64_t head; // bytes written to the ring
+    char error[128];
+};
+
+typedef struct {
+    int fd;
+    int state;
+    stream_t* stream;
+    char line[256];
+    int line_len;
+    char pre[128]; // response line and header, sent before the stream
+    int pre_len;
+    int pre_pos;
+    uint64_t pos;
+    time_t stalled;
+} client_t;
+
+static struct {
+    char inipath[256];
+    char datapath[256];
+    char wavepath[256];
+    char cachepath[256];
+    char rendercache[256];
+    uint64_t rendercache_size;
+    QP_RenderCache* cache;
+
+    thread_mutex_t lock;
+    thread_cond_t work; // signalled when workers may have something to do
+    stream_t* streams;
+    client_t* clients[SERVER_MAX_CLIENTS];
+    int client_count;
+    int wake[2]; // workers write here when data is available
+    int quit;
+} server;
+
+static uint8_t* put32(uint8_t* d,uint32_t v)
+{
+    d[0]=v; d[1]=v>>8; d[2]=v>>16; d[3]=v>>24;
+    return d+4;
+}
+
+static uint8_t* put16(uint8_t* d,uint16_t v)
+{
+    d[0]=v; d[1]=v>>8;
+    return d+2;
+}
+
+// WAV header for a stream of unknown length
+static int wav_stream_header(uint8_t* d,int rate,int channels)
+{
+    uint8_t* p = d;
+    memcpy(p,"RIFF",4); p = put32(p+4,0xffffffff);
+    memcpy(p,"WAVEfmt ",8); p = put32(p+8,16);
+    p = put16(p,1);
+    p = put16(p,channels);
+    p = put32(p,rate);
+    p = put32(p,rate*channels*2);
+    p = put16(p,channels*2);
+    p = put16(p,16);
+    memcpy(p,"data",4); p = put32(p+4,0xffffffff);
+    return p-d;
+}
+
+static uint64_t stream_min_pos(stream_t* s)
+{
+    uint64_t pos = s->head;
+    int i;
+    for(i=0;i<server.client_count;i++)
+    {
+        client_t* c = server.clients[i];
+        if(c->stream == s && (c->state == CLIENT_WAIT || c->state == CLIENT_STREAM) && c->pos < pos)
+            pos = c->pos;
+    }
+    return pos;
+}
+
+// Space left in the ring buffer before the slowest client is overwritten.
+static int stream_space(stream_t* s)
+{
+    return SERVER_RING - (int)(s->head - stream_min_pos(s));
+}
+
+static void stream_free(stream_t* s)
+{
+    QP_PlayerDestroy(s->player);
+    if(s->cache_in)
+        fclose(s->cache_in);
+    if(s->cache_out)
+        QP_RenderCacheFinish(server.cache,s->cache_out,0);
+    free(s->encoded);
+    free(s->render);
+    free(s->ring);
+    free(s);
+}
+
+static void stream_load(stream_t* s)
+{
+    char ini[512];
+    int id;
+
+    s->player = QP_PlayerCreate(server.datapath,server.wavepath);
+    if(!s->player)
+    {
+        snprintf(s->error,sizeof(s->error),"Out of memory");
+        return;
+    }
+    QP_PlayerSetCachePath(s->player,server.cachepath);
+    snprintf(ini,sizeof(ini),"%s/%s.ini",server.inipath,s->game);
+    if(QP_PlayerOpen(s->player,ini,s->rate))
+    {
+        snprintf(s->error,sizeof(s->error),"%s",QP_PlayerGetError(s->player));
+        return;
+    }
+    s->slot = s->song & 0x800 ? 8 : 0;
+    id = s->song & 0x7ff;
+    if(id >= QP_PlayerGetSongCount(s->player,s->slot))
+    {
+        snprintf(s->error,sizeof(s->error),"Song ID out of range");
+        return;
+    }
+    QP_PlayerRequestSong(s->player,s->slot,id);
+    s->out_rate = QP_PlayerGetSampleRate(s->player);
+
+    if(server.cache)
+    {
+        // wav and s16 have the same data, only the header is different
+        int32_t opt[3] = {s->format == FORMAT_F32,s->channels,s->loops};
+        uint64_t key = QP_PlayerGetRenderKey(s->player,s->song,opt,sizeof(opt));
+        s->cache_in = QP_RenderCacheGet(server.cache,key);
+        if(s->cache_in)
+        {
+            QP_PlayerDestroy(s->player);
+            s->player = NULL;
+        }
+        else
+            s->cache_out = QP_RenderCachePut(server.cache,key);
+    }
+}
+
+// Render a chunk and encode it. Returns 1 if the song has ended.
+static int stream_encode(stream_t* s)
+{
+    int len = SERVER_CHUNK*s->channels;
+    uint8_t* d = s->encoded;
+    int i,status;
+
+    QP_PlayerRender(s->player,s->render,SERVER_CHUNK,s->channels);
+    for(i=0;i<len;i++)
+    {
+        float f = s->render[i];
+        if(s->format == FORMAT_F32)
+        {
+            memcpy(d,&f,4);
+            d += 4;
+        }
+        else
+        {
+            float v = f*32767.0f;
+            v = v < -32768.0f ? -32768.0f : v > 32767.0f ? 32767.0f : v;
+            d = put16(d,(int16_t)(v < 0 ? v-0.5f : v+0.5f));
+        }
+    }
+    s->frames += SERVER_CHUNK;
+
+    status = QP_PlayerGetSongStatus(s->player,s->slot);
+    if(status & (QP_SONG_PLAYING|QP_SONG_STARTING))
+        s->started = 1;
+    else if(s->started || s->frames > (uint64_t)s->out_rate*SERVER_START_TIME)
+        return 1;
+    if(s->loops && !s->fading && QP_PlayerGetLoopCount(s->player,s->slot) >= s->loops)
+    {
+        QP_PlayerFadeOutSong(s->player,s->slot);
+        s->fading = 1;
+    }
+    return 0;
+}
+
+// Render or read a chunk into the ring buffer. Returns the number of bytes.
+static int stream_render(stream_t* s,int* ended)
+{
+    int size = SERVER_CHUNK*s->bytes;
+    int start = s->head % SERVER_RING;
+    int len;
+
+    if(s->cache_in)
+    {
+        size = fread(s->encoded,1,size,s->cache_in);
+        *ended = size < SERVER_CHUNK*s->bytes;
+    }
+    else
+    {
+        *ended = stream_encode(s);
+        if(s->cache_out && QP_RenderCacheWrite(s->cache_out,s->encoded,size))
+        {
+            QP_RenderCacheFinish(server.cache,s->cache_out,0);
+            s->cache_out = NULL;
+        }
+        if(*ended && s->cache_out)
+        {
+            QP_RenderCacheFinish(server.cache,s->cache_out,1);
+            s->cache_out = NULL;
+        }
+    }
+
+    len = size < SERVER_RING - start ? size : SERVER_RING - start;
+    memcpy(s->ring+start,s->encoded,len);
+    memcpy(s->ring,s->encoded+len,size-len);
+    return size;
+}
+
+static void server_worker(void* arg)
+{
+    (void)arg;
+    thread_mutex_lock(&server.lock);
+    while(!server.quit)
+    {
+        stream_t *s, *pick = NULL, **prev;
+        int space, best = 0, ended = 0, size = 0;
+
+        for(prev = &server.streams; (s = *prev); )
+        {
+            // streams without clients are freed
+            if(!s->clients && !s->busy)
+            {
+                *prev = s->next;
+                thread_mutex_unlock(&server.lock);
+                stream_free(s);
+                thread_mutex_lock(&server.lock);
+                prev = &server.streams;
+                continue;
+            }
+            prev = &s->next;
+            if(s->busy)
+                continue;
+            // load first, then the stream with the most space
+            if(s->state == STREAM_LOAD)
+                space = SERVER_RING+1;
+            else if(s->state == STREAM_PLAY)
+                space = stream_space(s);
+            else
+                continue;
+            if(space >= SERVER_CHUNK*s->bytes && space > best)
+            {
+                best = space;
+                pick = s;
+            }
+        }
+        if(!pick)
+        {
+            thread_cond_wait(&server.work,&server.lock);
+            continue;
+        }
+        pick->busy = 1;
+        thread_mutex_unlock(&server.lock);
+
+        if(pick->state == STREAM_LOAD)
+            stream_load(pick);
+        else
+            size = stream_render(pick,&ended);
+
+        thread_mutex_lock(&server.lock);
+        if(pick->state == STREAM_LOAD && pick->error[0])
+            pick->state = STREAM_FAIL;
+        else if(pick->state == STREAM_LOAD)
+            pick->state = STREAM_PLAY;
+        else
+            pick->head += size;
+        if(ended)
+            pick->state = STREAM_END;
+        pick->busy = 0;
+
+        // a full pipe means the server is already awake
+        if(write(server.wake[1],"",1) < 0)
+            continue;
+    }
+    thread_mutex_unlock(&server.lock);
+}
+
+static int parse_request(client_t* c,stream_t* req)
+{
+    char cmd[16], format[16] = "wav";
+    int i,n;
+
+    memset(req,0,sizeof(*req));
+    req->rate = 48000;
+    req->channels = 2;
+    req->loops = 2;
+    n = sscanf(c->line,"%15s %63s %i %15s %i %i %i",cmd,req->game,&req->song,format,
+               &req->rate,&req->channels,&req->loops);
+    if(n < 3 || strcmp(cmd,"PLAY"))
+        return -1;
+
+    // game names are file names in the ini directory
+    for(i=0;req->game[i];i++)
+    {
+        if(!isalnum((unsigned char)req->game[i]) && req->game[i] != '_' && req->game[i] != '-')
+            return -1;
+    }
+    for(i=0;i<3;i++)
+    {
+        if(!strcmp(format,format_names[i]))
+            break;
+    }
+    req->format = i;
+    if(i == 3 || req->song < 0 || req->song > 0xfff || req->loops < 0
+       || (req->rate && (req->rate < 8000 || req->rate > 192000))
+       || (req->channels != 1 && req->channels != 2 && req->channels != 4))
+        return -1;
+    req->bytes = req->channels*(req->format == FORMAT_F32 ? 4 : 2);
+    return 0;
+}
+
+// Find a playing stream with the same options, or start a new one.
+static stream_t* stream_get(stream_t* req)
+{
+    stream_t* s;
+    for(s=server.streams;s;s=s->next)
+    {
+        if((s->state == STREAM_LOAD || s->state == STREAM_PLAY)
+           && !strcmp(s->game,req->game) && s->song == req->song && s->format == req->format
+           && s->rate == req->rate && s->channels == req->channels && s->loops == req->loops)
+            return s;
+    }
+
+    s = malloc(sizeof(*s));
+    if(!s)
+        return NULL;
+    *s = *req;
+    s->ring = malloc(SERVER_RING);
+    s->render = malloc(SERVER_CHUNK*s->channels*sizeof(float));
+    s->encoded = malloc(SERVER_CHUNK*s->bytes);
+    if(!s->ring || !s->render || !s->encoded)
+    {
+        free(s->ring);
+        free(s->render);
+        free(s->encoded);
+        free(s);
+        return NULL;
+    }
+    s->next = server.streams;
+    server.streams = s;
+    return s;
+}
+
+static void client_error(client_t* c,const char* msg)
+{
+    c->pre_len = snprintf(c->pre,sizeof(c->pre),"ERR %s\n",msg);
+    c->pre_pos = 0;
+    c->state = CLIENT_CLOSE;
+}
+
+static void client_read(client_t* c)
+{
+    stream_t req;
+    char* end;
+    int n = recv(c->fd,c->line+c->line_len,sizeof(c->line)-1-c->line_len,0);
+    if(n <= 0)
+    {
+        c->state = CLIENT_CLOSE;
+        c->pre_len = 0;
+        return;
+    }
+    c->line_len += n;
+    c->line[c->line_len] = 0;
+    end = strchr(c->line,'\n');
+    if(!end)
+    {
+        if(c->line_len == sizeof(c->line)-1)
+            client_error(c,"Request too long");
+        return;
+    }
+    *end = 0;
+
+    if(parse_request(c,&req))
+        return client_error(c,"Bad request");
+    c->stream = stream_get(&req);
+    if(!c->stream)
+        return client_error(c,"Out of memory");
+    c->stream->clients++;
+    c->pos = c->stream->head;
+    c->state = CLIENT_WAIT;
+    thread_cond_broadcast(&server.work);
+}
+
+// Stream loaded, send the response before the data.
+static void client_start(client_t* c)
+{
+    stream_t* s = c->stream;
+    c->pre_len = snprintf(c->pre,sizeof(c->pre),"OK %d %d %s\n",s->out_rate,s->channels,format_names[s->format]);
+    if(s->format == FORMAT_WAV)
+        c->pre_len += wav_stream_header((uint8_t*)c->pre+c->pre_len,s->out_rate,s->channels);
+    c->pre_pos = 0;
+    c->state = CLIENT_STREAM;
+}
+
+// Returns -1 if the connection should be closed.
+static int client_write(client_t* c)
+{
+    stream_t* s = c->stream;
+    int n;
+
+    if(c->pre_pos < c->pre_len)
+    {
+        n = send(c->fd,c->pre+c->pre_pos,c->pre_len-c->pre_pos,MSG_NOSIGNAL);
+        if(n < 0)
+            return errno == EAGAIN || errno == EWOULDBLOCK ? 0 : -1;
+        c->pre_pos += n;
+        if(c->pre_pos < c->pre_len)
+            return 0;
+    }
+    if(c->state == CLIENT_CLOSE)
+        return -1;
+
+    while(c->pos < s->head)
+    {
+        int start = c->pos % SERVER_RING;
+        int len = s->head - c->pos;
+        if(len > SERVER_RING - start)
+            len = SERVER_RING - start;
+        n = send(c->fd,s->ring+start,len,MSG_NOSIGNAL);
+        if(n < 0)
+            return errno == EAGAIN || errno == EWOULDBLOCK ? 0 : -1;
+        c->pos += n;
+        // the stream may have space to render again
+        thread_cond_broadcast(&server.work);
+        if(n < len)
+            return 0;
+    }
+    return s->state == STREAM_END ? -1 : 0;
+}
+
+static void client_remove(int i)
+{
+    client_t* c = server.clients[i];
+    if(c->stream)
+    {
+        c->stream->clients--;
+        thread_cond_broadcast(&server.work);
+    }
+    close(c->fd);
+    free(c);
+    server.clients[i] = server.clients[--server.client_count];
+}
+
+static void client_accept(int lfd)
+{
+    client_t* c;
+    int fd = accept(lfd,NULL,NULL);
+    if(fd < 0)
+        return;
+    c = calloc(1,sizeof(*c));
+    if(!c || server.client_count == SERVER_MAX_CLIENTS)
+    {
+        free(c);
+        close(fd);
+        return;
+    }
+    fcntl(fd,F_SETFL,fcntl(fd,F_GETFL) | O_NONBLOCK);
+    c->fd = fd;
+    server.clients[server.client_count++] = c;
+}
+
+static int server_listen(const char* socketpath,int port)
+{
+    int fd;
+    if(socketpath)
+    {
+        struct sockaddr_un addr;
+        memset(&addr,0,sizeof(addr));
+        addr.sun_family = AF_UNIX;
+        snprintf(addr.sun_path,sizeof(addr.sun_path),"%s",socketpath);
+        unlink(socketpath);
+        fd = socket(AF_UNIX,SOCK_STREAM,0);
+        if(fd < 0 || bind(fd,(struct sockaddr*)&addr,sizeof(addr)))
+            return -1;
+    }
+    else
+    {
+        struct sockaddr_in addr;
+        int one = 1;
+        memset(&addr,0,sizeof(addr));
+        addr.sin_family = AF_INET;
+        addr.sin_port = htons(port);
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        fd = socket(AF_INET,SOCK_STREAM,0);
+        if(fd < 0)
+            return -1;
+        setsockopt(fd,SOL_SOCKET,SO_REUSEADDR,&one,sizeof(one));
+        if(bind(fd,(struct sockaddr*)&addr,sizeof(addr)))
+            return -1;
+    }
+    if(listen(fd,16))
+        return -1;
+    return fd;
+}
+
+static void server_run(int lfd)
+{
+    struct pollfd fds[SERVER_MAX_CLIENTS+2];
+    char buf[64];
+    int i,n;
+
+    for(;;)
+    {
+        time_t now = time(NULL);
+
+        thread_mutex_lock(&server.lock);
+        for(i=0;i<server.client_count;)
+        {
+            client_t* c = server.clients[i];
+            stream_t* s = c->stream;
+            int drop = 0;
+
+            if(c->state == CLIENT_WAIT && s->state == STREAM_FAIL)
+                client_error(c,s->error);
+            else if(c->state == CLIENT_WAIT && s->state != STREAM_LOAD)
+                client_start(c);
+            if(c->state == CLIENT_STREAM || (c->state == CLIENT_CLOSE && c->pre_pos < c->pre_len))
+                drop = client_write(c);
+            else if(c->state == CLIENT_CLOSE)
+                drop = 1;
+
+            // drop clients that hold back the stream for too long
+            if(c->state == CLIENT_STREAM && s->head - c->pos > SERVER_RING - SERVER_CHUNK*s->bytes)
+            {
+                if(!c->stalled)
+                    c->stalled = now;
+                else if(now - c->stalled > SERVER_TIMEOUT)
+                    drop = 1;
+            }
+            else
+                c->stalled = 0;
+
+            if(drop)
+                client_remove(i);
+            else
+                i++;
+        }
+
+        n = 0;
+        fds[n].fd = lfd;
+        fds[n++].events = POLLIN;
+        fds[n].fd = server.wake[0];
+        fds[n++].events = POLLIN;
+        for(i=0;i<server.client_count;i++)
+        {
+            client_t* c = server.clients[i];
+            fds[n].fd = c->fd;
+            fds[n].events = 0;
+            if(c->state == CLIENT_REQUEST)
+                fds[n].events = POLLIN;
+            else if(c->pre_pos < c->pre_len || (c->state == CLIENT_STREAM && c->pos < c->stream->head))
+                fds[n].events = POLLOUT;
+            n++;
+        }
+        thread_mutex_unlock(&server.lock);
+
+        if(poll(fds,n,1000) < 0 && errno != EINTR)
+            break;
+
+        thread_mutex_lock(&server.lock);
+        if(fds[1].revents & POLLIN)
+        {
+            while(read(server.wake[0],buf,sizeof(buf)) > 0)
+                ;
+        }
+        // clients are only added and removed by this thread, so the
+        // indexes still match
+        for(i=server.client_count-1;i>=0;i--)
+        {
+            client_t* c = server.clients[i];
+            if(fds[i+2].revents & (POLLERR|POLLHUP|POLLNVAL) && c->state != CLIENT_REQUEST)
+                client_remove(i);
+            else if(fds[i+2].revents & POLLIN)
+                client_read(c);
+        }
+        if(fds[0].revents & POLLIN)
+            client_accept(lfd);
+        thread_mutex_unlock(&server.lock);
+    }
+}
+
+static void read_config(const char* filename)
+{
+    inifile_t ini;
+    if(ini_open((char*)filename,&ini))
+        return;
+    while(!ini_readnext(&ini))
+    {
+        if(strcmp(ini.section,"config"))
+            continue;
+        if(!strcmp(ini.key,"inipath"))
+            snprintf(server.inipath,sizeof(server.inipath),"%s",ini.value);
+        else if(!strcmp(ini.key,"datapath"))
+            snprintf(server.datapath,sizeof(server.datapath),"%s",ini.value);
+        else if(!strcmp(ini.key,"wavepath"))
+            snprintf(server.wavepath,sizeof(server.wavepath),"%s",ini.value);
+        else if(!strcmp(ini.key,"cachepath"))
+            snprintf(server.cachepath,sizeof(server.cachepath),"%s",ini.value);
+        else if(!strcmp(ini.key,"rendercache"))
+            snprintf(server.rendercache,sizeof(server.rendercache),"%s",ini.value);
+        else if(!strcmp(ini.key,"rendercachesize"))
+            server.rendercache_size = (uint64_t)atoi(ini.value)<<20;
+    }
+    ini_close(&ini);
+}
+
+int main(int argc,char* argv[])
+{
+    const char* socketpath = NULL;
+    int port = 7270;
+    int threads = 4;
+    int lfd,i;
+    thread_t* workers;
+
+    strcpy(server.inipath,"ini");
+    strcpy(server.datapath,"roms");
+    strcpy(server.wavepath,"roms");
+    server.rendercache_size = (uint64_t)1024<<20;
+    read_config("quattroplay.ini");
+
+    for(i=1;i<argc;i++)
+    {
+        if(!strcmp(argv[i],"-p") && i+1<argc)
+            port = atoi(argv[++i]);
+        else if(!strcmp(argv[i],"-u") && i+1<argc)
+            socketpath = argv[++i];
+        else if(!strcmp(argv[i],"-t") && i+1<argc)
+            threads = atoi(argv[++i]);
+        else if(!strcmp(argv[i],"-r") && i+1<argc)
+            snprintf(server.rendercache,sizeof(server.rendercache),"%s",argv[++i]);
+        else
+        {
+            printf("usage: %s [-p port] [-u socket path] [-t worker threads] [-r render cache path]\n",argv[0]);
+            printf("paths are read from quattroplay.ini, the render cache from rendercache and\n");
+            printf("rendercachesize (in MB, default 1024) in the [config] section\n");
+            return -1;
+        }
+    }
+    if(threads < 1)
+        threads = 1;
+    if(*server.rendercache)
+        server.cache = QP_RenderCacheOpen(server.rendercache,server.rendercache_size);
+
+    signal(SIGPIPE,SIG_IGN);
+    lfd = server_listen(socketpath,port);
+    if(lfd < 0)
+    {
+        perror("listen");
+        return -1;
+    }
+    if(pipe(server.wake))
+        return -1;
+    fcntl(server.wake[0],F_SETFL,O_NONBLOCK);
+    fcntl(server.wake[1],F_SETFL,O_NONBLOCK);
+
+    thread_mutex_init(&server.lock);
+    thread_cond_init(&server.work);
+    workers = malloc(threads*sizeof(thread_t));
+    for(i=0;i<threads;i++)
+    {
+        if(thread_create(&workers[i],server_worker,NULL))
+            break;
+    }
+    threads = i;
+    if(!threads)
+        return -1;
+    if(socketpath)
+        printf("listening on %s, %d workers\n",socketpath,threads);
+    else
+        printf("listening on 127.0.0.1:%d, %d workers\n",port,threads);
+
+    server_run(lfd);
+
+    thread_mutex_lock(&server.lock);
+    server.quit = 1;
+    thread_cond_broadcast(&server.work);
+    thread_mutex_unlock(&server.lock);
+    for(i=0;i<threads;i++)
+        thread_join(&workers[i]);
+    return 0;
+}
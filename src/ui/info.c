@@ -14,7 +14,19 @@
 #include "ui.h"
 #include "scr_main.h"
 
-void ui_info_track(int id,int ypos)
+// The pages read the driver directly, so they are drawn between
+// DriverReadBegin and DriverReadRetry and redrawn if a tick got in between.
+#define INFO_RETRIES 8
+
+static void ui_info_clear(int ypos)
+{
+    int i;
+    for(i=ypos;i<FROWS-1;i++)
+        memset(&screen.text[i][44],0,sizeof(screen.text[i])-44);
+    set_color(ypos,44,FROWS-1-ypos,FCOLUMNS-44,COLOR_BLACK,COLOR_L_GREY);
+}
+
+static void ui_info_draw_track(int id,int ypos)
 {
     switch(DriverInterface->Type)
     {
@@ -27,7 +39,7 @@ void ui_info_track(int id,int ypos)
     }
 }
 
-void ui_info_voice(int id,int ypos)
+static void ui_info_draw_voice(int id,int ypos)
 {
     switch(DriverInterface->Type)
     {
@@ -39,3 +51,29 @@ void ui_info_voice(int id,int ypos)
         break;
     }
 }
+
+void ui_info_track(int id,int ypos)
+{
+    int tries = INFO_RETRIES;
+    uint32_t seq;
+    do
+    {
+        ui_info_clear(ypos);
+        seq = DriverReadBegin();
+        ui_info_draw_track(id,ypos);
+    }
+    while(DriverReadRetry(seq) && --tries);
+}
+
+void ui_info_voice(int id,int ypos)
+{
+    int tries = INFO_RETRIES;
+    uint32_t seq;
+    do
+    {
+        ui_info_clear(ypos);
+        seq = DriverReadBegin();
+        ui_info_draw_voice(id,ypos);
+    }
+    while(DriverReadRetry(seq) && --tries);
+}
@@ -179,7 +179,7 @@ void ui_info_s2_track(int id,int ypos)
                     oct = (S->DriverType==S2X_TYPE_NA) ? 8 : 16;
                     // grey out if the voice is not currently playing
                     oct = (T->Channel[i].Enabled) ? T->Channel[i].VoiceNo : oct+i;
-                    if(!S->SE[i].Type || S->SE[i].Track != id || (DriverGetVoiceStatus(oct)&0xf000) != 0xf000)
+                    if(!S->SE[i].Type || S->SE[i].Track != id || (DriverGetSnapshot()->VoiceStatus[oct&31]&0xf000) != 0xf000)
                         c2 = COLOR_L_GREY;
                 }
                 else if(!note)
@@ -46,7 +46,7 @@ void scr_about()
 */
 
         y+=h+1;
-        h=8;
+        h=10;
 
         set_color(y,1,h,FCOLUMNS-2,COLOR_D_BLUE,COLOR_L_GREY);
         SCRN(y+1,2,FCOLUMNS-3,"Audio settings");
@@ -62,6 +62,10 @@ void scr_about()
         snprintf(temp,80,"%d-bit %s",SDL_AUDIO_BITSIZE(af),SDL_AUDIO_ISFLOAT(af)?"Float":"");
         SCRN(y+6,3,FCOLUMNS-4,"%-20s%s",
              "Format",temp);
+        SCRN(y+7,3,FCOLUMNS-4,"%-20s%.0f%%",
+             "Load", Audio->state.Load*100);
+        SCRN(y+8,3,FCOLUMNS-4,"%-20s%d (%d changes)",
+             "Quality tier", Audio->state.QualityTier, Audio->state.TierChanges);
 
         if(got_input)
             screen_mode = last_scrmode;
@@ -36,12 +36,14 @@ static void drawreg(int val,int y,int x)
     colorsel_t c = COLOR_N_GREY;
     colorsel_t bg= COLOR_D_BLUE;
 
+    const struct QP_DriverSnapshot *snap = DriverGetSnapshot();
+
     if(val < 0x20)
     {
-        if(DriverGetSlotCount()-1 < val)
+        if(snap->SlotCount-1 < val)
             unmapped=1;
         else
-            v = DriverGetSongId(val)|DriverGetSongStatus(val);
+            v = snap->SongId[val]|snap->SongStatus[val];
     }
     else if(val < 0x120)
     {
@@ -51,7 +53,7 @@ static void drawreg(int val,int y,int x)
         else
             v = DriverGetParameter(a);
     }
-    else if(val < 0x140 && DriverGetVoiceCount()-1 >= a)
+    else if(val < 0x140 && snap->VoiceCount-1 >= a)
     {
         uint32_t solomask = DriverGetSolo();
         uint32_t mutemask = DriverGetMute();
@@ -62,7 +64,7 @@ static void drawreg(int val,int y,int x)
         //    v = 0x8000|(QDrv->Voice[a].TrackNo-1)<<8|(QDrv->Voice[a].ChannelNo);
         //if(QDrv->Voice[a].Enabled)
         //    v |= 0x80;
-        v = DriverGetVoiceStatus(a);
+        v = snap->VoiceStatus[a];
 
         if(solomask)
         {
@@ -137,6 +139,8 @@ static void ui_entry_setvalue(int flag, int type, int offset, int value)
     case ENTRY_SONGREQ:
         Game->PlaylistControl = 0;
         DriverResetLoopCount();
+        if(flag && !QP_AudioTriggerSong(Audio,offset,value))
+            break;
         if(DRV_QUATTRO)
         {
             if(flag)
@@ -172,7 +176,7 @@ static void ui_convert_currval()
             return;
         curr_val_type = ENTRY_SONGREQ;
         //curr_val_edit = QDrv->SongRequest[curr_val_offset] & 0x7ff;
-        curr_val_edit = DriverGetSongId(curr_val_offset);
+        curr_val_edit = DriverGetSnapshot()->SongId[curr_val_offset&0x1f];
     }
     else if(curr_val < 0x120)
     {
@@ -401,6 +405,7 @@ void scr_main()
     }
 
     int i, j=0, x=0, y=0;
+    const struct QP_DriverSnapshot *snap = DriverGetSnapshot();
 
     SCRN(1,1,FCOLUMNS-2,"%s",DriverGetSongMessage());
 
@@ -436,18 +441,18 @@ void scr_main()
     if(curr_val < 0x20)
     {
         i=curr_val;
-        if(i<DriverGetSlotCount())
+        if(i<snap->SlotCount)
         {
             ui_info_track(i,5);
             x += SCRN(49,1+x,48,", R: Restart, S: Stop, F: Fade");
-            j += SCRN(3,1,40,"Track %02x = %04x",i,DriverGetSongId(i));
+            j += SCRN(3,1,40,"Track %02x = %04x",i,snap->SongId[i]);
 
-            double timer = DriverGetPlayingTime(i);
+            double timer = snap->SongTime[i];
             y += SCRN(3,44+y,40,"%s %2.0f:%02.0f",
-                     DriverGetSongStatus(i)&0x8000 ? "Playing" : "Stopped",
+                     snap->SongStatus[i]&0x8000 ? "Playing" : "Stopped",
                      floor(timer/60),floor(fmod(timer,60)));
 
-            int8_t loopcount = DriverGetLoopCount(curr_val); //Q_LoopDetectionGetCount(QDrv,curr_val);
+            int8_t loopcount = snap->LoopCount[i]; //Q_LoopDetectionGetCount(QDrv,curr_val);
             if(loopcount > 0)
                 y += SCRN(3,44+y,15,", Loop%3d",loopcount);
         }
@@ -470,7 +475,7 @@ void scr_main()
         ui_info_voice(i,5);
         SCRN(3,1,40,"Voice %02x",i);
 
-        i = DriverGetVoiceStatus(i);
+        i = i < snap->VoiceCount ? snap->VoiceStatus[i] : 0;
         if(i&0x8000)
             SCRN(3,44,40,"Track %02x, Channel %02x",(i>>8)&0x1f,i&0x0f);
     }
@@ -123,7 +123,7 @@ static int item_get_value(struct main2_item *i)
     switch(i->type)
     {
     case ITEM_SONGREQ:
-        return DriverGetSongId(i->index);
+        return DriverGetSnapshot()->SongId[i->index];
     case ITEM_PARAMETER:
         return DriverGetParameter(i->index);
     default:
@@ -139,6 +139,8 @@ static void item_set_value(struct main2_item *i,int value)
     case ITEM_SONGREQ:
         Game->PlaylistControl = 0;
         DriverResetLoopCount();
+        if(!QP_AudioTriggerSong(Audio,i->index,value))
+            return;
         return DriverRequestSong(i->index,value);
     case ITEM_PARAMETER:
         return DriverSetParameter(i->index,value);
@@ -180,8 +182,9 @@ static char* item_display_value(struct main2_item *i,char* buffer,int len)
 
         if(i->type == ITEM_SONGREQ)
         {
-            int status = DriverGetSongStatus(i->index);
-            int loopcnt = DriverGetLoopCount(i->index);
+            const struct QP_DriverSnapshot *snap = DriverGetSnapshot();
+            int status = snap->SongStatus[i->index];
+            int loopcnt = snap->LoopCount[i->index];
 
             switch(status&(SONG_STATUS_STARTING|SONG_STATUS_PLAYING))
             {
@@ -189,7 +192,7 @@ static char* item_display_value(struct main2_item *i,char* buffer,int len)
             default:
                 break;
             case SONG_STATUS_PLAYING:
-                songtime = DriverGetPlayingTime(i->index);
+                songtime = snap->SongTime[i->index];
                 if(status & SONG_STATUS_SUBSONG)
                     CATF(buffer,len," (Sub)");
                 else if(loopcnt>0)
@@ -130,7 +130,8 @@ void scr_playlist_kbd()
     int16_t pitch;
     int has_drums=0;
 
-    int cnt = DriverGetVoiceCount();
+    const struct QP_DriverSnapshot *snap = DriverGetSnapshot();
+    int cnt = snap->VoiceCount;
     if(!cnt)
         return;
     if(cnt>MAX_VOICES) cnt=MAX_VOICES;
@@ -142,8 +143,9 @@ void scr_playlist_kbd()
     // Get voice info
     for(i=0;i<cnt;i++)
     {
-        if(!DriverGetVoiceInfo(i,&vi[id]))
+        if(snap->VoiceInfoValid[i])
         {
+            vi[id] = snap->VoiceInfo[i];
             if((vi[id].VoiceType&0x0f) == VOICE_TYPE_PERCUSSION)
             {
                 has_drums=1;
@@ -344,7 +346,7 @@ void scr_playlist()
 
         if(disp_timer)
         {
-            double songtime = DriverGetPlayingTime(SongReq);
+            double songtime = DriverGetSnapshot()->SongTime[SongReq];
             SCRN(3,FCOLUMNS-6,6,"%2.0f:%02.0f",
                 floor(songtime/60),floor(fmod(songtime,60)));
         }
@@ -4,7 +4,11 @@
 #include "ui.h"
 
 #define PLPAGE (FROWS-7)
+// preload the highlighted game after the cursor has stopped for this long (ms)
+#define PRELOAD_DELAY 300
     static int select_pos;
+    static int preload_pos = -1;
+    static uint32_t select_time;
 
 static void select_pos_check()
 {
@@ -30,17 +34,18 @@ static void scr_select_input()
             increment *= PLPAGE;
         select_pos  += increment;
         select_pos_check();
+        select_time = SDL_GetTicks();
         break;
     case SDLK_RETURN:
     case SDLK_KP_ENTER:
         running = 0;
         returncode = select_pos+1;
         select_pos_check();
-        Game->PlaylistPosition=select_pos;
         break;
     case SDLK_F3: // refresh rom defs
         if(!Audit->AuditFlag)
             Audit->Count = 0;
+        preload_pos = -1;
         break;
     default:
         break;
@@ -100,6 +105,13 @@ void scr_select()
         if(got_input)
             scr_select_input();
 
+        if(!Audit->AuditFlag && preload_pos != select_pos && Audit->Entry[select_pos].RomOk &&
+           SDL_GetTicks() - select_time > PRELOAD_DELAY)
+        {
+            preload_pos = select_pos;
+            QP_GameManagerPreload(GameManager,Audit->Entry[select_pos].Name);
+        }
+
         int y = 0;
         int i = select_pos;
         int offset = 0;
@@ -3,6 +3,7 @@
 #include "SDL2/SDL.h"
 
 #include "../qp.h"
+#include "../lib/trace.h"
 
 #include "ui.h"
 #include "scr_main.h"
@@ -38,7 +39,7 @@ void ui_drawscreen()
                  Audio->state.MuteRear ? "Stereo" : " Quad ",
                  Audio->state.FastForward ? "Fast Forward" : "");
         if(Audio->state.FileLogging)
-            SCRN(0,15+i,20,"Logging %8d ...",Audio->state.LogSamples);
+            SCRN(0,15+i,20,"Logging %8lu ...",(unsigned long)Audio->state.LogSamples);
     }
 
     switch(screen_mode)
@@ -171,12 +172,17 @@ void ui_handleinput(SDL_Keysym* ks)
     case SDLK_F11:
         if(gameloaded)
         {
-            SDL_LockAudioDevice(Audio->dev);
+            // these lock the audio device themselves, so that the file
+            // isn't closed while the audio device is locked.
             if(Audio->state.FileLogging == 0)
-                QP_AudioWavOpen(Audio,"qp_log.wav");
+            {
+                char filename[32];
+                sprintf(filename,"qp_log.%s",wav_extension(Game->WavFormat));
+                if(!QP_AudioWavOpen(Audio,filename,Game->WavFormat))
+                    wav_tag(Audio->state.WavFile,"ALBUM",Game->Title);
+            }
             else
                 QP_AudioWavClose(Audio);
-            SDL_UnlockAudioDevice(Audio->dev);
         }
         break;
     case SDLK_F12:
@@ -242,6 +248,7 @@ int ui_main(screen_mode_t sm)
 
     frame_cnt= 0;
     lasttick= SDL_GetTicks();
+    Uint32 lastevent = lasttick;
     #ifdef RENDER_PROFILING
 
     lasttick= SDL_GetTicks();
@@ -254,10 +261,13 @@ int ui_main(screen_mode_t sm)
 
     while(running)
     {
-        //SDL_WaitEvent(NULL);
+        // nothing is playing, so wait for input instead of redrawing
+        if(Audio->state.Idle && SDL_GetTicks()-lastevent > UI_IDLE_WAIT)
+            SDL_WaitEventTimeout(NULL,UI_IDLE_WAIT);
 
         while(SDL_PollEvent(&event))
         {
+            lastevent = SDL_GetTicks();
             switch(event.type)
             {
             case SDL_QUIT:
@@ -289,8 +299,11 @@ int ui_main(screen_mode_t sm)
         // Redraw the screen
 
 
+        TRACE_THREAD_NAME("ui");
+        TRACE_BEGIN("ui frame");
         RP_START(rp1);
         SDL_SetRenderTarget(rend,dispbuf);
+        DriverUpdateSnapshot();
         ui_drawscreen();
         if(debug_stat)
         {
@@ -313,6 +326,7 @@ int ui_main(screen_mode_t sm)
         RP_START(rp3)
         ui_refresh();
         RP_END(rp3,rp3r);
+        TRACE_END("ui frame");
         //ui_drawscreen();
         //sprintf(&screen.text[0][0],"ID = %04x",count);
         //update_text();
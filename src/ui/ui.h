@@ -9,6 +9,7 @@
 #define UI_FPS 30
 // Amount of frames to sample for FPS counting
 #define UI_FPS_SAMPLES 16
+#define UI_IDLE_WAIT 250 // max ms between redraws while the audio is idle
 
 #define UI_NOTICE_TIME 100
 
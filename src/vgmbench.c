@@ -0,0 +1,176 @@
+/*
+    Chip emulation benchmark
+
+    Plays a VGM log to the C352 and YM2151 emulators and reports the update
+    rate of each chip. Output hashes can be saved and compared to check that
+    a change to the emulation does not change the output.
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "vgmplay.h"
+
+static const char* chip_name[VGM_CHIPS] = {"c352","ym2151"};
+static const char* chip_label[VGM_CHIPS] = {"C352","YM2151"};
+
+#define BENCH_BLOCK 4410
+
+static int compare_hashes(const char* filename,QP_VgmPlayer* v)
+{
+    char name[32];
+    unsigned long long hash;
+    int i,found,errors = 0;
+    int listed[VGM_CHIPS] = {0};
+    FILE* f = fopen(filename,"r");
+    if(!f)
+    {
+        printf("Could not open '%s'\n",filename);
+        return -1;
+    }
+    while(fscanf(f,"%31s %llx",name,&hash) == 2)
+    {
+        for(i=0,found=0;i<VGM_CHIPS;i++)
+        {
+            if(strcmp(name,chip_name[i]) || !v->chip[i].enabled)
+                continue;
+            found = 1;
+            listed[i] = 1;
+            if(v->chip[i].hash != hash)
+            {
+                printf("%s output differs (%016llx, expected %016llx)\n",
+                       chip_label[i],(unsigned long long)v->chip[i].hash,hash);
+                errors++;
+            }
+        }
+        if(!found)
+        {
+            printf("%s is not in the VGM file\n",name);
+            errors++;
+        }
+    }
+    for(i=0;i<VGM_CHIPS;i++)
+    {
+        if(v->chip[i].enabled && !listed[i])
+        {
+            printf("%s is not in '%s'\n",chip_label[i],filename);
+            errors++;
+        }
+    }
+    fclose(f);
+    if(!errors)
+        printf("Output matches '%s'\n",filename);
+    return errors ? -1 : 0;
+}
+
+static int save_hashes(const char* filename,QP_VgmPlayer* v)
+{
+    int i;
+    FILE* f = fopen(filename,"w");
+    if(!f)
+    {
+        printf("Could not write '%s'\n",filename);
+        return -1;
+    }
+    for(i=0;i<VGM_CHIPS;i++)
+    {
+        if(v->chip[i].enabled)
+            fprintf(f,"%s %016llx\n",chip_name[i],(unsigned long long)v->chip[i].hash);
+    }
+    fclose(f);
+    return 0;
+}
+
+int main(int argc,char* argv[])
+{
+    const char* filename = NULL;
+    const char* savefile = NULL;
+    const char* comparefile = NULL;
+    int repeat = 1;
+    int noint = 0, c140 = 0;
+    double best[VGM_CHIPS];
+    char msg[256];
+    QP_VgmPlayer* v;
+    int i,n;
+
+    for(i=1;i<argc;i++)
+    {
+        if(!strcmp(argv[i],"-n") && i+1<argc)
+            repeat = atoi(argv[++i]);
+        else if(!strcmp(argv[i],"-s") && i+1<argc)
+            savefile = argv[++i];
+        else if(!strcmp(argv[i],"-c") && i+1<argc)
+            comparefile = argv[++i];
+        else if(!strcmp(argv[i],"-noint"))
+            noint = 1;
+        else if(!strcmp(argv[i],"-c140"))
+            c140 = 1;
+        else if(*argv[i] != '-' && !filename)
+            filename = argv[i];
+        else
+            filename = NULL, i = argc;
+    }
+    if(!filename)
+    {
+        printf("usage: %s [options] file.vgm\n",argv[0]);
+        printf("  -n count   play the file count times, the fastest run is reported\n");
+        printf("  -s file    save the output hashes\n");
+        printf("  -c file    compare the output hashes, exit code is 1 if different\n");
+        printf("  -noint     disable C352 interpolation\n");
+        printf("  -c140      use C140 mulaw samples (System 2 logs)\n");
+        return -1;
+    }
+    if(repeat < 1)
+        repeat = 1;
+
+    v = malloc(sizeof(*v));
+    if(!v || QP_VgmOpen(v,filename,msg,sizeof(msg)))
+    {
+        printf("%s\n",v ? msg : "Out of memory");
+        free(v);
+        return -1;
+    }
+
+    // the settings are kept when restarting
+    v->timing = 1;
+    v->c352.no_interpolation = noint;
+    if(c140)
+        v->c352.mulaw_type = C352_MULAW_TYPE_C140;
+
+    for(n=0;n<repeat;n++)
+    {
+        QP_VgmRestart(v);
+        while(QP_VgmRun(v,BENCH_BLOCK))
+            ;
+        for(i=0;i<VGM_CHIPS;i++)
+        {
+            if(!n || v->chip[i].time < best[i])
+                best[i] = v->chip[i].time;
+        }
+    }
+
+    printf("%s: %.2f seconds\n",filename,(double)v->position/VGM_RATE);
+    printf("%-8s %12s %10s %10s %14s %10s  %s\n","chip","updates","writes","seconds","updates/s","realtime","hash");
+    for(i=0;i<VGM_CHIPS;i++)
+    {
+        QP_VgmChip* c = &v->chip[i];
+        double rate;
+        if(!c->enabled)
+            continue;
+        rate = best[i] > 0 ? c->updates/best[i] : 0;
+        printf("%-8s %12llu %10llu %10.3f %14.0f %9.1fx  %016llx\n",
+               chip_label[i],(unsigned long long)c->updates,(unsigned long long)c->writes,
+               best[i],rate,rate/(c->delta*VGM_RATE),(unsigned long long)c->hash);
+    }
+
+    n = 0;
+    if(savefile && save_hashes(savefile,v))
+        n = -1;
+    if(comparefile && compare_hashes(comparefile,v))
+        n = 1;
+
+    QP_VgmClose(v);
+    free(v);
+    return n;
+}
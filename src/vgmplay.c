@@ -0,0 +1,340 @@
+/*
+    VGM player
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+
+#include "vgmplay.h"
+#include "loader.h"
+#include "lib/fileio.h"
+
+#define FNV_OFFSET 0xcbf29ce484222325ULL
+#define FNV_PRIME 0x100000001b3ULL
+
+static uint32_t vgm_read32(const uint8_t* d)
+{
+    return d[0] | d[1]<<8 | d[2]<<16 | (uint32_t)d[3]<<24;
+}
+
+static double vgm_time()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC,&ts);
+    return ts.tv_sec + ts.tv_nsec*1e-9;
+}
+
+static uint64_t vgm_hash(uint64_t h,const double* out,int count)
+{
+    int i,j;
+    for(i=0;i<count;i++)
+    {
+        uint32_t s = (int32_t)out[i];
+        for(j=0;j<4;j++)
+        {
+            h ^= (s>>(j*8))&0xff;
+            h *= FNV_PRIME;
+        }
+    }
+    return h;
+}
+
+// Length of commands for other chips, which are skipped. 0 if unknown.
+static int vgm_cmdlen(uint8_t cmd)
+{
+    if(cmd >= 0x30 && cmd <= 0x3f)
+        return 2;
+    if(cmd >= 0x40 && cmd <= 0x4e)
+        return 3;
+    if(cmd == 0x4f || cmd == 0x50)
+        return 2;
+    if(cmd >= 0x51 && cmd <= 0x5f)
+        return 3;
+    if(cmd == 0x68)
+        return 12;
+    if(cmd >= 0x90 && cmd <= 0x95)
+    {
+        static const int len[6] = {5,5,6,11,2,5};
+        return len[cmd-0x90];
+    }
+    if(cmd >= 0xa0 && cmd <= 0xbf)
+        return 3;
+    if(cmd >= 0xc0 && cmd <= 0xdf)
+        return 4;
+    if(cmd >= 0xe0)
+        return 5;
+    return 0;
+}
+
+static void vgm_chip_init(QP_VgmPlayer* v)
+{
+    uint32_t clock = v->chip[VGM_C352].clock;
+    int mulaw_type = v->c352.mulaw_type;
+    int no_interpolation = v->c352.no_interpolation;
+    int div;
+
+    memset(&v->c352,0,sizeof(C352));
+    C352_init(&v->c352,clock & 0x7fffffff);
+    C352_set_mulaw_type(&v->c352,mulaw_type);
+    v->c352.no_interpolation = no_interpolation;
+    v->c352.mute_rear = clock>>31;
+    v->c352.wave = v->wave;
+    v->c352.wave_mask = v->wave_size ? v->wave_size-1 : 0;
+    v->c352.vgm = NULL;
+    div = v->start > 0xd6 ? v->data[0xd6]*4 : 0;
+    if(div)
+        v->c352.rate = (clock & 0x7fffffff)/div;
+    v->chip[VGM_C352].delta = (double)v->c352.rate / VGM_RATE;
+
+    memset(&v->ym2151,0,sizeof(YM2151));
+    YM2151_init(&v->ym2151,v->chip[VGM_YM2151].clock);
+    YM2151_reset(&v->ym2151);
+    v->chip[VGM_YM2151].delta = (double)v->ym2151.rate / VGM_RATE;
+}
+
+// Copy the 0x92 data blocks into the C352 rom. The rom size is rounded up
+// to a power of two so it can be used as the address mask.
+static int vgm_load_blocks(QP_VgmPlayer* v)
+{
+    uint32_t pos = v->start;
+    while(pos+7 <= v->size && v->data[pos] == 0x67)
+    {
+        uint8_t type = v->data[pos+2];
+        uint32_t size = vgm_read32(v->data+pos+3) & 0x7fffffff;
+        if((uint64_t)pos+7+size > v->size)
+            return -1;
+        if(type == 0x92 && size >= 8)
+        {
+            uint32_t romsize = vgm_read32(v->data+pos+7);
+            uint32_t start = vgm_read32(v->data+pos+11);
+            uint32_t len = size-8;
+            uint32_t alloc = 1;
+            // keep the rom within the game wave limit, so that the size
+            // can't overflow below
+            if(romsize > GAME_WAVE_MAX || start > GAME_WAVE_MAX || len > GAME_WAVE_MAX-start)
+                return -1;
+            while(alloc < romsize || (uint64_t)alloc < (uint64_t)start+len)
+                alloc <<= 1;
+            if(alloc > v->wave_size)
+            {
+                uint8_t* wave = realloc(v->wave,alloc);
+                if(!wave)
+                    return -1;
+                memset(wave+v->wave_size,0,alloc-v->wave_size);
+                v->wave = wave;
+                v->wave_size = alloc;
+            }
+            memcpy(v->wave+start,v->data+pos+15,len);
+        }
+        pos += 7+size;
+    }
+    return 0;
+}
+
+int QP_VgmOpen(QP_VgmPlayer* v,const char* filename,char* msg,int msglen)
+{
+    char fn[512];
+    memset(v,0,sizeof(*v));
+    snprintf(fn,sizeof(fn),"%s",filename);
+    if(load_file(fn,&v->data,&v->size))
+    {
+        snprintf(msg,msglen,"Could not open '%s'",filename);
+        return -1;
+    }
+    if(v->size < 0x40 || memcmp(v->data,"Vgm ",4))
+    {
+        snprintf(msg,msglen,"'%s' is not a VGM file (compressed files are not supported)",filename);
+        QP_VgmClose(v);
+        return -1;
+    }
+
+    // header fields depend on the version, missing fields are zero
+    v->samples = vgm_read32(v->data+0x18);
+    v->start = 0x40;
+    if(vgm_read32(v->data+0x08) >= 0x150 && vgm_read32(v->data+0x34))
+    {
+        uint64_t start = 0x34 + (uint64_t)vgm_read32(v->data+0x34);
+        v->start = start < v->size ? start : v->size;
+    }
+    if(v->start >= v->size)
+    {
+        snprintf(msg,msglen,"'%s' has an invalid data offset",filename);
+        QP_VgmClose(v);
+        return -1;
+    }
+    if(v->start >= 0x34)
+        v->chip[VGM_YM2151].clock = vgm_read32(v->data+0x30) & 0x3fffffff;
+    if(v->start >= 0xe0)
+        v->chip[VGM_C352].clock = vgm_read32(v->data+0xdc);
+    v->chip[VGM_YM2151].enabled = v->chip[VGM_YM2151].clock != 0;
+    v->chip[VGM_C352].enabled = (v->chip[VGM_C352].clock & 0x7fffffff) != 0;
+    if(!v->chip[VGM_YM2151].enabled && !v->chip[VGM_C352].enabled)
+    {
+        snprintf(msg,msglen,"'%s' has no C352 or YM2151",filename);
+        QP_VgmClose(v);
+        return -1;
+    }
+    if(vgm_load_blocks(v))
+    {
+        snprintf(msg,msglen,"'%s' has an invalid data block",filename);
+        QP_VgmClose(v);
+        return -1;
+    }
+
+    v->c352.mulaw_type = C352_MULAW_TYPE_C352;
+    QP_VgmRestart(v);
+    return 0;
+}
+
+void QP_VgmClose(QP_VgmPlayer* v)
+{
+    free(v->data);
+    free(v->wave);
+    v->data = NULL;
+    v->wave = NULL;
+}
+
+void QP_VgmRestart(QP_VgmPlayer* v)
+{
+    int i;
+    vgm_chip_init(v);
+    for(i=0;i<VGM_CHIPS;i++)
+    {
+        QP_VgmChip* c = &v->chip[i];
+        c->pos = 0;
+        c->updates = 0;
+        c->writes = 0;
+        c->time = 0;
+        c->hash = FNV_OFFSET;
+    }
+    v->pos = v->start;
+    v->position = 0;
+    v->wait = 0;
+    v->done = 0;
+}
+
+// Run each chip for the VGM samples, the fraction is carried to the next wait.
+static void vgm_update(QP_VgmPlayer* v,int samples)
+{
+    QP_VgmChip* c;
+    double t = 0;
+    int i,count;
+
+    c = &v->chip[VGM_C352];
+    if(c->enabled)
+    {
+        c->pos += samples*c->delta;
+        count = (int)c->pos;
+        c->pos -= count;
+        if(v->timing)
+            t = vgm_time();
+        for(i=0;i<count;i++)
+        {
+            C352_update(&v->c352);
+            c->hash = vgm_hash(c->hash,v->c352.out,v->c352.mute_rear ? 2 : 4);
+        }
+        if(v->timing)
+            c->time += vgm_time()-t;
+        c->updates += count;
+    }
+
+    c = &v->chip[VGM_YM2151];
+    if(c->enabled)
+    {
+        c->pos += samples*c->delta;
+        count = (int)c->pos;
+        c->pos -= count;
+        if(v->timing)
+            t = vgm_time();
+        for(i=0;i<count;i++)
+        {
+            YM2151_update(&v->ym2151);
+            c->hash = vgm_hash(c->hash,v->ym2151.out,2);
+        }
+        if(v->timing)
+            c->time += vgm_time()-t;
+        c->updates += count;
+    }
+    v->position += samples;
+}
+
+int QP_VgmRun(QP_VgmPlayer* v,int samples)
+{
+    int played = 0;
+    while(played < samples)
+    {
+        uint8_t* d = v->data+v->pos;
+        uint32_t left = v->size-v->pos;
+        int len = 1;
+
+        // a wait can continue over several calls
+        if(v->wait)
+        {
+            int n = v->wait < samples-played ? v->wait : samples-played;
+            vgm_update(v,n);
+            v->wait -= n;
+            played += n;
+            continue;
+        }
+        if(v->done)
+            break;
+        if(!left)
+        {
+            v->done = 1;
+            break;
+        }
+
+        switch(d[0])
+        {
+        case 0x61:
+            len = 3;
+            if(left >= 3)
+                v->wait = d[1] | d[2]<<8;
+            break;
+        case 0x62:
+            v->wait = 735;
+            break;
+        case 0x63:
+            v->wait = 882;
+            break;
+        case 0x66:
+            v->done = 1;
+            break;
+        case 0x67:
+            len = left >= 7 ? 7+(vgm_read32(d+3) & 0x7fffffff) : 7;
+            break;
+        case 0x54:
+            len = 3;
+            if(left >= 3 && v->chip[VGM_YM2151].enabled)
+            {
+                YM2151_write_reg(&v->ym2151,d[1],d[2]);
+                v->chip[VGM_YM2151].writes++;
+            }
+            break;
+        case 0xe1:
+            len = 5;
+            if(left >= 5 && v->chip[VGM_C352].enabled)
+            {
+                C352_write(&v->c352,d[1]<<8|d[2],d[3]<<8|d[4]);
+                v->chip[VGM_C352].writes++;
+            }
+            break;
+        default:
+            if(d[0] >= 0x70 && d[0] <= 0x8f)
+                v->wait = (d[0] & 0x0f) + (d[0] < 0x80);
+            else if(!(len = vgm_cmdlen(d[0])))
+                v->done = 1;
+            break;
+        }
+        if(len > left)
+        {
+            v->wait = 0;
+            v->done = 1;
+        }
+        if(!v->done)
+            v->pos += len;
+    }
+    return played;
+}
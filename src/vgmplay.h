@@ -0,0 +1,67 @@
+/*
+    VGM player
+
+    Reads a VGM file (uncompressed, as written by the VGM logger) and plays
+    the register writes to the C352 and YM2151 emulators, without the sound
+    driver. Used to benchmark and compare the chip emulation with recorded
+    game traffic.
+*/
+#ifndef VGMPLAY_H_INCLUDED
+#define VGMPLAY_H_INCLUDED
+
+#include <stdint.h>
+
+#include "emu/c352.h"
+#include "emu/ym2151.h"
+
+// VGM wait commands are in samples at this rate
+#define VGM_RATE 44100
+
+enum {
+    VGM_C352 = 0,
+    VGM_YM2151,
+    VGM_CHIPS
+};
+
+typedef struct {
+    int enabled; // chip clock is set in the header
+    uint32_t clock;
+    double delta; // chip updates per VGM sample
+    double pos;
+
+    // statistics
+    uint64_t updates;
+    uint64_t writes;
+    double time; // seconds spent in update calls
+    uint64_t hash; // of the output of every update
+} QP_VgmChip;
+
+typedef struct {
+    uint8_t* data;
+    uint32_t size;
+    uint32_t pos;
+    uint32_t start; // first command
+    uint32_t samples; // total length in VGM samples
+    int wait; // samples left in the current wait command
+    int done;
+
+    uint8_t* wave; // C352 rom from 0x92 data blocks
+    uint32_t wave_size;
+
+    QP_VgmChip chip[VGM_CHIPS];
+    C352 c352;
+    YM2151 ym2151;
+    int timing; // measure time spent in each chip
+
+    uint64_t position; // VGM samples played
+} QP_VgmPlayer;
+
+// Returns 0 if successful, otherwise the error is in msg.
+int QP_VgmOpen(QP_VgmPlayer* v,const char* filename,char* msg,int msglen);
+void QP_VgmClose(QP_VgmPlayer* v);
+// Start again from the beginning, with reset chips and statistics.
+void QP_VgmRestart(QP_VgmPlayer* v);
+// Play up to samples VGM samples. Returns the number played, 0 at the end.
+int QP_VgmRun(QP_VgmPlayer* v,int samples);
+
+#endif // VGMPLAY_H_INCLUDED